@@ -44,18 +44,184 @@
 #include "semphr.h"
 #include "queue.h"
 #include "stringbuffer.h"
+#include "logring.h"
+#include "logrtt.h"
+#include "logwire.h"
+#include "logsink.h"
+#include "logformat.h"
 
 #define LOGGING_ENABLED 1
 
+// The feature switches below are wrapped in #ifndef so a build can set them
+// with -D. The host tests build every one of them flipped, keep each
+// combination compiling without warnings.
+
+// Largest record, header and payload, a LOG_* call can queue
 #define LOG_MSG_BUFFER_SIZE 128
-#define LOG_BUFFER_SIZE 64
+// Storage of the log buffer in bytes, MUST be a power of two. It is split
+// into two halves: LOG_* calls fill one while logTask drains the other, so
+// the two never wait for each other. Records are packed, each takes its
+// actual length plus a 4-byte prefix.
+#define LOG_BUFFER_BYTES 8192
+
+// Size of the line rendered by logTask before it is sent over serial
+#define LOG_LINE_BUFFER_SIZE 256
+
+// logTask packs as many rendered records as fit into a staging buffer of
+// this size and hands them to a sink with a single write. The UART sink
+// has its own, sinks that write synchronously share another one.
+#define LOG_TX_BATCH_SIZE 1024
+// Most records in one batch
+#define LOG_TX_BATCH_RECORDS 48
+
+#if LOG_TX_BATCH_SIZE < LOG_LINE_BUFFER_SIZE
+  #error "LOG_TX_BATCH_SIZE must hold at least one LOG_LINE_BUFFER_SIZE line"
+#endif
+
+// When enabled the caller only captures the format pointer, a timestamp and
+// the raw argument words; all printf formatting is deferred to logTask.
+// Set to 0 to format the message on the calling task's stack instead.
+#ifndef LOG_DEFERRED_FORMATTING
+  #define LOG_DEFERRED_FORMATTING 1
+#endif
+
+// Maximum number of 32-bit argument words captured per deferred record
+#define LOG_MAX_ARG_WORDS 8
+
+// When enabled the built-in sinks send compact binary frames (call-site
+// ID, time delta and the captured arguments as varints, see logwire.h)
+// instead of text lines. Decode them on the host with Tools/logdecode.py
+// and the matching ELF. Requires LOG_DEFERRED_FORMATTING, as does any
+// sink added with LOG_SINK_BINARY.
+#ifndef LOG_WIRE_BINARY
+  #define LOG_WIRE_BINARY 0
+#endif
+// Most frames between two that carry the absolute time instead of the
+// delta, a decoder attached to a running target shows times from then on
+#define LOG_WIRE_SYNC_INTERVAL 32
+
+#if LOG_WIRE_BINARY && !LOG_DEFERRED_FORMATTING
+  #error "LOG_WIRE_BINARY requires LOG_DEFERRED_FORMATTING"
+#endif
+
+// When enabled records are queued in a lock-free ring (see logring.h)
+// instead of the mutex protected StringBuffer. Producers then never block
+// and never take a kernel object, a full ring drops the new record.
+#ifndef LOG_USE_LOCKFREE_RING
+  #define LOG_USE_LOCKFREE_RING 0
+#endif
+
+// What a LOG_* call does when the log buffer is full, see
+// StringBufferPolicy_e. With STR_BUF_BLOCK the calling task waits up to
+// LOG_BLOCK_TIMEOUT_MS for logTask to make room before the record is lost.
+// The lock-free ring and the ISR records always lose the new record.
+// Lost records are counted and reported by logTask.
+#ifndef LOG_BUFFER_POLICY
+  #define LOG_BUFFER_POLICY STR_BUF_OVERWRITE_OLDEST
+#endif
+#define LOG_BLOCK_TIMEOUT_MS 20
+
+// Storage of the lock-free ring in bytes, MUST be a power of two
+#define LOG_RING_SIZE 4096
+
+// Number of fixed-size records queued by LOG_*_FROM_ISR, MUST be a power of two
+#define LOG_ISR_BUFFER_SIZE 32
+// Maximum number of 32-bit arguments of a LOG_*_FROM_ISR call
+#define LOG_ISR_MAX_ARGS 4
+
+// Records logTask keeps for the sinks, MUST be a power of two. Each sink
+// sends from its own cursor into them, see logsink.h. A sink that falls
+// further behind than this loses its oldest records, the others never
+// wait for it.
+#define LOG_SINK_RING_SIZE 4096
+
+#if LOG_SINK_RING_SIZE < 4 * LOG_MSG_BUFFER_SIZE
+  #error "LOG_SINK_RING_SIZE must hold a few LOG_MSG_BUFFER_SIZE records"
+#endif
+
+// Built-in sinks loggingInit adds, both may be enabled and more can be
+// added with loggingAddSink. LOG_OUTPUT_RTT copies the output into a RAM
+// ring a debug probe reads while the core runs, see logrtt.h. It costs a
+// memcpy per batch and no UART time.
+#ifndef LOG_OUTPUT_UART
+  #define LOG_OUTPUT_UART 1
+#endif
+#ifndef LOG_OUTPUT_RTT
+  #define LOG_OUTPUT_RTT 0
+#endif
+// Most verbose level each of them sends, e.g. LOG_LEVEL_WARNING keeps a
+// slow UART free for what matters while RTT still shows everything
+#define LOG_UART_LEVEL LOG_LEVEL_INFO
+#define LOG_RTT_LEVEL LOG_LEVEL_INFO
+
+// UART the UART sink writes to
+#define LOG_UART_HANDLE huart1
+// Send log lines with HAL_UART_Transmit_DMA on USART1's DMA2 stream 7
+// instead of busy waiting in HAL_UART_Transmit
+#ifndef LOG_UART_USE_DMA
+  #define LOG_UART_USE_DMA 1
+#endif
+// Time a DMA transfer may take beyond what its bytes need at the UART's
+// baud rate before it is aborted, so larger batches or a slower UART never
+// cut a healthy transfer short. Also how often logTask polls a sink that
+// does not report the completion of its writes.
+#define LOG_TX_TIMEOUT_MS 100
+// Storage of the RTT up-buffer in bytes
+#define LOG_RTT_BUFFER_SIZE 4096
+// A batch the RTT ring has no room for, e.g. while no probe reads, is
+// dropped whole (LOG_RTT_MODE_NO_BLOCK_SKIP) or cut (..._TRIM)
+#ifndef LOG_RTT_MODE
+  #define LOG_RTT_MODE LOG_RTT_MODE_NO_BLOCK_SKIP
+#endif
+
+// logTask sleeps until a record is queued, then flushes as soon as
+// LOG_WAKEUP_WATERMARK records are pending or an ERROR record arrives, and
+// at the latest LOG_MAX_LATENCY_MS after it was woken
+#define LOG_WAKEUP_WATERMARK 32
+#define LOG_MAX_LATENCY_MS 10
 
-#define LOGGING_TASK_PERIOD_MS 10
+// Per call site token bucket: LOG_RATE_LIMIT_BURST records pass back to
+// back, after that LOG_RATE_LIMIT_PER_SEC per second. Set to 0 to disable.
+#ifndef LOG_RATE_LIMIT_PER_SEC
+  #define LOG_RATE_LIMIT_PER_SEC 20
+#endif
+#define LOG_RATE_LIMIT_BURST 10
+
+// Collapse identical messages from the same call site arriving within
+// LOG_REPORT_INTERVAL_MS of each other into "last message repeated N times".
+// Off by default, a heartbeat logged more often than that would only show
+// up in the reports. Deferred %s arguments compare by address, not text.
+#ifndef LOG_SUPPRESS_DUPLICATES
+  #define LOG_SUPPRESS_DUPLICATES 0
+#endif
+
+// Rate limited and collapsed messages are counted per call site and
+// reported by logTask at most this often, together with lost records
+#define LOG_REPORT_INTERVAL_MS 1000
+
+// Pipeline statistics read with loggingGetStats: records produced and
+// truncated, queue high-water marks, bytes sent and how long records take
+// from the LOG_* call to the end of their transfer. Costs a few atomic
+// updates per record. Every LOG_STATS_INTERVAL_MS, if anything was logged
+// in the meantime, logTask also logs a summary of them.
+#ifndef LOG_PIPELINE_STATS
+  #define LOG_PIPELINE_STATS 1
+#endif
+#define LOG_STATS_INTERVAL_MS 10000
+// Latency histogram: bucket i counts records that took 2^i to 2^(i+1) - 1
+// us, bucket 0 also counts 0 us and the last bucket everything longer
+#define LOG_LATENCY_BUCKETS 20
 
 #define LOG_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+// Words, 2 KiB. logTask renders messages itself: its deepest call chain,
+// through log_render and the formatter's %f path, measures about 1.2 KiB
+// in a 64-bit host build (gcc -O2 -fcallgraph-info=su). Kernel and HAL
+// calls and the exception frame come on top, LogStats_t.stack_free_min
+// tells the margin left on the target.
+#define LOG_TASK_STACK_SIZE (configMINIMAL_STACK_SIZE * 4)
 
-// UART handle used by the logging task to output logs to serial
-extern UART_HandleTypeDef huart1;
+// UART handle used by the UART sink to output logs to serial
+extern UART_HandleTypeDef LOG_UART_HANDLE;
 // Mutex used to protect access to log buffer
 extern xSemaphoreHandle logMutex;
 
@@ -93,33 +259,173 @@ typedef enum {
   #define LOG_LEVEL LOG_LEVEL_SETTING_INFO
 #endif
 
-void logging(const char *file, int line, const char *func, LogLevel_e level, const char *log_str, ...);
+// MODULE TAG
+// Place a module tag in your c file, before including logging.h, to switch
+// the levels of all its call sites at runtime with loggingSetModuleLevel.
+// Only the first LOG_MODULE_TAG_MAX characters of the tag are significant.
+// #define LOG_MODULE "main"
+#ifndef LOG_MODULE
+  #define LOG_MODULE "app"
+#endif
+
+#define LOG_MODULE_TAG_MAX 16
+
+// Compile-time hash of a string literal tag, matched at runtime against the
+// hash of the name given to loggingSetModuleLevel: sum of tag[i] * 31^i
+#define LOG_TAG_CHAR(tag, i, k) \
+  ((uint32_t)((i) < sizeof(tag) - 1 ? (uint8_t)(tag)[(i) < sizeof(tag) ? (i) : 0] : 0) * (k))
+#define LOG_MODULE_HASH(tag) \
+  (LOG_TAG_CHAR(tag, 0,  0x00000001u) + LOG_TAG_CHAR(tag, 1,  0x0000001Fu) + \
+   LOG_TAG_CHAR(tag, 2,  0x000003C1u) + LOG_TAG_CHAR(tag, 3,  0x0000745Fu) + \
+   LOG_TAG_CHAR(tag, 4,  0x000E1781u) + LOG_TAG_CHAR(tag, 5,  0x01B4D89Fu) + \
+   LOG_TAG_CHAR(tag, 6,  0x34E63B41u) + LOG_TAG_CHAR(tag, 7,  0x67E12CDFu) + \
+   LOG_TAG_CHAR(tag, 8,  0x94446F01u) + LOG_TAG_CHAR(tag, 9,  0xF449711Fu) + \
+   LOG_TAG_CHAR(tag, 10, 0x94E4B2C1u) + LOG_TAG_CHAR(tag, 11, 0x07B1A55Fu) + \
+   LOG_TAG_CHAR(tag, 12, 0xEE830681u) + LOG_TAG_CHAR(tag, 13, 0xE1DDC99Fu) + \
+   LOG_TAG_CHAR(tag, 14, 0x59DB6A41u) + LOG_TAG_CHAR(tag, 15, 0xE191DDDFu))
+
+// Runtime state of a single call site, kept in RAM next to its constant
+// description
+typedef struct {
+  volatile uint8_t enabled;   // Runtime switch tested before the call is made
+#if LOG_RATE_LIMIT_PER_SEC
+  uint64_t allowed_at;        // Rate limit: cycle count the bucket is full again
+  uint32_t suppressed;        // Calls dropped by the rate limit, not yet reported
+#endif
+#if LOG_SUPPRESS_DUPLICATES
+  uint64_t last_seen;         // Cycle count of the last call
+  uint32_t last_hash;         // Hash of the last message, 0 if none
+  uint32_t repeated;          // Duplicates collapsed, not yet reported
+#endif
+} LogCallSiteState_t;
+
+// Static description of a single LOG_* call site. Every call site owns one
+// constant instance so a log record only has to carry a pointer to it.
+// Instances are collected in the LOG_CALL_SITE_SECTION linker section, the
+// index of an instance in that section is its 16-bit call-site ID. The
+// layout is read by Tools/logdecode.py, keep both in sync.
+typedef struct {
+  const char *file;
+  const char *func;
+  const char *format;
+  uint16_t line;
+  uint8_t level;
+  uint8_t reserved;
+  uint32_t module;            // LOG_MODULE_HASH of the call site's LOG_MODULE
+  LogCallSiteState_t *state;
+} LogCallSite_t;
+
+#define LOG_CALL_SITE_SECTION "log_callsites"
+
+// Bounds of the call-site section, provided by the linker
+extern const LogCallSite_t __start_log_callsites[];
+extern const LogCallSite_t __stop_log_callsites[];
+
+#define LOG_CALL_SITE_ID(site) ((uint16_t)((site) - __start_log_callsites))
+
+void logging(const LogCallSite_t *site, ...);
+
+// Disabled call sites cost a load and a branch, arguments are not evaluated
+#define LOG_CALL_SITE(log_level, log_str, ...) \
+  do { \
+    static LogCallSiteState_t log_site_state = { .enabled = 1 }; \
+    __attribute__((section(LOG_CALL_SITE_SECTION), used, aligned(4))) \
+    static const LogCallSite_t log_site = { __FILE__, __func__, log_str, __LINE__, log_level, 0, \
+                                            LOG_MODULE_HASH(LOG_MODULE), &log_site_state }; \
+    if (log_site_state.enabled) \
+      logging(&log_site, ##__VA_ARGS__); \
+  } while (0)
+
+void logging_from_isr(const LogCallSite_t *site, uint32_t nargs, const uint32_t *args);
+
+// Counts the arguments of a LOG_*_FROM_ISR call (0 to LOG_ISR_MAX_ARGS)
+#define LOG_NARGS(...) LOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, N, ...) N
+
+// ISR variant: arguments are converted to 32-bit words at the call site and
+// copied into a fixed-size record, no format string is parsed. Only integer
+// conversions (%d %i %u %x %X %o %c) are supported, %s prints nothing.
+// Callable from interrupts at or below configMAX_SYSCALL_INTERRUPT_PRIORITY.
+#define LOG_CALL_SITE_FROM_ISR(log_level, log_str, ...) \
+  do { \
+    static LogCallSiteState_t log_site_state = { .enabled = 1 }; \
+    __attribute__((section(LOG_CALL_SITE_SECTION), used, aligned(4))) \
+    static const LogCallSite_t log_site = { __FILE__, __func__, log_str, __LINE__, log_level, 0, \
+                                            LOG_MODULE_HASH(LOG_MODULE), &log_site_state }; \
+    if (log_site_state.enabled) \
+      logging_from_isr(&log_site, LOG_NARGS(__VA_ARGS__), (const uint32_t[LOG_ISR_MAX_ARGS]){ __VA_ARGS__ }); \
+  } while (0)
 
 #ifdef LOGGING_ENABLED
   #if LOG_LEVEL >= LOG_LEVEL_SETTING_ERROR
-    #define LOG_ERROR(log_str, ...) logging(__FILE__, __LINE__, __func__, LOG_LEVEL_ERROR, log_str, ##__VA_ARGS__)
+    #define LOG_ERROR(log_str, ...) LOG_CALL_SITE(LOG_LEVEL_ERROR, log_str, ##__VA_ARGS__)
+    #define LOG_ERROR_FROM_ISR(log_str, ...) LOG_CALL_SITE_FROM_ISR(LOG_LEVEL_ERROR, log_str, ##__VA_ARGS__)
   #else
     #define LOG_ERROR(log_str, ...)
+    #define LOG_ERROR_FROM_ISR(log_str, ...)
   #endif
 
   #if LOG_LEVEL >= LOG_LEVEL_SETTING_WARNING
-    #define LOG_WARNING(log_str, ...) logging(__FILE__, __LINE__, __func__, LOG_LEVEL_WARNING, log_str, ##__VA_ARGS__)
+    #define LOG_WARNING(log_str, ...) LOG_CALL_SITE(LOG_LEVEL_WARNING, log_str, ##__VA_ARGS__)
+    #define LOG_WARNING_FROM_ISR(log_str, ...) LOG_CALL_SITE_FROM_ISR(LOG_LEVEL_WARNING, log_str, ##__VA_ARGS__)
   #else
     #define LOG_WARNING(log_str, ...)
+    #define LOG_WARNING_FROM_ISR(log_str, ...)
   #endif
 
   #if LOG_LEVEL >= LOG_LEVEL_SETTING_INFO
-    #define LOG_INFO(log_str, ...) logging(__FILE__, __LINE__, __func__, LOG_LEVEL_INFO, log_str, ##__VA_ARGS__)
+    #define LOG_INFO(log_str, ...) LOG_CALL_SITE(LOG_LEVEL_INFO, log_str, ##__VA_ARGS__)
+    #define LOG_INFO_FROM_ISR(log_str, ...) LOG_CALL_SITE_FROM_ISR(LOG_LEVEL_INFO, log_str, ##__VA_ARGS__)
   #else
     #define LOG_INFO(log_str, ...)
+    #define LOG_INFO_FROM_ISR(log_str, ...)
   #endif
 #else // LOGGING_ENABLED
   #define LOG_ERROR(log_str, ...)
   #define LOG_WARNING(log_str, ...)
   #define LOG_INFO(log_str, ...)
+  #define LOG_ERROR_FROM_ISR(log_str, ...)
+  #define LOG_WARNING_FROM_ISR(log_str, ...)
+  #define LOG_INFO_FROM_ISR(log_str, ...)
 #endif // LOGGING_ENABLED
 
+// Counters kept by logTask, read with loggingGetStats
+typedef struct {
+  uint32_t wakeups;            // Times logTask woke up to flush
+  uint32_t idle_wakeups;       // Wakeups that found nothing to send
+  uint32_t error_latency_last; // us from the last LOG_ERROR call to its transfer
+                               // start on the first sink
+  uint32_t error_latency_max;  // Largest error_latency_last seen
+  uint32_t suppressed;         // Calls dropped by the rate limit
+  uint32_t repeated;           // Duplicate calls collapsed
+  uint32_t lost;               // Records lost to a full buffer, task and ISR
+  uint32_t rtt_dropped;        // Bytes the RTT up-buffer had no room for
+  uint32_t sink_dropped;       // Records sinks fell too far behind to send
+  // Collected with LOG_PIPELINE_STATS, 0 otherwise
+  uint32_t produced;           // Records queued by LOG_* calls, task and ISR
+  uint32_t truncated;          // Records cut short to fit LOG_MSG_BUFFER_SIZE
+  uint32_t record_max;         // Largest task record queued, header included
+  uint32_t pending_max;        // Most records queued at once, task and ISR
+  uint32_t buffer_max;         // Most bytes in use in the producer side of
+                               // the log buffer, or in the lock-free ring
+  uint32_t wire_bytes;         // Bytes handed to the sinks, all of them
+  uint32_t wire_bytes_per_sec; // Average over the last stats interval
+  uint32_t stack_free_min;     // Least of logTask's stack ever left unused,
+                               // bytes, to size LOG_TASK_STACK_SIZE from
+  // Latencies are measured on the first sink, the UART when enabled
+  uint32_t latency_max;        // Longest LOG_* call to end of transfer, us
+  uint32_t latency[LOG_LATENCY_BUCKETS]; // Records per latency bucket
+} LogStats_t;
+
 void loggingInit(void);
 void logTask(void *pvParameters);
+void loggingGetStats(LogStats_t *stats);
+
+int loggingAddSink(LogSink *sink);
+void loggingSinkDone(LogSink *sink);
+void loggingSinkDoneFromISR(LogSink *sink, BaseType_t *higher_priority_task_woken);
+
+int loggingSetModuleLevel(const char *module, LogLevel_e level);
+int loggingSetCallSiteEnabled(uint16_t id, uint8_t enabled);
 
 #endif // _LOGGING_H_
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*****************************************************************************
+* | File        : logring.h
+* | Author      : Luke Mulder
+* | Function    : Lock-free multi-producer single-consumer record ring
+* | Info        :
+*   This header defines a byte ring that stores variable length records and
+*   can be written by any number of tasks without taking a mutex or entering
+*   a critical section. Producers claim space with a compare-and-swap on the
+*   head cursor (LDREX/STREX on the Cortex-M7 through C11 atomics), fill the
+*   record in place and then publish it. A single consumer reads published
+*   records in order and releases them once they are no longer needed.
+*
+*   Key features include:
+*     - Producers never block: when the ring is full the record is dropped
+*       and counted instead.
+*     - Reserve/commit interface so records are written directly into the
+*       ring storage. A reservation can be committed shorter or cancelled.
+*     - Records are always contiguous in memory, a record that would cross
+*       the end of the storage is moved to the start behind a padding entry.
+*
+*   Usage scenarios:
+*     - Log capture from several tasks without priority inversion.
+*     - Any event stream with many writers and one draining task.
+*
+* | This version:   V1.0
+* | Date        :   2024-07-02
+* | Info        :   Basic version
+*   - Reserve, commit, peek and release operations.
+*   - Drop accounting when producers find the ring full.
+*
+*****************************************************************************/
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+typedef struct {
+    uint8_t* buf;
+    uint32_t size;
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t dropped;
+} LogRing;
+
+// Largest payload a single record may hold
+#define LOG_RING_MAX_RECORD 0x3FFF
+
+int log_ring_init(LogRing *ring, uint8_t *storage, size_t size);
+
+void* log_ring_reserve(LogRing *ring, size_t len);
+void log_ring_commit(LogRing *ring, void *record, size_t len);
+void log_ring_cancel(LogRing *ring, void *record);
+
+size_t log_ring_peek(LogRing *ring, void **record);
+void log_ring_release(LogRing *ring);
+
+uint32_t log_ring_dropped(LogRing *ring);
+uint32_t log_ring_used(LogRing *ring);
+
+#endif // LOGRING_H
@@ -0,0 +1,76 @@
+/*****************************************************************************
+* | File        : logrtt.h
+* | Author      : Luke Mulder
+* | Function    : Memory mapped log channel read by a debug probe
+* | Info        :
+*   This header defines a control block in RAM laid out like SEGGER RTT's,
+*   so a debug probe (J-Link, OpenOCD "rtt", probe-rs) or a RAM dump parser
+*   finds it by its ID and reads the log output straight from memory. No
+*   peripheral is involved and the target never waits for the host: the
+*   probe reads through the debug port while the core keeps running.
+*
+*   Layout, all fields 32-bit words on the Cortex-M7:
+*     id[16]       "SEGGER RTT", written last so a half set up block is
+*                  never found
+*     max_up       Number of up-buffers (target to host), 1
+*     max_down     Number of down-buffers (host to target), 0
+*     up[0]        name, buf, size, wr_off, rd_off, flags
+*
+*   The up-buffer is a byte ring of size bytes. The target only moves
+*   wr_off, the probe only moves rd_off, wr_off == rd_off means empty and
+*   one byte always stays free. The low bits of flags tell the probe what
+*   the target does when the ring is full, see LOG_RTT_MODE_*.
+*
+*   Key features include:
+*     - Lock free between target and probe, each side owns one offset.
+*     - Works with the D-cache on: written bytes and the descriptor are
+*       cleaned to RAM, the probe's read offset is fetched from RAM. Should
+*       the probe move rd_off while the descriptor line is being written
+*       back, the old value returns and some bytes are shown twice. Placing
+*       the block in DTCM (from 0x20000000, never cached) avoids this.
+*
+* | This version:   V1.0
+* | Date        :   2024-07-24
+* | Info        :   Basic version
+*   - One up-buffer, skip or trim when full.
+*
+*****************************************************************************/
+#ifndef LOGRTT_H
+#define LOGRTT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// ID a probe scans RAM for, the field is 16 bytes
+#define LOG_RTT_ID "SEGGER RTT"
+#define LOG_RTT_ID_SIZE 16
+
+// Up-buffer modes, the values SEGGER RTT uses in the flags field
+#define LOG_RTT_MODE_NO_BLOCK_SKIP 0  // Data that does not fit whole is dropped
+#define LOG_RTT_MODE_NO_BLOCK_TRIM 1  // As much as fits is written, the rest dropped
+#define LOG_RTT_MODE_MASK          3
+
+// Ring descriptor, read and written by the probe
+typedef struct {
+    const char* name;
+    uint8_t* buf;
+    uint32_t size;
+    volatile uint32_t wr_off;
+    volatile uint32_t rd_off;
+    uint32_t flags;
+} LogRttBuffer;
+
+// Whole cache lines, so invalidating the block never touches other data
+typedef struct {
+    char id[LOG_RTT_ID_SIZE];
+    int32_t max_up;
+    int32_t max_down;
+    LogRttBuffer up[1];
+} __attribute__((aligned(32))) LogRttControlBlock;
+
+int log_rtt_init(LogRttControlBlock *cb, const char *name, uint8_t *storage, size_t size, uint32_t mode);
+
+size_t log_rtt_write(LogRttControlBlock *cb, const void *data, size_t len);
+size_t log_rtt_space(LogRttControlBlock *cb);
+
+#endif // LOGRTT_H
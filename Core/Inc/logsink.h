@@ -0,0 +1,88 @@
+/*****************************************************************************
+* | File        : logsink.h
+* | Author      : Luke Mulder
+* | Function    : Log outputs and the record ring they read from
+* | Info        :
+*   This header defines a sink, one place log output goes to (UART, RTT,
+*   flash, a RAM trace, ...), and the ring logTask keeps records in for
+*   all of them. A record is stored once and every sink reads it from its
+*   own cursor, so each sink goes at its own pace: a sink still busy with
+*   its last write is simply not handed more, the others carry on.
+*
+*   Every entry carries the level of its record. A sink only sees entries
+*   at or below its own level, the rest it steps over.
+*
+*   The ring only frees space all cursors have passed. When it is full the
+*   owner decides: wait for the sinks to catch up, or push anyway. A push
+*   into a full ring drops the oldest entries, the sinks that had not read
+*   them yet count them in their dropped field.
+*
+*   Key features include:
+*     - One writer, any number of sinks reading at their own pace.
+*     - Entries are always contiguous in memory, one that would cross the
+*       end of the storage is moved to the start behind a padding entry.
+*     - Per sink level and encoding, see LogSinkEncoding_e.
+*
+* | This version:   V1.0
+* | Date        :   2024-08-16
+* | Info        :   Basic version
+*   - Push, peek and advance, level filtering and drop accounting.
+*
+*****************************************************************************/
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "logwire.h"
+
+// What a sink is sent
+typedef enum {
+  LOG_SINK_TEXT = 0,    // Rendered text lines
+  LOG_SINK_BINARY       // Binary frames, see logwire.h
+} LogSinkEncoding_e;
+
+typedef struct LogSink LogSink;
+
+struct LogSink {
+    // Set up by the owner before the sink is attached
+    const char* name;
+    uint8_t level;              // Most verbose level sent, 0 sends nothing
+    uint8_t encoding;           // LogSinkEncoding_e
+    // Starts sending len bytes of data. Returns 0 if the bytes were taken,
+    // nonzero if they are lost. data stays untouched until flush returns 0.
+    int (*write)(LogSink *sink, const uint8_t *data, size_t len);
+    // Waits up to timeout_ms for the last write to complete, returns 0 once
+    // it has. NULL if write only returns when done.
+    int (*flush)(LogSink *sink, uint32_t timeout_ms);
+    void* ctx;                  // For the callbacks
+    uint8_t* buf;               // Staging buffer, see loggingAddSink
+    uint32_t buf_size;
+    // Kept by the ring and logTask
+    LogSink* next;
+    uint32_t cursor;            // Position of the next entry to read
+    uint32_t dropped;           // Entries dropped before they were read
+    uint32_t dropped_reported;
+    volatile uint8_t busy;      // A write has not completed yet
+    volatile uint64_t done_at;  // When it did, 0 if not known
+    LogWireEncoder wire;        // Binary sinks: delta timestamps
+};
+
+typedef struct {
+    uint8_t* buf;
+    uint32_t size;
+    uint32_t head;              // Where the next entry goes
+    uint32_t tail;              // Oldest entry a sink may still read
+    LogSink* sinks;             // In the order they were attached
+} LogSinkRing;
+
+int log_sink_ring_init(LogSinkRing *ring, uint8_t *storage, size_t size);
+int log_sink_attach(LogSinkRing *ring, LogSink *sink);
+
+uint8_t log_sink_ring_fits(LogSinkRing *ring, size_t len);
+int log_sink_ring_push(LogSinkRing *ring, const void *data, size_t len, uint8_t level);
+
+size_t log_sink_ring_peek(LogSinkRing *ring, LogSink *sink, void **entry);
+void log_sink_ring_advance(LogSinkRing *ring, LogSink *sink);
+
+#endif // LOGSINK_H
@@ -0,0 +1,79 @@
+/*****************************************************************************
+* | File        : logwire.h
+* | Author      : Luke Mulder
+* | Function    : Compact binary frames for the log wire
+* | Info        :
+*   This header defines the frame logTask sends with LOG_WIRE_BINARY. A
+*   frame only carries what the host cannot look up in the firmware ELF:
+*   the call-site ID, the timestamp and the captured arguments. All fields
+*   after the first two bytes are LEB128 varints, 7 bits per byte, low
+*   bits first, so small values take a single byte.
+*
+*   Layout:
+*     sync         0xA5
+*     flags        Bits 0-1 the level, LOG_WIRE_* bits above, bits 4-7 zero
+*     id           Call-site ID
+*     time         Zigzag encoded cycle delta to the previous frame, or the
+*                  absolute cycle count with LOG_WIRE_ABSOLUTE
+*     nwords       Number of argument words
+*     words        Each word zigzag encoded as an int32_t
+*     arena_len    Length of the %s string arena following it
+*
+*   Key features include:
+*     - A record with two small integer arguments takes about a dozen
+*       bytes instead of the 60 to 100 of its text line.
+*     - Type agnostic arguments: small positive and negative integers both
+*       take one byte and every word, pointers and halves of a double
+*       included, is restored bit exact.
+*     - A decoder joining a running stream synchronizes on the sync byte
+*       and takes the time from the next LOG_WIRE_ABSOLUTE frame, sent at
+*       least every sync_interval frames.
+*
+* | This version:   V1.0
+* | Date        :   2024-08-02
+* | Info        :   Basic version
+*   - Varint frames with delta timestamps, decoded by Tools/logdecode.py.
+*
+*****************************************************************************/
+#ifndef LOGWIRE_H
+#define LOGWIRE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define LOG_WIRE_SYNC 0xA5
+
+// Frame flags besides the level in bits 0-1
+#define LOG_WIRE_LEVEL_MASK 0x03
+#define LOG_WIRE_REPORT     0x04  // Suppression report: repeated and rate limited counts
+#define LOG_WIRE_ABSOLUTE   0x08  // time is the absolute cycle count
+
+// Longest varint of a 64-bit value
+#define LOG_WIRE_VARINT_MAX 10
+
+// Upper bound of a frame's size, arena_len below 2^21
+#define LOG_WIRE_FRAME_MAX(nwords, arena_len) \
+  (2 + 3 + LOG_WIRE_VARINT_MAX + 2 + 5 * (nwords) + 3 + (arena_len))
+
+typedef struct {
+    uint64_t last;            // Timestamp of the previous frame
+    uint32_t since_absolute;  // Frames sent since the last absolute time
+    uint32_t sync_interval;
+} LogWireEncoder;
+
+typedef struct {
+    uint16_t id;
+    uint8_t flags;            // Level and LOG_WIRE_REPORT
+    uint8_t nwords;
+    uint64_t timestamp;
+    const uint32_t* words;
+    const uint8_t* arena;
+    size_t arena_len;
+} LogWireFrame;
+
+void log_wire_init(LogWireEncoder *enc, uint32_t sync_interval);
+
+size_t log_wire_varint(uint64_t value, uint8_t *out);
+size_t log_wire_encode(LogWireEncoder *enc, const LogWireFrame *frame, uint8_t *out, size_t size);
+
+#endif // LOGWIRE_H
@@ -13,10 +13,25 @@
 *   Key features include:
 *     - Circular buffer logic to continuously manage data without needing
 *       to reset the buffer manually.
+*     - Entries are packed back to back behind a length prefix, a short entry
+*       only takes the storage it needs and only its bytes are copied. Reads
+*       return the stored length, nothing is measured with strlen.
+*       Entries never wrap, one that would cross the end of the storage is
+*       moved to the start behind a padding entry so every entry can be
+*       read in place.
 *     - Dynamic handling of string data with configurable maximum string length
 *       and buffer size.
-*     - Automatic memory management including initialization and deallocation.
-*     - Overwrite capability when the buffer is full to ensure ongoing operations.
+*     - Automatic memory management including initialization and deallocation,
+*       or static instances declared with STR_BUF_DEFINE that need no heap.
+*     - Reserve/commit writes: an entry is claimed at its largest size,
+*       filled in place, e.g. by vsnprintf, and committed with its final
+*       length, the rest of the claim is handed back.
+*     - Lease/release reads: entries are used in place, e.g. by a DMA
+*       transfer, and are protected from being overwritten until released.
+*       All pending entries can be leased at once as at most two regions.
+*     - Selectable overflow policy when the buffer is full: overwrite the
+*       oldest entry, drop the new one, or let the caller block and retry.
+*     - Loss accounting, dropped entries and bytes are counted per buffer.
 *
 *   Usage scenarios:
 *     - Logging systems where recent messages are more critical than older ones.
@@ -42,26 +57,87 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-#define STRING_BUFFER_SIZE 64
+// Storage in bytes, MUST be a power of two
+#define STRING_BUFFER_SIZE 16384
 #define STRING_BUFFER_MAX_LENGTH 256
 
+// Length prefix stored in front of every entry
+#define STR_BUF_HEADER_SIZE sizeof(uint32_t)
+
+// Storage taken by an entry of len bytes, prefix included, word aligned
+#define STR_BUF_ENTRY_SIZE(len) (((len) + STR_BUF_HEADER_SIZE + 3) & ~(size_t)3)
+
+// What a push does when the storage has no room
+typedef enum {
+    STR_BUF_OVERWRITE_OLDEST = 0,  // Default, the oldest entry is lost, the
+                                   // new one if the oldest is leased
+    STR_BUF_DROP_NEWEST,           // The pushed entry is lost
+    STR_BUF_BLOCK                  // Nothing is stored or counted, the caller
+                                   // waits for room and pushes again, or gives
+                                   // up with str_buf_discard
+} StringBufferPolicy_e;
+
+// Push results besides 0 (stored) and -1 (invalid arguments)
+#define STR_BUF_OVERWROTE 1   // Stored, the oldest entry was dropped
+#define STR_BUF_FULL     -2   // Not stored, the buffer is full
+
+// Contiguous region of storage handed out by str_buf_lease_spans
 typedef struct {
-    char** buf;
-    size_t head;
-    size_t tail;
-    size_t count;
-    size_t buf_size;
-    size_t str_size;
+    const uint8_t* data;
+    size_t len;
+} StrBufSpan;
+
+typedef struct {
+    uint8_t* buf;
+    size_t head;           // Free running byte position of the next entry
+    size_t tail;           // Free running byte position of the oldest entry
+    size_t count;          // Entries stored
+    size_t buf_size;       // Storage in bytes
+    size_t str_size;       // Largest entry in bytes
+    StringBufferPolicy_e policy;
+    size_t dropped;        // Entries lost to overflow
+    size_t dropped_bytes;  // Bytes lost to overflow
+    size_t leased;         // Oldest entries handed out by str_buf_lease
+    size_t lease_pos;      // Byte position of the first entry not leased
+    size_t wrap_pos;       // Byte position of the last padding entry
+    uint8_t allocated;     // buf came from malloc and is freed by str_buf_free
 } StringBuffer;
 
+// Defines a ready to use StringBuffer with size bytes of static storage, no
+// init call or heap allocation needed. The storage lands in .bss unless an
+// attribute is passed as the last argument, e.g.
+//   STR_BUF_DEFINE(static, rx_buffer, 4096, 64, __attribute__((section(".dtcm"))));
+// The first argument is the storage class of the instance, static or empty.
+#define STR_BUF_DEFINE(storage_class, name, size, str_len, ...) \
+  _Static_assert(((size) & ((size) - 1)) == 0, #name " size MUST be a power of 2"); \
+  _Static_assert(STR_BUF_ENTRY_SIZE(str_len) <= (size) / 2, #name " entries MUST fit twice"); \
+  static uint8_t name##_storage[size] __attribute__((aligned(4))) __VA_ARGS__; \
+  storage_class StringBuffer name = { .buf = name##_storage, .buf_size = (size), .str_size = (str_len) }
+
 int str_buf_init_custom_size(StringBuffer *sb, size_t buf_size, size_t str_size);
 int str_buf_init(StringBuffer *sb);
+int str_buf_init_static(StringBuffer *sb, uint8_t *storage, size_t buf_size, size_t str_size);
 int str_buf_free(StringBuffer *sb);
+int str_buf_set_policy(StringBuffer *sb, StringBufferPolicy_e policy);
 
 int str_buf_push(StringBuffer *sb, const char* data);
+int str_buf_push_data(StringBuffer *sb, const void* data, size_t len);
+int str_buf_discard(StringBuffer *sb, size_t len);
+void* str_buf_reserve(StringBuffer *sb, size_t len, int *status);
+int str_buf_commit(StringBuffer *sb, void* entry, size_t len);
+int str_buf_cancel(StringBuffer *sb, void* entry);
 int str_buf_pop(StringBuffer *sb, char** data);
+size_t str_buf_pop_data(StringBuffer *sb, void** data);
+int str_buf_peek(StringBuffer *sb, char** data);
+size_t str_buf_peek_data(StringBuffer *sb, void** data);
+size_t str_buf_lease(StringBuffer *sb, void** data);
+int str_buf_release(StringBuffer *sb, size_t n);
+size_t str_buf_lease_spans(StringBuffer *sb, StrBufSpan spans[2]);
 
 size_t str_buff_count(StringBuffer *sb);
 size_t str_buff_max_str_len(StringBuffer *sb);
+size_t str_buff_dropped(StringBuffer *sb);
+size_t str_buff_dropped_bytes(StringBuffer *sb);
+size_t str_buff_used_bytes(StringBuffer *sb);
 
 #endif // STRINGBUFFER_H
\ No newline at end of file
@@ -0,0 +1,164 @@
+/*****************************************************************************
+* | File        : typedring.h
+* | Author      : Luke Mulder
+* | Function    : Generic ring buffer for fixed-size binary records
+* | Info        :
+*   This header generates circular buffers for any plain data type, e.g.
+*   sensor samples, trace events or telemetry structs. TYPED_RING_DEFINE
+*   expands to a ring type and its inline functions, all named after the
+*   given prefix. Capacity is a compile-time power of two so positions are
+*   masked instead of using modulus, as in stringbuffer.c.
+*
+*   Key features include:
+*     - Elements are copied by value with memcpy, single or in bulk. A bulk
+*       push or pop takes at most two copies, before and after the wrap.
+*     - TYPED_RING_DEFINE_SPSC variant that is safe without a lock for one
+*       producer and one consumer, e.g. an interrupt and a task. Cursors are
+*       published with C11 acquire/release ordering.
+*     - Element storage is aligned to the Cortex-M7 D-cache line and the
+*       cursors start on the next line, so the elements can be cleaned or
+*       invalidated for DMA without touching the cursors or other data.
+*     - Zero initialized instances are empty, they can live in .bss without
+*       an init call.
+*
+*   Usage:
+*     typedef struct { uint16_t ch[4]; uint32_t time; } Sample_t;
+*     TYPED_RING_DEFINE_SPSC(sample_ring, Sample_t, 64);
+*     static sample_ring_t samples;
+*
+*     sample_ring_push(&samples, &sample);         // ADC interrupt
+*     n = sample_ring_pop_bulk(&samples, out, 16); // processing task
+*
+* | This version:   V1.0
+* | Date        :   2024-07-20
+* | Info        :   Basic version
+*   - Push, pop, bulk push and bulk pop, plain and SPSC variants.
+*
+*****************************************************************************/
+#ifndef TYPEDRING_H
+#define TYPEDRING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+// D-cache line size of the Cortex-M7
+#define TYPED_RING_CACHE_LINE 32
+
+// Cursor access of the plain variant, the caller serializes all calls
+#define TYPED_RING_LOAD_PLAIN(cursor)         (*(cursor))
+#define TYPED_RING_STORE_PLAIN(cursor, value) (*(cursor) = (value))
+
+// Cursor access of the SPSC variant: a side reads the other side's cursor
+// with acquire so the elements it publishes are visible, and publishes its
+// own with release once its elements are written or read
+#define TYPED_RING_LOAD_ACQUIRE(cursor)        atomic_load_explicit(cursor, memory_order_acquire)
+#define TYPED_RING_STORE_RELEASE(cursor, value) atomic_store_explicit(cursor, value, memory_order_release)
+
+// Ring of capacity elements of type, the caller serializes all calls
+#define TYPED_RING_DEFINE(name, type, capacity) \
+  TYPED_RING_DEFINE_(name, type, capacity, uint32_t, \
+                     TYPED_RING_LOAD_PLAIN, TYPED_RING_STORE_PLAIN)
+
+// Ring of capacity elements of type, one producer and one consumer may call
+// concurrently without a lock
+#define TYPED_RING_DEFINE_SPSC(name, type, capacity) \
+  TYPED_RING_DEFINE_(name, type, capacity, _Atomic uint32_t, \
+                     TYPED_RING_LOAD_ACQUIRE, TYPED_RING_STORE_RELEASE)
+
+// Head and tail are free running counters, only the producer writes head
+// and only the consumer writes tail. Each side reads its own cursor plainly.
+// The cursors get a cache line of their own behind the elements, the struct
+// alignment pads the rest of that line.
+#define TYPED_RING_DEFINE_(name, type, capacity, cursor_t, load, store) \
+  _Static_assert((capacity) != 0 && ((capacity) & ((capacity) - 1)) == 0, \
+                 #name " capacity MUST be a power of 2"); \
+  \
+  typedef struct { \
+    type items[capacity] __attribute__((aligned(TYPED_RING_CACHE_LINE))); \
+    cursor_t head __attribute__((aligned(TYPED_RING_CACHE_LINE))); \
+    cursor_t tail; \
+  } name##_t; \
+  \
+  static inline void name##_init(name##_t *ring) \
+  { \
+    store(&ring->head, 0); \
+    store(&ring->tail, 0); \
+  } \
+  \
+  static inline uint32_t name##_count(name##_t *ring) \
+  { \
+    uint32_t tail = load(&ring->tail); \
+    return load(&ring->head) - tail; \
+  } \
+  \
+  static inline uint32_t name##_space(name##_t *ring) \
+  { \
+    return (capacity) - name##_count(ring); \
+  } \
+  \
+  /* Copies up to n elements in, returns the number copied */ \
+  static inline uint32_t name##_push_bulk(name##_t *ring, const type *items, uint32_t n) \
+  { \
+    uint32_t head = ring->head; \
+    uint32_t space = (capacity) - (head - load(&ring->tail)); \
+    uint32_t pos = head & ((capacity) - 1); \
+    uint32_t first; \
+    \
+    if(n > space) \
+      n = space; \
+    \
+    first = ((capacity) - pos < n) ? (capacity) - pos : n; \
+    memcpy(&ring->items[pos], items, first * sizeof(type)); \
+    memcpy(&ring->items[0], items + first, (n - first) * sizeof(type)); \
+    \
+    store(&ring->head, head + n); \
+    return n; \
+  } \
+  \
+  /* Copies up to n elements out, returns the number copied */ \
+  static inline uint32_t name##_pop_bulk(name##_t *ring, type *items, uint32_t n) \
+  { \
+    uint32_t tail = ring->tail; \
+    uint32_t count = load(&ring->head) - tail; \
+    uint32_t pos = tail & ((capacity) - 1); \
+    uint32_t first; \
+    \
+    if(n > count) \
+      n = count; \
+    \
+    first = ((capacity) - pos < n) ? (capacity) - pos : n; \
+    memcpy(items, &ring->items[pos], first * sizeof(type)); \
+    memcpy(items + first, &ring->items[0], (n - first) * sizeof(type)); \
+    \
+    store(&ring->tail, tail + n); \
+    return n; \
+  } \
+  \
+  /* Returns 0 on success, -1 if the ring is full */ \
+  static inline int name##_push(name##_t *ring, const type *item) \
+  { \
+    uint32_t head = ring->head; \
+    \
+    if(head - load(&ring->tail) == (capacity)) \
+      return -1; \
+    \
+    ring->items[head & ((capacity) - 1)] = *item; \
+    store(&ring->head, head + 1); \
+    return 0; \
+  } \
+  \
+  /* Returns 0 on success, -1 if the ring is empty */ \
+  static inline int name##_pop(name##_t *ring, type *item) \
+  { \
+    uint32_t tail = ring->tail; \
+    \
+    if(load(&ring->head) == tail) \
+      return -1; \
+    \
+    *item = ring->items[tail & ((capacity) - 1)]; \
+    store(&ring->tail, tail + 1); \
+    return 0; \
+  }
+
+#endif // TYPEDRING_H
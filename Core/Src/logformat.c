@@ -0,0 +1,640 @@
+/*****************************************************************************
+* | File        : logformat.c
+* | Author      : Luke Mulder
+* | Function    : Small printf subset for the log lines
+* | Info        :
+*   Output goes through LogFmtOut, which keeps counting once the buffer is
+*   full so the callers get snprintf's return value. Padding past the end
+*   is only counted, a huge '*' width costs nothing.
+*
+*   %f splits the double into its integer part and the fraction bits, both
+*   exact as long as the value is below 2^64. The fraction is scaled by
+*   10^precision in 96 bits and rounded half to even on the exact
+*   remainder, which is what glibc prints.
+*
+*   Numbers are converted straight into the output buffer: the digits are
+*   counted first, then written from the last one back, nothing is staged
+*   on the stack.
+******************************************************************************/
+
+#include "logformat.h"
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+
+static const char log_fmt_digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static const char log_fmt_hex_lower[] = "0123456789abcdef";
+static const char log_fmt_hex_upper[] = "0123456789ABCDEF";
+
+static const uint32_t log_fmt_pow10[LOG_FMT_FLOAT_DIGITS + 1] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static void log_fmt_puts(LogFmtOut *out, const char *s, size_t n)
+{
+  size_t room = (out->len + 1 < out->size) ? out->size - 1 - out->len : 0;
+
+  if(n < room)
+    room = n;
+  if(room > 0)
+    memcpy(out->buf + out->len, s, room);
+  out->len += n;
+}
+
+static void log_fmt_pad(LogFmtOut *out, char c, size_t n)
+{
+  size_t room = (out->len + 1 < out->size) ? out->size - 1 - out->len : 0;
+
+  if(n < room)
+    room = n;
+  if(room > 0)
+    memset(out->buf + out->len, c, room);
+  out->len += n;
+}
+
+/**
+ * Writes the digits of value so they end just before end.
+ *
+ * @return Number of digits written, at least 1.
+ */
+static size_t log_fmt_utoa(uint64_t value, uint8_t base, uint8_t upper, char *end)
+{
+  const char *hex = upper ? log_fmt_hex_upper : log_fmt_hex_lower;
+  char *p = end;
+  uint32_t v;
+
+  if(base == 16)
+  {
+    do { *--p = hex[value & 0xF]; value >>= 4; } while(value);
+    return end - p;
+  }
+  if(base == 8)
+  {
+    do { *--p = '0' + (value & 0x7); value >>= 3; } while(value);
+    return end - p;
+  }
+
+  // Nine digits per 64-bit division, the rest is 32-bit arithmetic the
+  // Cortex-M7 divides in hardware
+  while(value > UINT32_MAX)
+  {
+    uint64_t high = value / 1000000000u;
+    v = (uint32_t)(value - high * 1000000000u);
+    for(int i = 0; i < 4; i++)
+    {
+      p -= 2;
+      memcpy(p, &log_fmt_digit_pairs[2 * (v % 100)], 2);
+      v /= 100;
+    }
+    *--p = '0' + v;
+    value = high;
+  }
+
+  v = (uint32_t)value;
+  while(v >= 100)
+  {
+    p -= 2;
+    memcpy(p, &log_fmt_digit_pairs[2 * (v % 100)], 2);
+    v /= 100;
+  }
+  if(v >= 10)
+  {
+    p -= 2;
+    memcpy(p, &log_fmt_digit_pairs[2 * v], 2);
+  }
+  else
+    *--p = '0' + v;
+
+  return end - p;
+}
+
+// Number of digits of value in base 8, 10 or 16, at least 1
+static size_t log_fmt_count_digits(uint64_t value, uint8_t base)
+{
+  size_t n = 1;
+
+  if(base == 16)
+  {
+    while(n < 16 && (value >> (4 * n)) != 0)
+      n++;
+  }
+  else if(base == 8)
+  {
+    while(n < 22 && (value >> (3 * n)) != 0)
+      n++;
+  }
+  else if(value <= UINT32_MAX)
+  {
+    while(n < 10 && value >= log_fmt_pow10[n])
+      n++;
+  }
+  else
+  {
+    uint64_t limit = 10000000000ull;
+
+    for(n = 10; n < 20 && value >= limit; n++)
+      limit *= 10;
+  }
+
+  return n;
+}
+
+/**
+ * Writes the ndigits digits of value, as counted by log_fmt_count_digits,
+ * 0 for none. They are converted in place in the output buffer, nothing
+ * is staged on the stack. Digits past the end of the buffer are divided
+ * off first.
+ */
+static void log_fmt_put_number(LogFmtOut *out, uint64_t value, uint8_t base, uint8_t upper, size_t ndigits)
+{
+  size_t room = (out->len + 1 < out->size) ? out->size - 1 - out->len : 0;
+
+  if(ndigits > room)
+  {
+    for(size_t i = room; i < ndigits; i++)
+      value /= base;
+  }
+  else
+    room = ndigits;
+
+  if(room > 0)
+    log_fmt_utoa(value, base, upper, out->buf + out->len + room);
+  out->len += ndigits;
+}
+
+// Bytes of an integer argument with the given length modifier
+static uint8_t log_fmt_int_size(uint8_t length)
+{
+  switch(length)
+  {
+    case LOG_FMT_LEN_HH: return sizeof(char);
+    case LOG_FMT_LEN_H:  return sizeof(short);
+    case LOG_FMT_LEN_L:  return sizeof(long);
+    case LOG_FMT_LEN_LL: return sizeof(long long);
+    case LOG_FMT_LEN_J:  return sizeof(intmax_t);
+    case LOG_FMT_LEN_Z:  return sizeof(size_t);
+    case LOG_FMT_LEN_T:  return sizeof(ptrdiff_t);
+    case LOG_FMT_LEN_LD: return sizeof(long long);
+    default:             return sizeof(int);
+  }
+}
+
+// Characters missing to widen a field of len characters to the spec's width
+static size_t log_fmt_width_pad(const LogFmtSpec *spec, size_t len)
+{
+  return ((size_t)spec->width > len) ? (size_t)spec->width - len : 0;
+}
+
+// Sign character of a signed conversion, 0 for none
+static char log_fmt_sign(const LogFmtSpec *spec, uint8_t negative)
+{
+  if(negative)
+    return '-';
+  if(spec->flags & LOG_FMT_PLUS)
+    return '+';
+  if(spec->flags & LOG_FMT_SPACE)
+    return ' ';
+  return 0;
+}
+
+static void log_fmt_integer(LogFmtOut *out, const LogFmtSpec *spec, uint64_t value, char sign)
+{
+  uint8_t base = 10;
+  uint8_t upper = (spec->conv == 'X');
+  size_t prefix_len = 0;
+  size_t ndigits = 0;
+  size_t zeros = 0;
+  size_t pad;
+
+  if(spec->conv == 'x' || spec->conv == 'X' || spec->conv == 'p')
+    base = 16;
+  else if(spec->conv == 'o')
+    base = 8;
+
+  // An explicit zero precision prints nothing for a zero value
+  if(value != 0 || spec->precision != 0)
+    ndigits = log_fmt_count_digits(value, base);
+
+  if(spec->conv == 'p' || (base == 16 && (spec->flags & LOG_FMT_ALT) && value != 0))
+    prefix_len = 2;
+
+  if(spec->precision > 0 && (size_t)spec->precision > ndigits)
+    zeros = spec->precision - ndigits;
+  // "%#o" always starts with a 0
+  else if(base == 8 && (spec->flags & LOG_FMT_ALT) && (ndigits == 0 || value != 0))
+    zeros = 1;
+
+  pad = log_fmt_width_pad(spec, (sign != 0) + prefix_len + zeros + ndigits);
+  if((spec->flags & (LOG_FMT_ZERO | LOG_FMT_LEFT)) == LOG_FMT_ZERO && spec->precision < 0)
+  {
+    zeros += pad;
+    pad = 0;
+  }
+
+  if(!(spec->flags & LOG_FMT_LEFT))
+    log_fmt_pad(out, ' ', pad);
+  if(sign)
+    log_fmt_puts(out, &sign, 1);
+  if(prefix_len)
+    log_fmt_puts(out, upper ? "0X" : "0x", 2);
+  log_fmt_pad(out, '0', zeros);
+  log_fmt_put_number(out, value, base, upper, ndigits);
+  if(spec->flags & LOG_FMT_LEFT)
+    log_fmt_pad(out, ' ', pad);
+}
+
+static void log_fmt_text(LogFmtOut *out, const LogFmtSpec *spec, char sign, const char *text, size_t len)
+{
+  size_t pad = log_fmt_width_pad(spec, (sign != 0) + len);
+
+  if(!(spec->flags & LOG_FMT_LEFT))
+    log_fmt_pad(out, ' ', pad);
+  if(sign)
+    log_fmt_puts(out, &sign, 1);
+  log_fmt_puts(out, text, len);
+  if(spec->flags & LOG_FMT_LEFT)
+    log_fmt_pad(out, ' ', pad);
+}
+
+/**
+ * Rounds frac / 2^shift * 10^digits to an integer, half to even.
+ *
+ * @param frac Fraction bits, below 2^53 and below 2^shift.
+ * @param odd The last digit printed before the fraction is odd, decides
+ *            ties when digits is 0.
+ * @return The rounded fraction, 10^digits when it carries into the
+ *         integer part.
+ */
+static uint32_t log_fmt_round_fraction(uint64_t frac, uint32_t shift, uint8_t digits, uint8_t odd)
+{
+  uint64_t low = (frac & 0xFFFFFFFFu) * log_fmt_pow10[digits];
+  uint64_t mid = (frac >> 32) * log_fmt_pow10[digits];
+  // Product below 2^83 as hi:lo
+  uint64_t lo = low + (mid << 32);
+  uint64_t hi = (mid >> 32) + (lo < low);
+  uint64_t q;
+  // Product bits below the unit, left aligned, and whether any further
+  // down are set
+  uint64_t rem;
+  uint8_t sticky = 0;
+
+  // The whole product is below half a unit
+  if(shift > 83)
+    return 0;
+
+  if(shift < 64)
+  {
+    q = (hi << (64 - shift)) | (lo >> shift);
+    rem = lo << (64 - shift);
+  }
+  else if(shift == 64)
+  {
+    q = hi;
+    rem = lo;
+  }
+  else
+  {
+    q = hi >> (shift - 64);
+    rem = (hi << (128 - shift)) | (lo >> (shift - 64));
+    sticky = (lo << (128 - shift)) != 0;
+  }
+
+  if(digits > 0)
+    odd = q & 1;
+  if(rem > (1ull << 63) || (rem == (1ull << 63) && (sticky || odd)))
+    q++;
+
+  return (uint32_t)q;
+}
+
+/**
+ * Prints a finite double, log_fmt_conv prints inf and nan. Kept out of
+ * log_fmt_conv, whose frame every conversion pays for.
+ */
+__attribute__((noinline)) static void log_fmt_float(LogFmtOut *out, const LogFmtSpec *spec, double value)
+{
+  size_t precision = (spec->precision < 0) ? 6 : (size_t)spec->precision;
+  uint8_t frac_digits = (precision < LOG_FMT_FLOAT_DIGITS) ? precision : LOG_FMT_FLOAT_DIGITS;
+  uint8_t point = (precision > 0 || (spec->flags & LOG_FMT_ALT));
+  size_t int_zeros = 0;
+  size_t zeros = 0;
+  size_t pad;
+  uint64_t bits;
+  uint64_t mantissa;
+  uint64_t int_part;
+  size_t ndigits;
+  size_t frac_len = 0;
+  uint32_t frac = 0;
+  int32_t exponent;
+  char sign;
+
+  memcpy(&bits, &value, sizeof(bits));
+  sign = log_fmt_sign(spec, bits >> 63);
+  exponent = (bits >> 52) & 0x7FF;
+  mantissa = bits & ((1ull << 52) - 1);
+
+  // value = mantissa * 2^exponent
+  if(exponent == 0)
+    exponent = -1074;
+  else
+  {
+    mantissa |= 1ull << 52;
+    exponent -= 1075;
+  }
+
+  if(exponent > 11)
+  {
+    // 2^64 and above: the leading digits, the rest zeros. The scale is
+    // exact up to 10^22, beyond that a few of the last digits are off.
+    double magnitude = (value < 0) ? -value : value;
+    double scale = 1;
+    while(magnitude >= 1e19 * scale)
+    {
+      scale *= 10;
+      int_zeros++;
+    }
+    int_part = (uint64_t)(magnitude / scale);
+  }
+  else if(exponent >= 0)
+    int_part = mantissa << exponent;
+  else
+  {
+    uint32_t shift = -exponent;
+    uint64_t frac_bits = (shift < 64) ? mantissa & ((1ull << shift) - 1) : mantissa;
+
+    int_part = (shift < 64) ? mantissa >> shift : 0;
+    frac = log_fmt_round_fraction(frac_bits, shift, frac_digits, int_part & 1);
+    if(frac == log_fmt_pow10[frac_digits])
+    {
+      int_part++;
+      frac = 0;
+    }
+  }
+
+  ndigits = log_fmt_count_digits(int_part, 10);
+  if(frac_digits > 0)
+    frac_len = log_fmt_count_digits(frac, 10);
+
+  pad = log_fmt_width_pad(spec, (sign != 0) + ndigits + int_zeros + point + precision);
+  if((spec->flags & (LOG_FMT_ZERO | LOG_FMT_LEFT)) == LOG_FMT_ZERO)
+  {
+    zeros = pad;
+    pad = 0;
+  }
+
+  if(!(spec->flags & LOG_FMT_LEFT))
+    log_fmt_pad(out, ' ', pad);
+  if(sign)
+    log_fmt_puts(out, &sign, 1);
+  log_fmt_pad(out, '0', zeros);
+  log_fmt_put_number(out, int_part, 10, 0, ndigits);
+  log_fmt_pad(out, '0', int_zeros);
+  log_fmt_puts(out, ".", point);
+  // The fraction's leading zeros, then its digits
+  log_fmt_pad(out, '0', frac_digits - frac_len);
+  log_fmt_put_number(out, frac, 10, 0, frac_len);
+  log_fmt_pad(out, '0', precision - frac_digits);
+  if(spec->flags & LOG_FMT_LEFT)
+    log_fmt_pad(out, ' ', pad);
+}
+
+/**
+ * Parses one printf conversion specification.
+ *
+ * @param p Pointer just past the '%' character.
+ * @param spec Filled with flags, width, precision, length and conversion.
+ *             '*' only sets LOG_FMT_WIDTH_STAR or LOG_FMT_PREC_STAR, the
+ *             caller fills in the argument.
+ * @return Pointer just past the conversion character.
+ */
+const char* log_fmt_parse(const char *p, LogFmtSpec *spec)
+{
+  spec->flags = 0;
+  spec->length = LOG_FMT_LEN_NONE;
+  spec->width = 0;
+  spec->precision = -1;
+
+  // Flags
+  for(;; p++)
+  {
+    if(*p == '-')      spec->flags |= LOG_FMT_LEFT;
+    else if(*p == '+') spec->flags |= LOG_FMT_PLUS;
+    else if(*p == ' ') spec->flags |= LOG_FMT_SPACE;
+    else if(*p == '#') spec->flags |= LOG_FMT_ALT;
+    else if(*p == '0') spec->flags |= LOG_FMT_ZERO;
+    else break;
+  }
+
+  // Width
+  if(*p == '*')
+  {
+    spec->flags |= LOG_FMT_WIDTH_STAR;
+    p++;
+  }
+  for(; *p >= '0' && *p <= '9'; p++)
+    if(spec->width < INT_MAX / 10 - 9)
+      spec->width = spec->width * 10 + (*p - '0');
+
+  // Precision
+  if(*p == '.')
+  {
+    p++;
+    spec->precision = 0;
+    if(*p == '*')
+    {
+      spec->flags |= LOG_FMT_PREC_STAR;
+      p++;
+    }
+    for(; *p >= '0' && *p <= '9'; p++)
+      if(spec->precision < INT_MAX / 10 - 9)
+        spec->precision = spec->precision * 10 + (*p - '0');
+  }
+
+  // Length modifier
+  switch(*p)
+  {
+    case 'h': p++; spec->length = LOG_FMT_LEN_H;
+              if(*p == 'h') { p++; spec->length = LOG_FMT_LEN_HH; } break;
+    case 'l': p++; spec->length = LOG_FMT_LEN_L;
+              if(*p == 'l') { p++; spec->length = LOG_FMT_LEN_LL; } break;
+    case 'j': p++; spec->length = LOG_FMT_LEN_J;                    break;
+    case 'z': p++; spec->length = LOG_FMT_LEN_Z;                    break;
+    case 't': p++; spec->length = LOG_FMT_LEN_T;                    break;
+    case 'L': p++; spec->length = LOG_FMT_LEN_LD;                   break;
+    default:                                                        break;
+  }
+
+  spec->conv = *p;
+
+  return (*p == '\0') ? p : p + 1;
+}
+
+/**
+ * Formats one argument as described by spec, whose '*' width and precision
+ * must already be filled in.
+ */
+void log_fmt_conv(LogFmtOut *out, const LogFmtSpec *spec, LogFmtArg arg)
+{
+  uint8_t bits = 8 * log_fmt_int_size(spec->length);
+  uint64_t mask = (bits < 64) ? (1ull << bits) - 1 : UINT64_MAX;
+
+  switch(spec->conv)
+  {
+    case 'd': case 'i':
+    {
+      // Sign extend from the argument's size
+      int64_t value = (int64_t)(arg.u << (64 - bits)) >> (64 - bits);
+      uint64_t magnitude = (value < 0) ? -(uint64_t)value : (uint64_t)value;
+      log_fmt_integer(out, spec, magnitude, log_fmt_sign(spec, value < 0));
+      break;
+    }
+    case 'u': case 'x': case 'X': case 'o':
+      log_fmt_integer(out, spec, arg.u & mask, 0);
+      break;
+    case 'p':
+      log_fmt_integer(out, spec, (uintptr_t)arg.u, 0);
+      break;
+    case 'c':
+    {
+      char c = (char)arg.u;
+      log_fmt_text(out, spec, 0, &c, 1);
+      break;
+    }
+    case 's':
+    {
+      const char *s = arg.s ? arg.s : "(null)";
+      size_t len = (spec->precision >= 0) ? strnlen(s, spec->precision) : strlen(s);
+      log_fmt_text(out, spec, 0, s, len);
+      break;
+    }
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+    {
+      uint8_t upper = (spec->conv >= 'A' && spec->conv <= 'Z');
+      uint64_t bits;
+
+      memcpy(&bits, &arg.f, sizeof(bits));
+      if(((bits >> 52) & 0x7FF) == 0x7FF)
+        log_fmt_text(out, spec, log_fmt_sign(spec, bits >> 63),
+                     (bits << 12) ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf"), 3);
+      else
+        log_fmt_float(out, spec, arg.f);
+      break;
+    }
+    case '%':
+      log_fmt_puts(out, "%", 1);
+      break;
+    default:
+      // %n and unknown conversions print nothing
+      break;
+  }
+}
+
+static uint64_t log_fmt_va_int(va_list *args, uint8_t length)
+{
+  switch(length)
+  {
+    case LOG_FMT_LEN_L:  return va_arg(*args, unsigned long);
+    case LOG_FMT_LEN_LL:
+    case LOG_FMT_LEN_LD: return va_arg(*args, unsigned long long);
+    case LOG_FMT_LEN_J:  return va_arg(*args, uintmax_t);
+    case LOG_FMT_LEN_Z:  return va_arg(*args, size_t);
+    case LOG_FMT_LEN_T:  return va_arg(*args, ptrdiff_t);
+    default:             return va_arg(*args, unsigned int);
+  }
+}
+
+/**
+ * Formats like vsnprintf, within the subset described in logformat.h.
+ *
+ * @return Length of the full output, excluding the terminator, even when
+ *         it was cut to fit size.
+ */
+int log_vsnprintf(char *buf, size_t size, const char *format, va_list args)
+{
+  LogFmtOut out = { buf, size, 0 };
+  LogFmtSpec spec;
+  LogFmtArg arg;
+  va_list ap;
+
+  va_copy(ap, args);
+
+  while(*format)
+  {
+    if(*format != '%')
+    {
+      const char *start = format;
+      while(*format && *format != '%')
+        format++;
+      log_fmt_puts(&out, start, format - start);
+      continue;
+    }
+
+    format = log_fmt_parse(format + 1, &spec);
+
+    if(spec.flags & LOG_FMT_WIDTH_STAR)
+    {
+      int width = va_arg(ap, int);
+      if(width < 0)
+      {
+        spec.flags |= LOG_FMT_LEFT;
+        width = (width == INT_MIN) ? INT_MAX : -width;
+      }
+      spec.width = width;
+    }
+    if(spec.flags & LOG_FMT_PREC_STAR)
+    {
+      int precision = va_arg(ap, int);
+      spec.precision = (precision < 0) ? -1 : precision;
+    }
+
+    arg.u = 0;
+    switch(spec.conv)
+    {
+      case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        arg.u = log_fmt_va_int(&ap, spec.length);
+        break;
+      case 'p':
+        arg.u = (uintptr_t)va_arg(ap, void*);
+        break;
+      case 's':
+        arg.s = va_arg(ap, const char*);
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        arg.f = (spec.length == LOG_FMT_LEN_LD) ? (double)va_arg(ap, long double) : va_arg(ap, double);
+        break;
+      case 'n':
+        (void)va_arg(ap, void*);
+        break;
+      default:
+        break;
+    }
+
+    log_fmt_conv(&out, &spec, arg);
+  }
+
+  va_end(ap);
+
+  if(size > 0)
+    buf[(out.len < size) ? out.len : size - 1] = '\0';
+
+  return (out.len < INT_MAX) ? (int)out.len : INT_MAX;
+}
+
+/**
+ * Formats like snprintf, within the subset described in logformat.h.
+ */
+int log_snprintf(char *buf, size_t size, const char *format, ...)
+{
+  va_list args;
+  int len;
+
+  va_start(args, format);
+  len = log_vsnprintf(buf, size, format, args);
+  va_end(args);
+
+  return len;
+}
@@ -4,118 +4,2305 @@
 * | Function    : Debug utilities for logging system events
 * | Info        :
 *   Provides a flexible logging mechanism to assist in debugging applications.
+*   Every LOG_* call is stored as a record made of a small header followed by
+*   either the formatted message text or, with LOG_DEFERRED_FORMATTING, the
+*   raw argument words captured from the caller. Records from interrupt
+*   handlers are queued separately as fixed-size records and merged in by
+*   capture time. logTask moves the records into the sink ring, from where
+*   every sink (UART, a debug probe's RTT channel, whatever was added with
+*   loggingAddSink) is sent them as text lines or binary frames at its own
+*   pace, see logsink.h.
 ******************************************************************************/
 
+#define LOG_MODULE "logging"
 #include "logging.h"
 #include "stringbuffer.h"
 
-static StringBuffer log_buffer;
+// Header placed in front of every record stored in the log buffer
+typedef struct {
+  const LogCallSite_t *site;
+  uint16_t len;         // Payload bytes following the header
+  uint8_t nwords;       // Deferred records: number of captured argument words
+  uint8_t flags;
+  uint64_t timestamp;   // Core clock cycles at capture, see log_timestamp
+} LogRecord_t;
 
+#define LOG_RECORD_DEFERRED 0x01
+#define LOG_RECORD_REPORT   0x02  // Suppression report: repeated and rate limited counts
+#define LOG_RECORD_TRUNCATED 0x04 // Text or arguments cut short to fit the record
+#define LOG_RECORD_GENERATED 0x08 // Written by logTask itself, not by a LOG_* call
+
+#define LOG_REPORT_SUPPRESSED (LOG_RATE_LIMIT_PER_SEC || LOG_SUPPRESS_DUPLICATES)
+
+#define LOG_UART_DMA (LOG_OUTPUT_UART && LOG_UART_USE_DMA)
+
+// logTask notification bits
+#define LOG_NOTIFY_RECORD 0x01  // First record queued while idle
+#define LOG_NOTIFY_FLUSH  0x02  // Watermark reached or ERROR record queued
+#define LOG_NOTIFY_SINK   0x04  // A sink completed its write
+
+#define LOG_RECORD_PAYLOAD_SIZE (LOG_MSG_BUFFER_SIZE - sizeof(LogRecord_t))
+
+// Most argument words of a report logTask writes itself, see log_report
+#define LOG_REPORT_WORDS 7
+
+// Offset stored for a %s argument that did not fit in the record
+#define LOG_ARG_STR_MISSING 0xFFFFFFFFu
+
+// Argument types a conversion specification can consume
+typedef enum {
+  LOG_ARG_NONE = 0,
+  LOG_ARG_INT,
+  LOG_ARG_LONG,
+  LOG_ARG_LLONG,
+  LOG_ARG_INTMAX,
+  LOG_ARG_SIZE,
+  LOG_ARG_PTRDIFF,
+  LOG_ARG_DOUBLE,
+  LOG_ARG_LDOUBLE,
+  LOG_ARG_PTR,
+  LOG_ARG_STR
+} LogArgType_e;
+
+static const uint8_t log_arg_size[] = {
+  [LOG_ARG_NONE]    = 0,
+  [LOG_ARG_INT]     = sizeof(int),
+  [LOG_ARG_LONG]    = sizeof(long),
+  [LOG_ARG_LLONG]   = sizeof(long long),
+  [LOG_ARG_INTMAX]  = sizeof(intmax_t),
+  [LOG_ARG_SIZE]    = sizeof(size_t),
+  [LOG_ARG_PTRDIFF] = sizeof(ptrdiff_t),
+  [LOG_ARG_DOUBLE]  = sizeof(double),
+  [LOG_ARG_LDOUBLE] = sizeof(long double),
+  [LOG_ARG_PTR]     = sizeof(void*),
+  [LOG_ARG_STR]     = sizeof(uint32_t)
+};
+
+#define LOG_ARG_WORDS(type) ((log_arg_size[type] + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+
+typedef struct {
+  LogFmtSpec fmt;
+  uint8_t stars;  // Number of '*' width/precision arguments
+  uint8_t type;   // LogArgType_e of the converted value
+} LogSpec_t;
+
+#if LOG_DEFERRED_FORMATTING && LOG_SUPPRESS_DUPLICATES
+// Arguments of a LOG_* call taken off its va_list before the record is
+// reserved, so the duplicate check runs on them without holding logMutex
+typedef struct {
+  uint32_t words[LOG_MAX_ARG_WORDS];
+  const char *strings[LOG_MAX_ARG_WORDS];  // String behind a %s word, see string_words
+  uint32_t string_words;                   // Bit n set if word n is a %s argument
+  uint8_t nwords;
+  uint8_t flags;                           // LOG_RECORD_TRUNCATED if arguments did not fit
+} LogArgs_t;
+
+#if LOG_MAX_ARG_WORDS > 32
+  #error "LOG_MAX_ARG_WORDS must not exceed the 32 bits of LogArgs_t.string_words"
+#endif
+#endif
+
+// Eager text is formatted straight into the reserved record, unless that
+// would format with logMutex held or the repeat check needs the text first
+#define LOG_FORMAT_IN_PLACE (!LOG_DEFERRED_FORMATTING && LOG_USE_LOCKFREE_RING && !LOG_SUPPRESS_DUPLICATES)
+
+#if LOG_USE_LOCKFREE_RING
+static LogRing log_ring;
+static uint8_t log_ring_storage[LOG_RING_SIZE] __attribute__((aligned(4)));
+#else
+// Ping-pong pair, statically placed so the log RAM shows up in the map file.
+// Producers fill one under logMutex, logTask drains the other without any
+// lock and swaps the two once its side is empty.
+STR_BUF_DEFINE(static, log_buffer_a, LOG_BUFFER_BYTES / 2, LOG_MSG_BUFFER_SIZE);
+STR_BUF_DEFINE(static, log_buffer_b, LOG_BUFFER_BYTES / 2, LOG_MSG_BUFFER_SIZE);
+// Producer side, only used with logMutex taken
+static StringBuffer *log_fill = &log_buffer_a;
+// logTask's side, never touched by a producer
+static StringBuffer *log_drain = &log_buffer_b;
+// Set by a commit to the producer side, cleared by the swap. Lets logTask
+// pass over an empty producer side without taking logMutex.
+static _Atomic uint8_t log_fill_queued;
+#endif
+
+// Fixed-size record written by LOG_*_FROM_ISR, laid out like a deferred
+// record so it is rendered and encoded by the same code
+typedef struct {
+  LogRecord_t header;
+  uint32_t args[LOG_ISR_MAX_ARGS];
+} LogIsrRecord_t;
+
+// Filled by interrupts under BASEPRI, drained by logTask only
+static LogIsrRecord_t log_isr_buffer[LOG_ISR_BUFFER_SIZE];
+static volatile uint32_t log_isr_head;
+static volatile uint32_t log_isr_tail;
+static volatile uint32_t log_isr_dropped;
+
+// Records taken from the queues, each sink reads them from its own cursor
+static LogSinkRing log_sink_ring;
+static uint8_t log_sink_storage[LOG_SINK_RING_SIZE] __attribute__((aligned(4)));
+
+// Staging buffer of the sinks that write synchronously, reused once write
+// returns
+static uint8_t log_tx_buf[LOG_TX_BATCH_SIZE] __attribute__((aligned(32)));
+
+#if LOG_PIPELINE_STATS
+// Capture times of the records in the first sink's batch, turned into
+// latencies once its write is complete
+static uint64_t log_tx_stamps[LOG_TX_BATCH_RECORDS];
+static uint32_t log_tx_nstamps;
+
+// Updated by the producers, folded into log_stats when read
+static _Atomic uint32_t log_produced;
+static _Atomic uint32_t log_truncated;
+static _Atomic uint32_t log_record_max;
+static _Atomic uint32_t log_pending_max;
+static _Atomic uint32_t log_buffer_max;
+
+// Stats interval in cycles, when the last one ended and the totals then
+static uint64_t log_stats_interval;
+static uint64_t log_stats_last;
+static uint32_t log_stats_produced;
+static uint32_t log_stats_wire_bytes;
+// Summary record logTask writes next, 0 when none is in progress
+static uint8_t log_stats_step;
+#endif
+
+// CYCCNT extended to 64 bits: upper word and the last value read
+static uint32_t log_cycles_high;
+static uint32_t log_cycles_last;
+// Idle logTask wakes up this often to catch every CYCCNT wrap
+static TickType_t log_cycles_refresh;
+
+#if LOG_RATE_LIMIT_PER_SEC
+// Token bucket in cycles: one token per interval, burst tokens of slack
+static uint64_t log_rate_interval;
+static uint64_t log_rate_burst;
+#endif
+
+// Set when suppressed or lost records have not been reported yet
+static _Atomic uint32_t log_report_pending;
+static uint64_t log_report_interval;
+static uint64_t log_report_last;
+// Next call site to check while logTask is reporting, NULL otherwise
+static const LogCallSite_t *log_report_cursor;
+// Next sink to check for dropped records, each is reported once per round
+// as the reports themselves may push more of its records out of the ring
+static LogSink *log_report_sink;
+
+// Loss totals already reported
+static uint32_t log_lost_reported;
+static uint32_t log_lost_bytes_reported;
+static uint32_t log_isr_lost_reported;
+
+// Call sites of the loss reports and summaries logTask writes on its own
+#define LOG_INTERNAL_CALL_SITE(name, log_level, log_str) \
+  static LogCallSiteState_t name##_state = { .enabled = 1 }; \
+  __attribute__((section(LOG_CALL_SITE_SECTION), used, aligned(4))) \
+  static const LogCallSite_t name = { __FILE__, "logTask", log_str, __LINE__, log_level, 0, \
+                                      LOG_MODULE_HASH(LOG_MODULE), &name##_state }
+
+#if LOG_USE_LOCKFREE_RING
+LOG_INTERNAL_CALL_SITE(log_lost_site, LOG_LEVEL_WARNING, "log ring full, %u records lost");
+#else
+LOG_INTERNAL_CALL_SITE(log_lost_site, LOG_LEVEL_WARNING, "log buffer full, %u records (%u bytes) lost");
+// Given by logTask when it swaps in an empty buffer while producers wait
+// for room with the STR_BUF_BLOCK policy
+static SemaphoreHandle_t logSpace;
+static StaticSemaphore_t logSpaceBuffer;
+static _Atomic uint32_t log_space_waiters;
+#endif
+LOG_INTERNAL_CALL_SITE(log_isr_lost_site, LOG_LEVEL_WARNING, "ISR log buffer full, %u records lost");
+LOG_INTERNAL_CALL_SITE(log_sink_lost_site, LOG_LEVEL_WARNING, "log sink %s fell behind, %u records lost");
+#if LOG_PIPELINE_STATS
+LOG_INTERNAL_CALL_SITE(log_stats_site, LOG_LEVEL_INFO,
+                       "log stats: %u produced, %u lost, %u truncated, %u B/s, peak %u records %u bytes, largest %u bytes");
+LOG_INTERNAL_CALL_SITE(log_latency_site, LOG_LEVEL_INFO,
+                       "log latency: 50%% < %u us, 90%% < %u us, 99%% < %u us, max %u us");
+#endif
+
+// Records queued and not yet taken by logTask, drives the wakeups
+static _Atomic uint32_t log_pending;
+static TaskHandle_t log_task_handle;
+
+static LogStats_t log_stats;
+
+#if LOG_UART_DMA
+// Given from the UART TX complete interrupt
+static SemaphoreHandle_t logTxDone;
+static StaticSemaphore_t logTxDoneBuffer;
+// The UART sink's own staging buffer, read by the DMA while logTask goes
+// on with the other sinks. Cache line aligned for the D-cache clean.
+static uint8_t log_uart_buf[LOG_TX_BATCH_SIZE] __attribute__((aligned(32)));
+// When the transfer started and how long it may take, in cycles
+// (its length on the wire plus LOG_TX_TIMEOUT_MS)
+static uint64_t log_uart_started;
+static uint64_t log_uart_timeout;
+static uint64_t log_uart_margin;
+// Set from the start of a transfer until its completion was signalled
+static volatile uint8_t log_uart_in_flight;
+#endif
+
+#if LOG_OUTPUT_RTT
+// Global so probe software can also be pointed at it by symbol
+LogRttControlBlock log_rtt;
+static uint8_t log_rtt_storage[LOG_RTT_BUFFER_SIZE] __attribute__((aligned(32)));
+#endif
+
+// Stays NULL with the lock-free ring
 SemaphoreHandle_t logMutex;
+#if !LOG_USE_LOCKFREE_RING
+static StaticSemaphore_t logMutexBuffer;
+#endif
+
+static const char* log_level_str(uint8_t level)
+{
+  switch(level)
+  {
+      case LOG_LEVEL_ERROR:   return "ERROR";
+      case LOG_LEVEL_WARNING: return "WARNING";
+      case LOG_LEVEL_INFO:    return "INFO";
+      default:                return "NONE";
+  }
+}
+
+/**
+ * Reads the DWT cycle counter extended to 64 bits. CYCCNT wraps every
+ * 2^32 core clock cycles (about 20 s at 216 MHz), a wrap is detected when
+ * the counter reads lower than last time. Callable from tasks and from
+ * interrupts at or below configMAX_SYSCALL_INTERRUPT_PRIORITY.
+ *
+ * @return Core clock cycles since loggingInit.
+ */
+static uint64_t log_timestamp(void)
+{
+  UBaseType_t saved_interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+  uint32_t now = DWT->CYCCNT;
+
+  if(now < log_cycles_last)
+    log_cycles_high++;
+  log_cycles_last = now;
+
+  uint64_t cycles = ((uint64_t)log_cycles_high << 32) | now;
+
+  taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+
+  return cycles;
+}
+
+/**
+ * Converts a cycle count into whole microseconds and the nanoseconds
+ * past the last microsecond, using SystemCoreClock.
+ */
+static uint64_t log_cycles_to_us(uint64_t cycles, uint32_t *ns)
+{
+  uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+  if(ns != NULL)
+    *ns = (uint32_t)(cycles % cycles_per_us) * 1000 / cycles_per_us;
+
+  return cycles / cycles_per_us;
+}
+
+#if LOG_RATE_LIMIT_PER_SEC
+/**
+ * Takes a token from the call site's bucket. The bucket is tracked as the
+ * cycle count at which it is full again, so admitting a call is one compare
+ * and one add. Refused calls are counted for the next report.
+ *
+ * @return 1 if the call may be logged, 0 if it is rate limited.
+ */
+static uint8_t log_rate_admit(const LogCallSite_t *site, uint64_t now)
+{
+  LogCallSiteState_t *state = site->state;
+  UBaseType_t saved_interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+  uint8_t admit = (state->allowed_at <= now + log_rate_burst);
+
+  if(admit)
+    state->allowed_at = ((state->allowed_at > now) ? state->allowed_at : now) + log_rate_interval;
+  else
+    state->suppressed++;
+
+  taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+
+  if(!admit)
+    atomic_store_explicit(&log_report_pending, 1, memory_order_relaxed);
+
+  return admit;
+}
+#endif // LOG_RATE_LIMIT_PER_SEC
+
+#if LOG_SUPPRESS_DUPLICATES
+// FNV-1a, continued from hash, start with LOG_HASH_SEED
+#define LOG_HASH_SEED 2166136261u
+
+static uint32_t log_hash(uint32_t hash, const void *data, size_t len)
+{
+  const uint8_t *bytes = data;
+
+  while(len--)
+    hash = (hash ^ *bytes++) * 16777619u;
+
+  return hash;
+}
+
+/**
+ * Hashes a call's site and argument words. A %s argument counts by its
+ * address, the word log_take_args leaves it in, not its text, so a buffer
+ * logged again with new contents can be taken for a repeat.
+ *
+ * @param words Argument words, those of a LOG_*_FROM_ISR call or taken by
+ *              log_take_args.
+ */
+static uint32_t log_args_hash(const LogCallSite_t *site, const uint32_t *words, size_t nwords)
+{
+  uint32_t hash = log_hash(LOG_HASH_SEED, &site, sizeof(site));
+
+  return log_hash(hash, words, nwords * sizeof(uint32_t));
+}
+
+/**
+ * Checks whether a call site repeats its previous message, arguments
+ * included, within LOG_REPORT_INTERVAL_MS. Repeats are counted for the next
+ * report instead of being queued.
+ *
+ * @param hash Hash of the call, e.g. from log_args_hash.
+ * @return 1 if the message is a repeat and must be dropped.
+ */
+static uint8_t log_is_repeat(const LogCallSite_t *site, uint64_t now, uint32_t hash)
+{
+  LogCallSiteState_t *state = site->state;
+  UBaseType_t saved_interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+  uint8_t repeat;
+
+  // Never 0, 0 means "no previous message"
+  hash = hash ? hash : 1;
+  repeat = (hash == state->last_hash && now - state->last_seen < log_report_interval);
+
+  state->last_seen = now;
+  state->last_hash = hash;
+  if(repeat)
+    state->repeated++;
+
+  taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+
+  if(repeat)
+    atomic_store_explicit(&log_report_pending, 1, memory_order_relaxed);
+
+  return repeat;
+}
+#endif // LOG_SUPPRESS_DUPLICATES
+
+/**
+ * Parses one printf conversion specification, see log_fmt_parse.
+ *
+ * @param p Pointer just past the '%' character.
+ * @param spec Filled with the parsed specification, the number of '*'
+ *             arguments and the value type.
+ * @return Pointer just past the conversion character.
+ */
+static const char* log_parse_spec(const char *p, LogSpec_t *spec)
+{
+  static const uint8_t int_type[] = {
+    [LOG_FMT_LEN_NONE] = LOG_ARG_INT,
+    [LOG_FMT_LEN_HH]   = LOG_ARG_INT,
+    [LOG_FMT_LEN_H]    = LOG_ARG_INT,
+    [LOG_FMT_LEN_L]    = LOG_ARG_LONG,
+    [LOG_FMT_LEN_LL]   = LOG_ARG_LLONG,
+    [LOG_FMT_LEN_J]    = LOG_ARG_INTMAX,
+    [LOG_FMT_LEN_Z]    = LOG_ARG_SIZE,
+    [LOG_FMT_LEN_T]    = LOG_ARG_PTRDIFF,
+    [LOG_FMT_LEN_LD]   = LOG_ARG_LLONG
+  };
+
+  p = log_fmt_parse(p, &spec->fmt);
+
+  spec->stars = ((spec->fmt.flags & LOG_FMT_WIDTH_STAR) != 0) + ((spec->fmt.flags & LOG_FMT_PREC_STAR) != 0);
+
+  switch(spec->fmt.conv)
+  {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+      spec->type = int_type[spec->fmt.length];
+      break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      spec->type = (spec->fmt.length == LOG_FMT_LEN_LD) ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+      break;
+    case 'p':
+      spec->type = LOG_ARG_PTR;
+      break;
+    case 's':
+      spec->type = LOG_ARG_STR;
+      break;
+    default:
+      // "%%" and unsupported conversions such as %n consume nothing
+      spec->type = LOG_ARG_NONE;
+      break;
+  }
+
+  return p;
+}
+
+#if LOG_DEFERRED_FORMATTING
+/**
+ * Takes one argument of the given type off the va_list and stores its
+ * value in the words at dest.
+ *
+ * @return The string of a %s argument, which is not stored, NULL for
+ *         other types.
+ */
+static const char* log_take_arg(void *dest, uint8_t type, va_list *args)
+{
+  switch(type)
+  {
+    case LOG_ARG_INT:     { int v       = va_arg(*args, int);         memcpy(dest, &v, sizeof(v)); break; }
+    case LOG_ARG_LONG:    { long v      = va_arg(*args, long);        memcpy(dest, &v, sizeof(v)); break; }
+    case LOG_ARG_LLONG:   { long long v = va_arg(*args, long long);   memcpy(dest, &v, sizeof(v)); break; }
+    case LOG_ARG_INTMAX:  { intmax_t v  = va_arg(*args, intmax_t);    memcpy(dest, &v, sizeof(v)); break; }
+    case LOG_ARG_SIZE:    { size_t v    = va_arg(*args, size_t);      memcpy(dest, &v, sizeof(v)); break; }
+    case LOG_ARG_PTRDIFF: { ptrdiff_t v = va_arg(*args, ptrdiff_t);   memcpy(dest, &v, sizeof(v)); break; }
+    case LOG_ARG_DOUBLE:  { double v    = va_arg(*args, double);      memcpy(dest, &v, sizeof(v)); break; }
+    case LOG_ARG_LDOUBLE: { long double v = va_arg(*args, long double); memcpy(dest, &v, sizeof(v)); break; }
+    case LOG_ARG_PTR:     { void *v     = va_arg(*args, void*);       memcpy(dest, &v, sizeof(v)); break; }
+    case LOG_ARG_STR:
+    {
+      const char *str = va_arg(*args, const char*);
+
+      return (str != NULL) ? str : "(null)";
+    }
+    default:
+      break;
+  }
+
+  return NULL;
+}
+
+/**
+ * Copies as much of a %s string as fits into a record's arena, always
+ * terminated, and sets LOG_RECORD_TRUNCATED on rec if it is cut short.
+ *
+ * @param arena_len Bytes of the arena in use, advanced past the string.
+ * @return The argument word: the string's offset in the arena, or
+ *         LOG_ARG_STR_MISSING if the arena is full.
+ */
+static uint32_t log_copy_string(LogRecord_t *rec, uint8_t *arena, size_t arena_size, size_t *arena_len,
+                                const char *str)
+{
+  uint32_t offset = *arena_len;
+  size_t str_len;
+
+  if(offset >= arena_size)
+  {
+    rec->flags |= LOG_RECORD_TRUNCATED;
+    return LOG_ARG_STR_MISSING;
+  }
+
+  str_len = strnlen(str, arena_size - offset - 1);
+  if(str[str_len] != '\0')
+    rec->flags |= LOG_RECORD_TRUNCATED;
+  memcpy(arena + offset, str, str_len);
+  arena[offset + str_len] = '\0';
+  *arena_len += str_len + 1;
+
+  return offset;
+}
+
+#if LOG_SUPPRESS_DUPLICATES
+/**
+ * Takes the raw arguments described by a format string off the caller's
+ * va_list, before a record is reserved. Argument values are stored as
+ * 32-bit words, a %s word holds the string's address until log_place_args
+ * copies the string into the record.
+ *
+ * @param taken Receives the words, the string behind each %s word and
+ *              LOG_RECORD_TRUNCATED if the arguments did not fit.
+ * @param format The printf style format string.
+ * @param args The caller's variable arguments, advanced past those taken.
+ */
+static void log_take_args(LogArgs_t *taken, const char *format, va_list *args)
+{
+  size_t nwords = 0;
+  LogSpec_t spec;
+
+  taken->string_words = 0;
+  taken->flags = 0;
+
+  while(*format)
+  {
+    const char *str;
+
+    if(*format++ != '%')
+      continue;
+
+    format = log_parse_spec(format, &spec);
+
+    if(nwords + spec.stars + LOG_ARG_WORDS(spec.type) > LOG_MAX_ARG_WORDS)
+    {
+      taken->flags |= LOG_RECORD_TRUNCATED;
+      break;
+    }
+
+    for(int i = 0; i < spec.stars; i++)
+      taken->words[nwords++] = (uint32_t)va_arg(*args, int);
+
+    if((str = log_take_arg(&taken->words[nwords], spec.type, args)) != NULL)
+    {
+      taken->words[nwords] = (uint32_t)(uintptr_t)str;
+      taken->strings[nwords] = str;
+      taken->string_words |= 1u << nwords;
+    }
+
+    nwords += LOG_ARG_WORDS(spec.type);
+  }
+
+  taken->nwords = nwords;
+}
+
+/**
+ * Writes arguments taken by log_take_args into a reserved record. %s
+ * strings are copied into the arena that follows the words, the word then
+ * holds the string offset in the arena.
+ *
+ * @param rec Record header, nwords and len are filled in, flags marks
+ *            arguments that did not fit.
+ * @param payload Record payload of LOG_RECORD_PAYLOAD_SIZE bytes.
+ */
+static void log_place_args(LogRecord_t *rec, uint8_t *payload, const LogArgs_t *taken)
+{
+  uint8_t *arena = payload + taken->nwords * sizeof(uint32_t);
+  size_t arena_size = LOG_RECORD_PAYLOAD_SIZE - taken->nwords * sizeof(uint32_t);
+  size_t arena_len = 0;
+
+  rec->flags |= taken->flags;
+
+  for(size_t i = 0; i < taken->nwords; i++)
+  {
+    uint32_t word = taken->words[i];
+
+    if(taken->string_words & (1u << i))
+      word = log_copy_string(rec, arena, arena_size, &arena_len, taken->strings[i]);
+
+    memcpy(payload + i * sizeof(uint32_t), &word, sizeof(word));
+  }
+
+  rec->nwords = taken->nwords;
+  rec->len = taken->nwords * sizeof(uint32_t) + arena_len;
+  rec->flags |= LOG_RECORD_DEFERRED;
+}
+
+#else
+/**
+ * Counts the argument words of a format string from its current position
+ * on, stopping where log_capture_args stops.
+ *
+ * @param nwords Words already taken before format.
+ * @return Words taken in total.
+ */
+static size_t log_count_words(const char *format, size_t nwords)
+{
+  LogSpec_t spec;
+
+  while(*format)
+  {
+    if(*format++ != '%')
+      continue;
+
+    format = log_parse_spec(format, &spec);
+    if(nwords + spec.stars + LOG_ARG_WORDS(spec.type) > LOG_MAX_ARG_WORDS)
+      break;
+    nwords += spec.stars + LOG_ARG_WORDS(spec.type);
+  }
+
+  return nwords;
+}
+
+/**
+ * Captures the raw arguments described by a format string straight into a
+ * reserved record. Argument values are stored as 32-bit words and %s
+ * strings are copied into the arena that follows the words, the word then
+ * holds the string offset in the arena. The arena starts behind the last
+ * word, so the first %s counts the words of the rest of the format.
+ *
+ * @param rec Record header, nwords and len are filled in, flags marks
+ *            arguments that did not fit.
+ * @param payload Record payload of LOG_RECORD_PAYLOAD_SIZE bytes.
+ * @param format The printf style format string.
+ * @param args The caller's variable arguments, advanced past those taken.
+ */
+static void log_capture_args(LogRecord_t *rec, uint8_t *payload, const char *format, va_list *args)
+{
+  uint8_t *arena = NULL;
+  size_t arena_size = 0;
+  size_t arena_len = 0;
+  size_t nwords = 0;
+  LogSpec_t spec;
+
+  while(*format)
+  {
+    const char *str;
+
+    if(*format++ != '%')
+      continue;
+
+    format = log_parse_spec(format, &spec);
+
+    if(nwords + spec.stars + LOG_ARG_WORDS(spec.type) > LOG_MAX_ARG_WORDS)
+    {
+      rec->flags |= LOG_RECORD_TRUNCATED;
+      break;
+    }
+
+    for(int i = 0; i < spec.stars; i++)
+    {
+      uint32_t star = (uint32_t)va_arg(*args, int);
+      memcpy(payload + nwords++ * sizeof(uint32_t), &star, sizeof(star));
+    }
+
+    if((str = log_take_arg(payload + nwords * sizeof(uint32_t), spec.type, args)) != NULL)
+    {
+      uint32_t word;
+
+      if(arena == NULL)
+      {
+        size_t total = log_count_words(format, nwords + 1);
+
+        arena = payload + total * sizeof(uint32_t);
+        arena_size = LOG_RECORD_PAYLOAD_SIZE - total * sizeof(uint32_t);
+      }
+
+      word = log_copy_string(rec, arena, arena_size, &arena_len, str);
+      memcpy(payload + nwords * sizeof(uint32_t), &word, sizeof(word));
+    }
+
+    nwords += LOG_ARG_WORDS(spec.type);
+  }
+
+  rec->nwords = nwords;
+  rec->len = nwords * sizeof(uint32_t) + arena_len;
+  rec->flags |= LOG_RECORD_DEFERRED;
+}
+#endif // LOG_SUPPRESS_DUPLICATES
+#endif // LOG_DEFERRED_FORMATTING
+
+/**
+ * Formats a deferred record's captured arguments. Each conversion
+ * specification is handed to log_fmt_conv with the value rebuilt from the
+ * stored argument words.
+ *
+ * @return Number of characters written to out, excluding the terminator.
+ */
+static size_t log_render_args(char *out, size_t size, const char *format, const LogRecord_t *rec)
+{
+  const uint32_t *words = (const uint32_t*)(rec + 1);
+  const char *arena = (const char*)(words + rec->nwords);
+  size_t arena_len = rec->len - rec->nwords * sizeof(uint32_t);
+  size_t word = 0;
+  LogFmtOut line = { out, size, 0 };
+  LogFmtArg arg;
+  LogSpec_t spec;
+
+  if(size == 0)
+    return 0;
+
+  while(*format && line.len < size - 1)
+  {
+    if(*format != '%')
+    {
+      out[line.len++] = *format++;
+      continue;
+    }
+
+    format = log_parse_spec(format + 1, &spec);
+    arg.u = 0;
+
+    // Stop at the first conversion that was not captured
+    if(word + spec.stars + LOG_ARG_WORDS(spec.type) > rec->nwords)
+      break;
+
+    // A '*' width or precision comes from the record, anything wider than
+    // the line is cut anyway
+    if(spec.fmt.flags & LOG_FMT_WIDTH_STAR)
+    {
+      int width = (int)words[word++];
+      if(width < 0)
+      {
+        spec.fmt.flags |= LOG_FMT_LEFT;
+        width = (width < -LOG_LINE_BUFFER_SIZE) ? LOG_LINE_BUFFER_SIZE : -width;
+      }
+      spec.fmt.width = (width > LOG_LINE_BUFFER_SIZE) ? LOG_LINE_BUFFER_SIZE : width;
+    }
+    if(spec.fmt.flags & LOG_FMT_PREC_STAR)
+    {
+      int precision = (int)words[word++];
+      spec.fmt.precision = (precision < 0) ? -1 : (precision > LOG_LINE_BUFFER_SIZE) ? LOG_LINE_BUFFER_SIZE : precision;
+    }
+
+    switch(spec.type)
+    {
+      case LOG_ARG_INT:     { unsigned v;           memcpy(&v, &words[word], sizeof(v)); arg.u = v; break; }
+      case LOG_ARG_LONG:    { unsigned long v;      memcpy(&v, &words[word], sizeof(v)); arg.u = v; break; }
+      case LOG_ARG_LLONG:   { unsigned long long v; memcpy(&v, &words[word], sizeof(v)); arg.u = v; break; }
+      case LOG_ARG_INTMAX:  { uintmax_t v;          memcpy(&v, &words[word], sizeof(v)); arg.u = v; break; }
+      case LOG_ARG_SIZE:    { size_t v;             memcpy(&v, &words[word], sizeof(v)); arg.u = v; break; }
+      case LOG_ARG_PTRDIFF: { ptrdiff_t v;          memcpy(&v, &words[word], sizeof(v)); arg.u = v; break; }
+      case LOG_ARG_DOUBLE:  { double v;             memcpy(&v, &words[word], sizeof(v)); arg.f = v; break; }
+      case LOG_ARG_LDOUBLE: { long double v;        memcpy(&v, &words[word], sizeof(v)); arg.f = v; break; }
+      case LOG_ARG_PTR:     { void *v;              memcpy(&v, &words[word], sizeof(v)); arg.u = (uintptr_t)v; break; }
+      case LOG_ARG_STR:
+        arg.s = (words[word] < arena_len) ? arena + words[word] : "";
+        break;
+      default:
+        break;
+    }
+
+    word += LOG_ARG_WORDS(spec.type);
+
+    log_fmt_conv(&line, &spec.fmt, arg);
+  }
+
+  if(line.len > size - 1)
+    line.len = size - 1;
+  out[line.len] = '\0';
+
+  return line.len;
+}
+
+#if LOG_REPORT_SUPPRESSED
+/**
+ * Writes the text of a suppression report, the record's two words hold the
+ * repeated and the rate limited counts.
+ *
+ * @return Number of characters written to out, excluding the terminator.
+ */
+static size_t log_render_report(char *out, size_t size, const LogRecord_t *rec)
+{
+  const uint32_t *counts = (const uint32_t*)(rec + 1);
+  int written;
+
+  if(counts[0] && counts[1])
+    written = log_snprintf(out, size, "last message repeated %lu times, %lu more rate limited",
+                           (unsigned long)counts[0], (unsigned long)counts[1]);
+  else if(counts[0])
+    written = log_snprintf(out, size, "last message repeated %lu times", (unsigned long)counts[0]);
+  else
+    written = log_snprintf(out, size, "%lu messages rate limited", (unsigned long)counts[1]);
+
+  if(written < 0 || size == 0)
+    return 0;
+
+  return ((size_t)written < size) ? (size_t)written : size - 1;
+}
+#endif // LOG_REPORT_SUPPRESSED
+
+/**
+ * Renders a stored record into a single text line. The capture time leads
+ * the line in seconds, down to the nanosecond.
+ *
+ * Outp: "[12.345678901] [INFO] Core/Src/main.c:425 StartDefaultTask() - Hello World!\r\n"
+ *
+ * @return Length of the line written to out.
+ */
+static size_t log_render(const LogRecord_t *rec, char *out, size_t size)
+{
+  const LogCallSite_t *site = rec->site;
+  uint32_t ns;
+  uint64_t us = log_cycles_to_us(rec->timestamp, &ns);
+  size_t len;
+  int offset;
+
+  // Begin log message with [s.us ns] [LEVEL] *.c:102 func() -
+  // (split up front, every conversion stays on the 32-bit path)
+  offset = log_snprintf(out, size, "[%lu.%06lu%03lu] [%s] %s:%d %s() - ",
+                        (unsigned long)(us / 1000000), (unsigned long)(us % 1000000), (unsigned long)ns,
+                        log_level_str(site->level), site->file, site->line, site->func);
+  if(offset < 0)
+    return 0;
+
+  // Always keep room for the line ending
+  len = ((size_t)offset < size - 3) ? (size_t)offset : size - 3;
+
+#if LOG_REPORT_SUPPRESSED
+  if(rec->flags & LOG_RECORD_REPORT)
+  {
+    len += log_render_report(out + len, size - 2 - len, rec);
+  }
+  else
+#endif
+  if(rec->flags & LOG_RECORD_DEFERRED)
+  {
+    len += log_render_args(out + len, size - 2 - len, site->format, rec);
+  }
+  else
+  {
+    // Stored with its terminator, even when truncated
+    size_t text_len = rec->len - 1;
+    if(text_len > size - 3 - len)
+      text_len = size - 3 - len;
+
+    memcpy(out + len, rec + 1, text_len);
+    len += text_len;
+  }
+
+  out[len++] = '\r';
+  out[len++] = '\n';
+  out[len] = '\0';
+
+  return len;
+}
+
+#if LOG_DEFERRED_FORMATTING
+/**
+ * Encodes a deferred record as a binary frame, see logwire.h. The host
+ * decoder looks the call-site ID up in the ELF's call-site section to
+ * restore the text line. Timestamps are deltas to the sink's last frame.
+ *
+ * @return Length of the frame written to out, 0 if it does not fit.
+ */
+static size_t log_encode(LogSink *sink, const LogRecord_t *rec, uint8_t *out, size_t size)
+{
+  LogWireFrame frame;
+
+  frame.id = LOG_CALL_SITE_ID(rec->site);
+  frame.flags = (rec->site->level & LOG_WIRE_LEVEL_MASK) | ((rec->flags & LOG_RECORD_REPORT) ? LOG_WIRE_REPORT : 0);
+  frame.nwords = rec->nwords;
+  frame.timestamp = rec->timestamp;
+  // Words and arena are laid out back to back in the payload
+  frame.words = (const uint32_t*)(rec + 1);
+  frame.arena = (const uint8_t*)(rec + 1) + rec->nwords * sizeof(uint32_t);
+  frame.arena_len = rec->len - rec->nwords * sizeof(uint32_t);
+
+  return log_wire_encode(&sink->wire, &frame, out, size);
+}
+#endif // LOG_DEFERRED_FORMATTING
+
+/**
+ * Renders or encodes a record into out, depending on the sink's encoding.
+ *
+ * @return Number of bytes to transmit.
+ */
+static size_t log_output(LogSink *sink, const LogRecord_t *rec, char *out, size_t size)
+{
+#if LOG_DEFERRED_FORMATTING
+  if(sink->encoding == LOG_SINK_BINARY)
+    return log_encode(sink, rec, (uint8_t*)out, size);
+#endif
+
+  return log_render(rec, out, size);
+}
+
+#if LOG_PIPELINE_STATS
+// Raises a high-water mark, from any task or interrupt
+static void log_stats_max(_Atomic uint32_t *max, uint32_t value)
+{
+  uint32_t seen = atomic_load_explicit(max, memory_order_relaxed);
+
+  while(value > seen &&
+        !atomic_compare_exchange_weak_explicit(max, &seen, value, memory_order_relaxed, memory_order_relaxed))
+    ;
+}
+#endif
+
+/**
+ * Accounts for a newly queued record and works out which logTask
+ * notification it warrants, if any.
+ */
+static uint32_t log_notify_bits(uint8_t level)
+{
+  uint32_t pending = atomic_fetch_add_explicit(&log_pending, 1, memory_order_relaxed) + 1;
+  uint32_t bits = 0;
+
+#if LOG_PIPELINE_STATS
+  atomic_fetch_add_explicit(&log_produced, 1, memory_order_relaxed);
+  log_stats_max(&log_pending_max, pending);
+#endif
+
+  if(pending == 1)
+    bits |= LOG_NOTIFY_RECORD;
+
+  if(pending == LOG_WAKEUP_WATERMARK || level == LOG_LEVEL_ERROR)
+    bits |= LOG_NOTIFY_FLUSH;
+
+  // logTask drains everything queued before it started on its own
+  return (log_task_handle != NULL) ? bits : 0;
+}
+
+static void log_notify(uint8_t level)
+{
+  uint32_t bits = log_notify_bits(level);
+
+  if(bits)
+    xTaskNotify(log_task_handle, bits, eSetBits);
+}
+
+static void log_notify_from_isr(uint8_t level)
+{
+  BaseType_t higher_priority_task_woken = pdFALSE;
+  uint32_t bits = log_notify_bits(level);
+
+  if(bits)
+  {
+    xTaskNotifyFromISR(log_task_handle, bits, eSetBits, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+  }
+}
+
+static uint8_t log_report_due(uint64_t now)
+{
+  return atomic_load_explicit(&log_report_pending, memory_order_relaxed) &&
+         now - log_report_last >= log_report_interval;
+}
+
+/**
+ * Copies a record into the sink ring. Records it had to drop for a sink
+ * that fell behind are reported like the other losses.
+ */
+static void log_push(const LogRecord_t *rec)
+{
+  if(log_sink_ring_push(&log_sink_ring, rec, sizeof(LogRecord_t) + rec->len, rec->site->level) > 0)
+    atomic_store_explicit(&log_report_pending, 1, memory_order_relaxed);
+}
+
+/**
+ * Fills in a loss report for the first sink that had records dropped
+ * since its last one. The sink's name is the %s argument, stored in the
+ * arena behind the two words and cut to the room the report has there.
+ *
+ * @param words Room for LOG_REPORT_WORDS words.
+ * @return 1 if header and words hold a report, 0 otherwise.
+ */
+static uint8_t log_take_sink_loss(LogRecord_t *header, uint32_t *words)
+{
+  while(log_report_sink != NULL)
+  {
+    LogSink *sink = log_report_sink;
+    char *arena = (char*)&words[2];
+    const char *name = (sink->name != NULL) ? sink->name : "";
+    size_t name_len = strnlen(name, (LOG_REPORT_WORDS - 2) * sizeof(uint32_t) - 1);
+
+    log_report_sink = sink->next;
+    if(sink->dropped == sink->dropped_reported)
+      continue;
+
+    words[0] = 0;
+    words[1] = sink->dropped - sink->dropped_reported;
+    sink->dropped_reported = sink->dropped;
+    memcpy(arena, name, name_len);
+    arena[name_len] = '\0';
+
+    header->site = &log_sink_lost_site;
+    header->nwords = 2;
+    header->len = 2 * sizeof(uint32_t) + name_len + 1;
+    log_stats.sink_dropped += words[1];
+
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Fills in a loss report if records were lost to a full buffer since the
+ * last one. Task and ISR buffer losses are reported separately, then the
+ * records each sink fell too far behind to send.
+ *
+ * @param words Receives the lost record count and, for the task buffer,
+ *              the lost bytes. Room for LOG_REPORT_WORDS words.
+ * @return 1 if header and words hold a report, 0 otherwise. The report is
+ *         taken even if its call site is disabled.
+ */
+static uint8_t log_take_loss(LogRecord_t *header, uint32_t *words)
+{
+  uint32_t isr_lost = log_isr_dropped;
+#if LOG_USE_LOCKFREE_RING
+  uint32_t lost = log_ring_dropped(&log_ring);
+  uint32_t lost_bytes = 0;
+#else
+  uint32_t lost = str_buff_dropped(&log_buffer_a) + str_buff_dropped(&log_buffer_b);
+  uint32_t lost_bytes = str_buff_dropped_bytes(&log_buffer_a) + str_buff_dropped_bytes(&log_buffer_b);
+#endif
+
+  header->flags = LOG_RECORD_DEFERRED;
+
+  if(lost != log_lost_reported)
+  {
+    words[0] = lost - log_lost_reported;
+    words[1] = lost_bytes - log_lost_bytes_reported;
+    log_lost_reported = lost;
+    log_lost_bytes_reported = lost_bytes;
+
+    header->site = &log_lost_site;
+    header->nwords = LOG_USE_LOCKFREE_RING ? 1 : 2;
+  }
+  else if(isr_lost != log_isr_lost_reported)
+  {
+    words[0] = isr_lost - log_isr_lost_reported;
+    log_isr_lost_reported = isr_lost;
+
+    header->site = &log_isr_lost_site;
+    header->nwords = 1;
+  }
+  else
+  {
+    return log_take_sink_loss(header, words);
+  }
+
+  header->len = header->nwords * sizeof(uint32_t);
+  log_stats.lost += words[0];
+
+  return 1;
+}
+
+#if LOG_PIPELINE_STATS
+// Upper bound of the latency bucket holding the given share of all records
+static uint32_t log_latency_percentile(uint32_t total, uint32_t percent)
+{
+  uint64_t wanted = ((uint64_t)total * percent + 99) / 100;
+  uint64_t seen = 0;
+  uint32_t i;
+
+  for(i = 0; i < LOG_LATENCY_BUCKETS - 1; i++)
+  {
+    seen += log_stats.latency[i];
+    if(seen >= wanted)
+      break;
+  }
+
+  // Never more than was actually measured, the last bucket has no bound
+  if(i == LOG_LATENCY_BUCKETS - 1 || (2u << i) > log_stats.latency_max)
+    return log_stats.latency_max;
+
+  return 2u << i;
+}
+
+/**
+ * Fills in the next summary record once per LOG_STATS_INTERVAL_MS: the
+ * counts and high-water marks, then the latency percentiles. The wire
+ * rate is updated at the end of every interval, the summary is only
+ * written if LOG_* calls were made during it. Latencies count once their
+ * transfer is complete, records in the summary's own batch are not in it.
+ *
+ * @param words Receives up to 7 argument words.
+ * @return 1 if header and words hold a summary record, 0 otherwise.
+ */
+static uint8_t log_take_stats(LogRecord_t *header, uint32_t *words, uint64_t now)
+{
+  uint32_t produced = atomic_load_explicit(&log_produced, memory_order_relaxed);
+  uint32_t total = 0;
+
+  header->flags = LOG_RECORD_DEFERRED;
+
+  if(log_stats_step == 0)
+  {
+    uint64_t elapsed_ms;
+
+    if(now - log_stats_last < log_stats_interval)
+      return 0;
+
+    elapsed_ms = log_cycles_to_us(now - log_stats_last, NULL) / 1000;
+    if(elapsed_ms == 0)
+      elapsed_ms = 1;
+    log_stats.wire_bytes_per_sec = (uint64_t)(log_stats.wire_bytes - log_stats_wire_bytes) * 1000 / elapsed_ms;
+    log_stats_wire_bytes = log_stats.wire_bytes;
+    log_stats_last = now;
+
+    if(produced == log_stats_produced)
+      return 0;
+    log_stats_produced = produced;
+
+    words[0] = produced;
+    words[1] = log_stats.lost;
+    words[2] = atomic_load_explicit(&log_truncated, memory_order_relaxed);
+    words[3] = log_stats.wire_bytes_per_sec;
+    words[4] = atomic_load_explicit(&log_pending_max, memory_order_relaxed);
+    words[5] = atomic_load_explicit(&log_buffer_max, memory_order_relaxed);
+    words[6] = atomic_load_explicit(&log_record_max, memory_order_relaxed);
+
+    header->site = &log_stats_site;
+    header->nwords = 7;
+    log_stats_step = 1;
+  }
+  else
+  {
+    for(uint32_t i = 0; i < LOG_LATENCY_BUCKETS; i++)
+      total += log_stats.latency[i];
+
+    words[0] = log_latency_percentile(total, 50);
+    words[1] = log_latency_percentile(total, 90);
+    words[2] = log_latency_percentile(total, 99);
+    words[3] = log_stats.latency_max;
+
+    header->site = &log_latency_site;
+    header->nwords = 4;
+    log_stats_step = 0;
+  }
+
+  header->len = header->nwords * sizeof(uint32_t);
+
+  return 1;
+}
+#endif // LOG_PIPELINE_STATS
+
+// Reports are not counted in the latencies, see log_sink_batch
+static uint8_t log_push_report(LogRecord_t *rec)
+{
+  rec->flags |= LOG_RECORD_GENERATED;
+  log_push(rec);
+
+  return 1;
+}
+
+/**
+ * Produces the next report. Once per LOG_REPORT_INTERVAL_MS, when records
+ * were lost to a full buffer or a call site had messages rate limited or
+ * collapsed, logTask reports the losses and then walks all call sites and
+ * reports and clears their counts, one record per call site, attributed to
+ * the call site itself. The pipeline summary comes first when it is due,
+ * see log_take_stats. Reports are copied into the sink ring like the
+ * records of LOG_* calls.
+ *
+ * @return 1 if a report was produced, 0 when there is nothing to report.
+ */
+static uint8_t log_report(void)
+{
+  struct {
+    LogRecord_t header;
+    uint32_t counts[LOG_REPORT_WORDS];  // Repeated and rate limited, or summary values
+  } rec;
+  uint64_t now = log_timestamp();
+
+  rec.header.timestamp = now;
+
+#if LOG_PIPELINE_STATS
+  while(log_take_stats(&rec.header, rec.counts, now))
+  {
+    if(!rec.header.site->state->enabled)
+      continue;
+
+    return log_push_report(&rec.header);
+  }
+#endif
+
+  if(log_report_cursor == NULL)
+  {
+    if(!log_report_due(now))
+      return 0;
+
+    atomic_store_explicit(&log_report_pending, 0, memory_order_relaxed);
+    log_report_last = now;
+    log_report_cursor = __start_log_callsites;
+    log_report_sink = log_sink_ring.sinks;
+  }
+
+  while(log_take_loss(&rec.header, rec.counts))
+  {
+    if(!rec.header.site->state->enabled)
+      continue;
+
+    return log_push_report(&rec.header);
+  }
+
+#if LOG_REPORT_SUPPRESSED
+  while(log_report_cursor < __stop_log_callsites)
+  {
+    const LogCallSite_t *site = log_report_cursor++;
+    LogCallSiteState_t *state = site->state;
+    UBaseType_t saved_interrupt_status;
+
+    rec.counts[0] = 0;
+    rec.counts[1] = 0;
+
+    saved_interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+#if LOG_SUPPRESS_DUPLICATES
+    rec.counts[0] = state->repeated;
+    state->repeated = 0;
+    // Reported, the next identical message is printed again
+    if(rec.counts[0])
+      state->last_hash = 0;
+#endif
+#if LOG_RATE_LIMIT_PER_SEC
+    rec.counts[1] = state->suppressed;
+    state->suppressed = 0;
+#endif
+    taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+
+    if(rec.counts[0] == 0 && rec.counts[1] == 0)
+      continue;
+
+    log_stats.repeated += rec.counts[0];
+    log_stats.suppressed += rec.counts[1];
+
+    rec.header.site = site;
+    rec.header.len = 2 * sizeof(uint32_t);
+    rec.header.nwords = 2;
+    rec.header.flags = LOG_RECORD_DEFERRED | LOG_RECORD_REPORT;
+
+    return log_push_report(&rec.header);
+  }
+#endif
+
+  log_report_cursor = NULL;
+
+  return 0;
+}
+
+// 1 while a sink has not completed its last write
+static uint8_t log_sinks_busy(void)
+{
+  for(LogSink *sink = log_sink_ring.sinks; sink != NULL; sink = sink->next)
+  {
+    if(sink->busy)
+      return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Blocks logTask until there is a reason to flush. Sleeps without timeout
+ * while nothing is queued. Once a record is queued it keeps collecting
+ * until the watermark is reached, an ERROR record arrives or
+ * LOG_MAX_LATENCY_MS have passed. A sink completing its write ends the
+ * wait too, it gets its next batch right away.
+ */
+static void log_wait_for_flush(void)
+{
+  TimeOut_t timeout;
+  TickType_t remaining = pdMS_TO_TICKS(LOG_MAX_LATENCY_MS);
+  uint32_t bits = 0;
+  uint32_t more;
+
+  while(atomic_load_explicit(&log_pending, memory_order_relaxed) == 0)
+  {
+    TickType_t idle_timeout = log_cycles_refresh;
+    uint64_t now = log_timestamp();
+    uint8_t busy = log_sinks_busy();
+
+    if(log_report_due(now))
+      break;
+
+    // Come back for the report even if nothing else is logged
+    if(atomic_load_explicit(&log_report_pending, memory_order_relaxed))
+      idle_timeout = pdMS_TO_TICKS(LOG_REPORT_INTERVAL_MS);
+
+#if LOG_PIPELINE_STATS
+    // Same for the summary of the records logged since the last one
+    if(atomic_load_explicit(&log_produced, memory_order_relaxed) != log_stats_produced)
+    {
+      if(now - log_stats_last >= log_stats_interval)
+        break;
+      if(pdMS_TO_TICKS(LOG_STATS_INTERVAL_MS) < idle_timeout)
+        idle_timeout = pdMS_TO_TICKS(LOG_STATS_INTERVAL_MS);
+    }
+#endif
+
+    // A sink still writing is polled again when it reports completion, or
+    // after LOG_TX_TIMEOUT_MS if it never does
+    if(busy && pdMS_TO_TICKS(LOG_TX_TIMEOUT_MS) < idle_timeout)
+      idle_timeout = pdMS_TO_TICKS(LOG_TX_TIMEOUT_MS);
+
+    if(xTaskNotifyWait(0, UINT32_MAX, &bits, idle_timeout) == pdTRUE)
+      break;
+
+    if(busy)
+    {
+      bits = LOG_NOTIFY_SINK;
+      break;
+    }
+
+    // Nothing logged for a while, read the counter before it wraps twice
+    log_timestamp();
+  }
+
+  vTaskSetTimeOutState(&timeout);
+  while(!(bits & (LOG_NOTIFY_FLUSH | LOG_NOTIFY_SINK)) && xTaskCheckForTimeOut(&timeout, &remaining) == pdFALSE)
+  {
+    if(xTaskNotifyWait(0, UINT32_MAX, &more, remaining) == pdTRUE)
+      bits |= more;
+  }
+
+  log_stats.wakeups++;
+}
+
+#if !LOG_USE_LOCKFREE_RING
+/**
+ * Hands the filled log buffer to logTask and the drained one to the
+ * producers. Called by logTask once its side is empty, logMutex is only
+ * taken when a record was committed since the last swap and held for the
+ * pointer exchange only, so a LOG_* call never waits for
+ * rendering or UART I/O. Everything logTask drains afterwards was captured
+ * before anything in the new producer side, the output stays in order.
+ */
+static void log_swap(void)
+{
+  StringBuffer *drained = log_drain;
+
+  // Nothing to swap in, e.g. while only ISRs log. A commit racing this is
+  // followed by its notification, logTask comes back for it.
+  if(!atomic_load_explicit(&log_fill_queued, memory_order_acquire))
+    return;
+
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  if(str_buff_count(log_fill) > 0)
+  {
+    log_drain = log_fill;
+    log_fill = drained;
+  }
+  atomic_store_explicit(&log_fill_queued, 0, memory_order_relaxed);
+  xSemaphoreGive(logMutex);
+
+  // Producers blocked on the full buffer can go on, see log_reserve
+  if(log_drain != drained && atomic_load_explicit(&log_space_waiters, memory_order_relaxed))
+    xSemaphoreGive(logSpace);
+}
+#endif
+
+/**
+ * Takes the oldest queued record, from either the task buffer or the
+ * interrupt records, and copies it into the sink ring. Both queues are in
+ * capture order so comparing their heads keeps the ring ordered by
+ * timestamp. Task records are read in place from logTask's side of the log
+ * buffers, no lock is taken unless that side is empty and a record waits on
+ * the other one, and none at all while nothing is queued. Suppression reports
+ * are produced once the queues are empty.
+ *
+ * @return 1 if a record was taken, 0 when nothing is queued.
+ */
+static uint8_t log_next(void)
+{
+  const LogRecord_t *task_rec;
+  const LogRecord_t *isr_rec = NULL;
+
+  // Queues drained, report what was held back or lost in the meantime
+  if(atomic_load_explicit(&log_pending, memory_order_relaxed) == 0)
+    return log_report();
+
+#if LOG_USE_LOCKFREE_RING
+  if(log_ring_peek(&log_ring, (void**)&task_rec) == 0)
+    task_rec = NULL;
+#else
+  if(str_buff_count(log_drain) == 0)
+    log_swap();
+  if(str_buf_peek_data(log_drain, (void**)&task_rec) == 0)
+    task_rec = NULL;
+#endif
+
+  if(log_isr_tail != log_isr_head)
+    isr_rec = &log_isr_buffer[log_isr_tail & (LOG_ISR_BUFFER_SIZE - 1)].header;
+
+  if(isr_rec != NULL &&
+     (task_rec == NULL || isr_rec->timestamp <= task_rec->timestamp))
+  {
+    log_push(isr_rec);
+    // Slot is free for interrupts again once copied
+    log_isr_tail = log_isr_tail + 1;
+  }
+  else if(task_rec != NULL)
+  {
+    log_push(task_rec);
+#if LOG_USE_LOCKFREE_RING
+    log_ring_release(&log_ring);
+#else
+    str_buf_pop_data(log_drain, (void**)&task_rec);
+#endif
+  }
+  else
+  {
+    return log_report();
+  }
+
+  atomic_fetch_sub_explicit(&log_pending, 1, memory_order_relaxed);
+
+  return 1;
+}
+
+/**
+ * Checks whether a sink is idle with everything sent, waiting for records
+ * the full sink ring has no room for.
+ */
+static uint8_t log_sinks_waiting(void)
+{
+  void *entry;
+
+  for(LogSink *sink = log_sink_ring.sinks; sink != NULL; sink = sink->next)
+  {
+    if(!sink->busy && sink->level != LOG_LEVEL_NONE &&
+       log_sink_ring_peek(&log_sink_ring, sink, &entry) == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Moves queued records into the sink ring while it has room. A full ring
+ * only takes more when a sink waits for them, then up to a batch worth of
+ * the oldest entries is dropped for the sinks still behind. Otherwise the
+ * records stay queued until the sinks catch up.
+ *
+ * @return 1 if anything was moved.
+ */
+static uint8_t log_collect(void)
+{
+  int32_t evict = -1;
+  uint8_t moved = 0;
+
+  for(;;)
+  {
+    if(!log_sink_ring_fits(&log_sink_ring, LOG_MSG_BUFFER_SIZE))
+    {
+      if(evict < 0)
+        evict = log_sinks_waiting() ? LOG_TX_BATCH_RECORDS : 0;
+      if(evict == 0)
+        break;
+      evict--;
+    }
+
+    if(!log_next())
+      break;
+    moved = 1;
+  }
+
+  return moved;
+}
+
+/**
+ * Fills a staging buffer with the records a sink has not sent yet, from
+ * its cursor on. Records are rendered back to back while there is room
+ * for another full line, so the whole batch goes out in one write.
+ *
+ * @param count Receives the number of records in the batch.
+ * @param oldest_error Receives the header of the first ERROR record in the
+ *                     batch, its site is NULL when the batch holds none.
+ * @return Number of bytes to write, 0 when the sink is up to date.
+ */
+static size_t log_sink_batch(LogSink *sink, uint8_t *out, size_t size, uint32_t *count, LogRecord_t *oldest_error)
+{
+  const LogRecord_t *rec;
+  size_t used = 0;
+#if LOG_PIPELINE_STATS
+  uint8_t first = (sink == log_sink_ring.sinks);
+
+  if(first)
+    log_tx_nstamps = 0;
+#endif
+
+  *count = 0;
+  oldest_error->site = NULL;
+
+  while(size - used >= LOG_LINE_BUFFER_SIZE && *count < LOG_TX_BATCH_RECORDS &&
+        log_sink_ring_peek(&log_sink_ring, sink, (void**)&rec) > 0)
+  {
+    used += log_output(sink, rec, (char*)out + used, LOG_LINE_BUFFER_SIZE);
+    (*count)++;
+
+#if LOG_PIPELINE_STATS
+    if(first && !(rec->flags & LOG_RECORD_GENERATED))
+      log_tx_stamps[log_tx_nstamps++] = rec->timestamp;
+#endif
+
+    if(rec->site->level == LOG_LEVEL_ERROR && oldest_error->site == NULL)
+      *oldest_error = *rec;
+
+    log_sink_ring_advance(&log_sink_ring, sink);
+  }
+
+  return used;
+}
+
+#if LOG_UART_DMA
+static int log_uart_write(LogSink *sink, const uint8_t *data, size_t len)
+{
+  UART_HandleTypeDef *huart = sink->ctx;
+
+  // DMA reads memory directly, write back any cached bytes first
+  if(SCB->CCR & SCB_CCR_DC_Msk)
+    SCB_CleanDCache_by_Addr((uint32_t*)data, (len + 31) & ~31u);
+
+  // At most 12 bits a byte: start, 9 data or 8 and parity, 2 stop bits
+  log_uart_timeout = log_uart_margin;
+  if(huart->Init.BaudRate != 0)
+    log_uart_timeout += (uint64_t)SystemCoreClock * len * 12 / huart->Init.BaudRate;
+
+  log_uart_started = log_timestamp();
+  log_uart_in_flight = 1;
+
+  if(HAL_UART_Transmit_DMA(sink->ctx, data, len) != HAL_OK)
+  {
+    log_uart_in_flight = 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Waits for the DMA transfer started by log_uart_write to complete. logTask
+ * only polls, it is woken by the TX complete callback.
+ */
+static int log_uart_flush(LogSink *sink, uint32_t timeout_ms)
+{
+  if(xSemaphoreTake(logTxDone, pdMS_TO_TICKS(timeout_ms)) == pdTRUE)
+    return 0;
+
+  if(log_timestamp() - log_uart_started < log_uart_timeout)
+    return 1;
+
+  // Completion never arrived, stop the transfer so the UART is usable again
+  HAL_UART_AbortTransmit(sink->ctx);
+  log_uart_in_flight = 0;
+
+  return 0;
+}
+#elif LOG_OUTPUT_UART
+static int log_uart_write(LogSink *sink, const uint8_t *data, size_t len)
+{
+  return (HAL_UART_Transmit(sink->ctx, data, len, 0xFFFF) == HAL_OK) ? 0 : -1;
+}
+#endif // LOG_UART_DMA
+
+#if LOG_OUTPUT_UART
+static LogSink log_uart_sink = {
+  .name = "uart",
+  .level = LOG_UART_LEVEL,
+  .encoding = LOG_WIRE_BINARY ? LOG_SINK_BINARY : LOG_SINK_TEXT,
+  .write = log_uart_write,
+#if LOG_UART_DMA
+  .flush = log_uart_flush,
+  .buf = log_uart_buf,
+  .buf_size = sizeof(log_uart_buf),
+#endif
+  .ctx = &LOG_UART_HANDLE
+};
+#endif
+
+#if LOG_UART_DMA
+/**
+ * UART transmit complete callback, runs in the USART1 interrupt after the
+ * DMA has handed over the last byte.
+ */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  BaseType_t higher_priority_task_woken = pdFALSE;
+
+  if(huart != log_uart_sink.ctx)
+    return;
+
+  log_uart_in_flight = 0;
+  xSemaphoreGiveFromISR(logTxDone, &higher_priority_task_woken);
+  loggingSinkDoneFromISR(&log_uart_sink, &higher_priority_task_woken);
+  portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+ * UART error callback. A transfer ended by a DMA error must not leave the
+ * sink busy until the timeout. Receive errors (overrun, framing, noise)
+ * leave a running transmission alone, the HAL keeps gState at BUSY_TX
+ * then and the DMA still reads log_uart_buf: completing the write here
+ * would let the next batch overwrite it mid-transfer.
+ */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+  if(huart != log_uart_sink.ctx || !log_uart_in_flight || huart->gState == HAL_UART_STATE_BUSY_TX)
+    return;
+
+  HAL_UART_TxCpltCallback(huart);
+}
+#endif // LOG_UART_DMA
+
+#if LOG_OUTPUT_RTT
+/**
+ * Copies a batch into the RTT up-buffer, done when it returns. What the
+ * buffer has no room for is counted, the probe is not waited for.
+ */
+static int log_rtt_sink_write(LogSink *sink, const uint8_t *data, size_t len)
+{
+  size_t written = log_rtt_write(sink->ctx, data, len);
+
+  if(written < len)
+  {
+    taskENTER_CRITICAL();
+    log_stats.rtt_dropped += len - written;
+    taskEXIT_CRITICAL();
+  }
+
+  return 0;
+}
+
+static LogSink log_rtt_sink = {
+  .name = "rtt",
+  .level = LOG_RTT_LEVEL,
+  .encoding = LOG_WIRE_BINARY ? LOG_SINK_BINARY : LOG_SINK_TEXT,
+  .write = log_rtt_sink_write,
+  .ctx = &log_rtt
+};
+#endif // LOG_OUTPUT_RTT
+
+#if LOG_PIPELINE_STATS
+/**
+ * Adds the records of the first sink's completed batch to the latency
+ * histogram, each measured from its LOG_* call to the end of the write.
+ */
+static void log_tx_account(uint64_t done)
+{
+  for(uint32_t i = 0; i < log_tx_nstamps; i++)
+  {
+    uint64_t us = log_cycles_to_us(done - log_tx_stamps[i], NULL);
+    uint32_t latency = (us < UINT32_MAX) ? (uint32_t)us : UINT32_MAX;
+    uint32_t bucket = latency ? 31 - __builtin_clz(latency) : 0;
+
+    if(bucket >= LOG_LATENCY_BUCKETS)
+      bucket = LOG_LATENCY_BUCKETS - 1;
+
+    log_stats.latency[bucket]++;
+    if(latency > log_stats.latency_max)
+      log_stats.latency_max = latency;
+  }
+
+  log_tx_nstamps = 0;
+}
+#endif
+
+// Marks a sink's write complete
+static void log_sink_done(LogSink *sink)
+{
+  uint64_t done = sink->done_at ? sink->done_at : log_timestamp();
+
+  sink->busy = 0;
+
+#if LOG_PIPELINE_STATS
+  if(sink == log_sink_ring.sinks)
+    log_tx_account(done);
+#else
+  (void)done;
+#endif
+}
+
+/**
+ * Hands a sink its next batch once its previous write is complete. Never
+ * waits for a sink: one still busy is skipped and later picks up from its
+ * cursor, so a slow sink does not hold back a fast one.
+ *
+ * @return 1 if a batch was written.
+ */
+static uint8_t log_sink_send(LogSink *sink)
+{
+  uint8_t *out = (sink->buf != NULL) ? sink->buf : log_tx_buf;
+  size_t size = (sink->buf != NULL) ? sink->buf_size : sizeof(log_tx_buf);
+  LogRecord_t error;
+  uint32_t count;
+  size_t len;
+
+  if(sink->busy)
+  {
+    if(sink->flush(sink, 0) != 0)
+      return 0;
+    log_sink_done(sink);
+  }
+
+  len = log_sink_batch(sink, out, size, &count, &error);
+  if(len == 0)
+    return 0;
+
+  sink->done_at = 0;
+  if(sink->write(sink, out, len) != 0)
+  {
+    sink->dropped += count;
+    atomic_store_explicit(&log_report_pending, 1, memory_order_relaxed);
+    // The host never sees these frames, the next one carries the full time
+    log_wire_init(&sink->wire, LOG_WIRE_SYNC_INTERVAL);
+#if LOG_PIPELINE_STATS
+    if(sink == log_sink_ring.sinks)
+      log_tx_nstamps = 0;
+#endif
+    return 1;
+  }
+
+  log_stats.wire_bytes += len;
+
+  if(error.site != NULL && sink == log_sink_ring.sinks)
+  {
+    log_stats.error_latency_last = log_cycles_to_us(log_timestamp() - error.timestamp, NULL);
+    if(log_stats.error_latency_last > log_stats.error_latency_max)
+      log_stats.error_latency_max = log_stats.error_latency_last;
+  }
+
+  if(sink->flush != NULL)
+    sink->busy = 1;
+  else
+    log_sink_done(sink);
+
+  return 1;
+}
+
+/**
+ * One round of logTask's work: every sink that is free gets a batch, then
+ * the queues are moved into the sink ring as far as it has room.
+ *
+ * @return 1 if anything was sent or moved, another round may do more.
+ */
+static uint8_t log_pump(void)
+{
+  uint8_t progress = 0;
+
+  for(LogSink *sink = log_sink_ring.sinks; sink != NULL; sink = sink->next)
+    progress |= log_sink_send(sink);
+
+  progress |= log_collect();
+
+  return progress;
+}
+
+/**
+ * Adds a sink logTask sends the log output to. Call after loggingInit and
+ * before logTask starts, the sinks are sent to in the order they were
+ * added. The sink is set up by the caller:
+ *
+ *   name, level, encoding  What it is called in loss reports, the most
+ *                          verbose level it is sent, text or binary.
+ *   write                  Starts sending a batch.
+ *   flush, buf, buf_size   For a sink that completes its writes in the
+ *                          background: it needs its own staging buffer of
+ *                          at least LOG_LINE_BUFFER_SIZE bytes, untouched
+ *                          until flush reports the write complete. It
+ *                          should call loggingSinkDone(FromISR) then, or
+ *                          it is only polled every LOG_TX_TIMEOUT_MS.
+ *                          A sink whose write only returns when done
+ *                          leaves flush NULL and, without a buf, shares a
+ *                          staging buffer with the other such sinks.
+ *
+ * @return 0 if the sink was added, -1 if it is incomplete or logTask
+ *         already runs.
+ */
+int loggingAddSink(LogSink *sink)
+{
+  if(sink == NULL || sink->write == NULL || log_task_handle != NULL)
+    return -1;
+
+  if(sink->buf != NULL ? sink->buf_size < LOG_LINE_BUFFER_SIZE : sink->flush != NULL)
+    return -1;
+
+#if !LOG_DEFERRED_FORMATTING
+  // Text records cannot be encoded
+  if(sink->encoding == LOG_SINK_BINARY)
+    return -1;
+#endif
+
+  sink->busy = 0;
+  sink->done_at = 0;
+  sink->dropped_reported = 0;
+  log_wire_init(&sink->wire, LOG_WIRE_SYNC_INTERVAL);
+
+  return log_sink_attach(&log_sink_ring, sink);
+}
+
+/**
+ * Tells logTask that a sink's write is complete, so it is given the next
+ * batch right away instead of at the next poll.
+ */
+void loggingSinkDone(LogSink *sink)
+{
+  sink->done_at = log_timestamp();
+
+  if(log_task_handle != NULL)
+    xTaskNotify(log_task_handle, LOG_NOTIFY_SINK, eSetBits);
+}
+
+/**
+ * loggingSinkDone for interrupt handlers, e.g. a DMA complete callback.
+ *
+ * @param higher_priority_task_woken Set to pdTRUE if logTask should run
+ *                                   when the interrupt returns.
+ */
+void loggingSinkDoneFromISR(LogSink *sink, BaseType_t *higher_priority_task_woken)
+{
+  sink->done_at = log_timestamp();
+
+  if(log_task_handle != NULL)
+    xTaskNotifyFromISR(log_task_handle, LOG_NOTIFY_SINK, eSetBits, higher_priority_task_woken);
+}
 
 /**
  * Initializes the logging system by creating a mutex for protecting
  * the logging buffer and initializing the string buffer used to store log messages.
- * 
+ * All storage, kernel objects included, is static so nothing is allocated.
+ * The built-in sinks enabled in logging.h are added here.
+ *
  * @return int Returns 0 if the buffer is successfully initialized, or a non-zero
- *             error code if initialization fails. The failure might be due to 
+ *             error code if initialization fails. The failure might be due to
  *             memory allocation issues or other initialization problems.
  */
 void loggingInit()
 {
   int error;
 
+#if LOG_USE_LOCKFREE_RING
+  // Producers synchronize on the ring itself, no mutex needed
+  error = log_ring_init(&log_ring, log_ring_storage, sizeof(log_ring_storage));
+#else
   // Create mutex for log buffer protection
-  logMutex = xSemaphoreCreateMutex();
+  logMutex = xSemaphoreCreateMutexStatic(&logMutexBuffer);
+
+  // Log buffer storage is static, only the overflow policy is set here
+  error = str_buf_set_policy(&log_buffer_a, LOG_BUFFER_POLICY);
+  error |= str_buf_set_policy(&log_buffer_b, LOG_BUFFER_POLICY);
 
-  // Initialize log buffer
-  error = str_buf_init_custom_size(&log_buffer, LOG_BUFFER_SIZE, LOG_MSG_BUFFER_SIZE);
+  logSpace = xSemaphoreCreateBinaryStatic(&logSpaceBuffer);
 
   assert_param(logMutex != NULL);
+  assert_param(logSpace != NULL);
+#endif
+
+  error |= log_sink_ring_init(&log_sink_ring, log_sink_storage, sizeof(log_sink_storage));
+
+#if LOG_UART_DMA
+  logTxDone = xSemaphoreCreateBinaryStatic(&logTxDoneBuffer);
+  assert_param(logTxDone != NULL);
+#endif
+
+#if LOG_OUTPUT_RTT
+  if(log_rtt_init(&log_rtt, "Terminal", log_rtt_storage, sizeof(log_rtt_storage), LOG_RTT_MODE) != 0)
+    error = -1;
+#endif
+
+  // Start the DWT cycle counter used for the timestamps
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  // Half the counter's wrap period
+  log_cycles_refresh = pdMS_TO_TICKS((uint32_t)((1000ull << 31) / SystemCoreClock));
+
+#if LOG_RATE_LIMIT_PER_SEC
+  log_rate_interval = SystemCoreClock / LOG_RATE_LIMIT_PER_SEC;
+  log_rate_burst = log_rate_interval * (LOG_RATE_LIMIT_BURST - 1);
+#endif
+  log_report_interval = (uint64_t)SystemCoreClock * LOG_REPORT_INTERVAL_MS / 1000;
+#if LOG_PIPELINE_STATS
+  log_stats_interval = (uint64_t)SystemCoreClock * LOG_STATS_INTERVAL_MS / 1000;
+#endif
+#if LOG_UART_DMA
+  log_uart_margin = (uint64_t)SystemCoreClock * LOG_TX_TIMEOUT_MS / 1000;
+#endif
+
+  // The UART first, the latency stats are measured on it
+#if LOG_OUTPUT_UART
+  error |= loggingAddSink(&log_uart_sink);
+#endif
+#if LOG_OUTPUT_RTT
+  error |= loggingAddSink(&log_rtt_sink);
+#endif
+
   assert_param(error == 0);
 }
 
 /**
  * Task function that continuously processes the log messages queued in the log buffer.
- * It waits for messages to become available in the buffer, then transmits them over UART.
+ * It waits for messages to become available in the buffer and moves them into the
+ * sink ring. Every sink is sent its records rendered into text lines or encoded as
+ * binary frames, batching as many per write as fit in LOG_TX_BATCH_SIZE. A sink still
+ * busy with a write (the UART while its DMA runs) is skipped and catches up from its
+ * own cursor once done, the others go on meanwhile. logMutex is only taken to swap
+ * the log buffers, never while rendering or transmitting (see log_swap).
+ * Between flushes the task sleeps on its notification, see log_wait_for_flush.
  * This task should run indefinitely as long as the system is active.
  *
  * @param pvParameters Currently not used. Intended for future expansion if needed.
  */
 void logTask(void *pvParameters)
 {
-  char* next_log;
+  uint8_t sent;
+
+  log_task_handle = xTaskGetCurrentTaskHandle();
 
   for(;;)
   {
-    xSemaphoreTake(logMutex, portMAX_DELAY);
-    while(str_buff_count(&log_buffer) > 0)
-    {
-      str_buf_pop(&log_buffer, &next_log);
-      HAL_UART_Transmit(&huart1, (uint8_t*)next_log, strlen(next_log), 0xFFFF);
-    }
-    xSemaphoreGive(logMutex);
+    sent = 0;
+
+    while(log_pump())
+      sent = 1;
 
-    vTaskDelay(pdMS_TO_TICKS(LOGGING_TASK_PERIOD_MS));
+    if(!sent && log_stats.wakeups > 0)
+      log_stats.idle_wakeups++;
+
+    log_wait_for_flush();
   }
 
   vTaskDelete(NULL);
 }
 
+#if LOG_USE_LOCKFREE_RING
+static LogRecord_t* log_reserve(size_t len)
+{
+  return log_ring_reserve(&log_ring, len);
+}
+
+static void log_commit(LogRecord_t *rec, size_t len)
+{
+  log_ring_commit(&log_ring, rec, len);
+#if LOG_PIPELINE_STATS
+  log_stats_max(&log_record_max, len);
+  log_stats_max(&log_buffer_max, log_ring_used(&log_ring));
+#endif
+}
+
+#if LOG_FORMAT_IN_PLACE
+// Only a message that failed to format is given back
+static void log_cancel(LogRecord_t *rec)
+{
+  log_ring_cancel(&log_ring, rec);
+}
+#endif
+
+#else
+// Reserves under logMutex and accounts for records overwritten to make room
+static LogRecord_t* log_try_reserve(size_t len, int *status)
+{
+  size_t count;
+  void *rec;
+
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+
+  count = str_buff_count(log_fill);
+  rec = str_buf_reserve(log_fill, len, status);
+
+  if(rec == NULL)
+  {
+    xSemaphoreGive(logMutex);
+  }
+  else if(*status == STR_BUF_OVERWROTE)
+  {
+    // The overwritten records will never be taken by logTask
+    atomic_fetch_sub_explicit(&log_pending, count + 1 - str_buff_count(log_fill), memory_order_relaxed);
+    atomic_store_explicit(&log_report_pending, 1, memory_order_relaxed);
+  }
+
+  return rec;
+}
+
+/**
+ * Reserves room for a record of up to len bytes in the log buffer, to be
+ * written in place and finished with log_commit. logMutex
+ * stays taken in between, so the record must be written without blocking.
+ * With the STR_BUF_BLOCK policy a full buffer makes the calling task wait
+ * for logTask to swap in its drained buffer, for at most
+ * LOG_BLOCK_TIMEOUT_MS in total, before the record is given up. Before the
+ * scheduler runs there is nobody to wait for and the record is given up at
+ * once. The other policies never wait.
+ *
+ * @return The record, NULL if it is lost.
+ */
+static LogRecord_t* log_reserve(size_t len)
+{
+  TimeOut_t timeout;
+  TickType_t remaining = pdMS_TO_TICKS(LOG_BLOCK_TIMEOUT_MS);
+  LogRecord_t *rec;
+  int status;
+
+  rec = log_try_reserve(len, &status);
+
+  if(rec != NULL || LOG_BUFFER_POLICY != STR_BUF_BLOCK)
+    return rec;
+
+  vTaskSetTimeOutState(&timeout);
+  atomic_fetch_add_explicit(&log_space_waiters, 1, memory_order_relaxed);
+
+  while(rec == NULL && log_task_handle != NULL &&
+        xTaskGetSchedulerState() == taskSCHEDULER_RUNNING &&
+        xTaskCheckForTimeOut(&timeout, &remaining) == pdFALSE)
+  {
+    // Have logTask drain right away instead of after LOG_MAX_LATENCY_MS
+    xTaskNotify(log_task_handle, LOG_NOTIFY_FLUSH, eSetBits);
+    xSemaphoreTake(logSpace, remaining);
+
+    rec = log_try_reserve(len, &status);
+  }
+
+  // logTask wakes one producer per swap, the next waiting one is woken here
+  if(atomic_fetch_sub_explicit(&log_space_waiters, 1, memory_order_relaxed) > 1 && rec != NULL)
+    xSemaphoreGive(logSpace);
+
+  if(rec == NULL)
+  {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    str_buf_discard(log_fill, len);
+    xSemaphoreGive(logMutex);
+  }
+
+  return rec;
+}
+
+static void log_commit(LogRecord_t *rec, size_t len)
+{
+  str_buf_commit(log_fill, rec, len);
+  atomic_store_explicit(&log_fill_queued, 1, memory_order_release);
+#if LOG_PIPELINE_STATS
+  log_stats_max(&log_record_max, len);
+  log_stats_max(&log_buffer_max, str_buff_used_bytes(log_fill));
+#endif
+  xSemaphoreGive(logMutex);
+}
+
+#endif // LOG_USE_LOCKFREE_RING
+
 /**
- * Logs a message with a specified severity level. The message format and arguments
- * are similar to printf, allowing for flexible message composition. This function
- * is responsible for formatting the log message and queuing it in the log buffer.
+ * Logs a message with the severity level of its call site. The message format
+ * and arguments are similar to printf, allowing for flexible message composition.
+ * With LOG_DEFERRED_FORMATTING only the raw arguments are captured here and
+ * logTask does the formatting, otherwise the message text is formatted here.
+ * Either way the record is written straight into the log buffer. Only
+ * where the repeat check has to see the message first, or where eager
+ * formatting would otherwise run with logMutex held, are the arguments or
+ * the text staged on the caller's stack and copied in. Calls over the
+ * call site's rate limit and repeats of its previous message are only counted,
+ * logTask reports the counts later (see LOG_RATE_LIMIT_PER_SEC).
  *
  * Call: LOG_INFO("Hello World!");
  * Outp: "[INFO] Core/Src/main.c:425 StartDefaultTask() - Hello World!"
- * 
- * @param file The source file name from which the log is generated.
- * @param line The line number in the source file at which the log is generated.
- * @param func The function name from which the log is generated.
- * @param level The severity level of the log (e.g., ERROR, WARNING, INFO).
- * @param log_str The format string for the log message (similar to printf).
+ *
+ * @param site The call site holding file, line, function, level and format.
  * @param ... Variable arguments providing values to fill the format string.
  */
-void logging(const char *file, int line, const char *func, LogLevel_e level, const char *log_str, ...)
+void logging(const LogCallSite_t *site, ...)
 {
-  if (level == LOG_LEVEL_NONE) return;
+  LogRecord_t *rec;
+  uint8_t *payload;
+  uint64_t timestamp;
+  va_list args;
+#if LOG_DEFERRED_FORMATTING && LOG_SUPPRESS_DUPLICATES
+  LogArgs_t taken;
+#elif !LOG_DEFERRED_FORMATTING
+#if !LOG_FORMAT_IN_PLACE
+  char text[LOG_RECORD_PAYLOAD_SIZE];
+#endif
+  size_t text_len;
+  int needed;
+#endif
 
-  int offset, needed;
+  if (site->level == LOG_LEVEL_NONE) return;
 
-  char log_msg[LOG_MSG_BUFFER_SIZE];
-  log_msg[LOG_MSG_BUFFER_SIZE - 1] = '\0';
+  timestamp = log_timestamp();
 
-  const char* level_str = "";
-  switch(level)
+#if LOG_RATE_LIMIT_PER_SEC
+  if (!log_rate_admit(site, timestamp)) return;
+#endif
+
+#if LOG_DEFERRED_FORMATTING && LOG_SUPPRESS_DUPLICATES
+  va_start(args, site);
+  log_take_args(&taken, site->format, &args);
+  va_end(args);
+
+  if (log_is_repeat(site, timestamp, log_args_hash(site, taken.words, taken.nwords))) return;
+#elif !LOG_DEFERRED_FORMATTING && !LOG_FORMAT_IN_PLACE
+  va_start(args, site);
+  needed = log_vsnprintf(text, sizeof(text), site->format, args);
+  va_end(args);
+
+  if (needed < 0) return;
+  // Longer messages are truncated, the stored text stays terminated
+  text_len = ((size_t)needed < sizeof(text)) ? (size_t)needed + 1 : sizeof(text);
+
+#if LOG_SUPPRESS_DUPLICATES
+  if (log_is_repeat(site, timestamp, log_hash(log_args_hash(site, NULL, 0), text, text_len))) return;
+#endif
+#endif
+
+#if !LOG_DEFERRED_FORMATTING && !LOG_FORMAT_IN_PLACE
+  rec = log_reserve(sizeof(LogRecord_t) + text_len);
+#else
+  // Reserved at the largest size and written in place, the unused rest is
+  // handed back on commit
+  rec = log_reserve(LOG_MSG_BUFFER_SIZE);
+#endif
+  if (rec == NULL)
   {
-      case LOG_LEVEL_ERROR:   level_str = "ERROR";   break;
-      case LOG_LEVEL_WARNING: level_str = "WARNING"; break;
-      case LOG_LEVEL_INFO:    level_str = "INFO";    break;
-      default:                level_str = "NONE";    break;
+    atomic_store_explicit(&log_report_pending, 1, memory_order_relaxed);
+    return;
   }
+  payload = (uint8_t*)(rec + 1);
 
-  // Begin log message with [LEVEL] *.c:102 func() -
-  offset = snprintf(log_msg, sizeof(log_msg), "[%s] %s:%d %s() - ", level_str, file, line, func);
-  if (offset < 0 || offset >= sizeof(log_msg))
+  rec->site = site;
+  rec->timestamp = timestamp;
+  rec->nwords = 0;
+  rec->flags = 0;
+
+#if LOG_DEFERRED_FORMATTING && LOG_SUPPRESS_DUPLICATES
+  log_place_args(rec, payload, &taken);
+#elif LOG_DEFERRED_FORMATTING
+  va_start(args, site);
+  log_capture_args(rec, payload, site->format, &args);
+  va_end(args);
+#elif LOG_FORMAT_IN_PLACE
+  va_start(args, site);
+  needed = log_vsnprintf((char*)payload, LOG_RECORD_PAYLOAD_SIZE, site->format, args);
+  va_end(args);
+  if (needed < 0)
   {
-      return;
+    log_cancel(rec);
+    return;
   }
+  // Longer messages are truncated, the stored text stays terminated
+  text_len = ((size_t)needed < LOG_RECORD_PAYLOAD_SIZE) ? (size_t)needed + 1 : LOG_RECORD_PAYLOAD_SIZE;
+#else
+  memcpy(payload, text, text_len);
+#endif
+#if !LOG_DEFERRED_FORMATTING
+  rec->len = text_len;
+  if ((size_t)needed >= LOG_RECORD_PAYLOAD_SIZE)
+    rec->flags |= LOG_RECORD_TRUNCATED;
+#endif
 
-  // Process the variable inputs for the log string
-  va_list args;
-  va_start(args, log_str);
-  needed = vsnprintf(log_msg + offset, sizeof(log_msg) - offset, log_str, args);
-  va_end(args);
+#if LOG_PIPELINE_STATS
+  if (rec->flags & LOG_RECORD_TRUNCATED)
+    atomic_fetch_add_explicit(&log_truncated, 1, memory_order_relaxed);
+#endif
+
+  log_commit(rec, sizeof(LogRecord_t) + rec->len);
+
+  log_notify(site->level);
+}
+
+/**
+ * Logs a message from an interrupt handler. Called through the
+ * LOG_*_FROM_ISR macros, which convert the arguments to 32-bit words at the
+ * call site. The record is copied into a fixed-size slot with interrupts
+ * masked through BASEPRI, so the cost is bounded and independent of the
+ * format string. When all slots are taken the record is dropped and counted.
+ *
+ * Call: LOG_INFO_FROM_ISR("EXTI line %u", 11);
+ *
+ * @param site The call site holding file, line, function, level and format.
+ * @param nargs Number of valid words in args.
+ * @param args The call's arguments converted to 32-bit words.
+ */
+void logging_from_isr(const LogCallSite_t *site, uint32_t nargs, const uint32_t *args)
+{
+  UBaseType_t saved_interrupt_status;
+  LogIsrRecord_t *rec;
+  uint64_t timestamp;
+
+  if (site->level == LOG_LEVEL_NONE) return;
+
+  timestamp = log_timestamp();
 
-  if (needed < 0 || needed >= (int)(sizeof(log_msg) - offset))
+#if LOG_RATE_LIMIT_PER_SEC
+  if (!log_rate_admit(site, timestamp)) return;
+#endif
+#if LOG_SUPPRESS_DUPLICATES
+  if (log_is_repeat(site, timestamp, log_args_hash(site, args, nargs))) return;
+#endif
+
+  saved_interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+
+  if (log_isr_head - log_isr_tail >= LOG_ISR_BUFFER_SIZE)
   {
-      return;
+    log_isr_dropped = log_isr_dropped + 1;
+    taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+    atomic_store_explicit(&log_report_pending, 1, memory_order_relaxed);
+    return;
   }
 
-  strncat(log_msg, "\r\n", sizeof(log_msg) - strlen(log_msg) - 1);
+  rec = &log_isr_buffer[log_isr_head & (LOG_ISR_BUFFER_SIZE - 1)];
 
-  xSemaphoreTake(logMutex, portMAX_DELAY);
-  str_buf_push(&log_buffer, log_msg);
-  xSemaphoreGive(logMutex);
-}
\ No newline at end of file
+  rec->header.site = site;
+  rec->header.timestamp = timestamp;
+  rec->header.len = nargs * sizeof(uint32_t);
+  rec->header.nwords = nargs;
+  rec->header.flags = LOG_RECORD_DEFERRED;
+  for (uint32_t i = 0; i < nargs; i++)
+    rec->args[i] = args[i];
+
+  log_isr_head = log_isr_head + 1;
+
+  taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+
+  log_notify_from_isr(site->level);
+}
+
+/**
+ * Copies the logging counters, e.g. to check how often logTask woke up
+ * without work or how long ERROR records took to reach the wire. With
+ * LOG_PIPELINE_STATS they also tell how close the queues came to full and
+ * how long records take from the LOG_* call to the end of their transfer,
+ * and how deep logTask's stack got, to size LOG_BUFFER_BYTES,
+ * LOG_MSG_BUFFER_SIZE and LOG_TASK_STACK_SIZE from.
+ *
+ * @param stats Receives a snapshot of the counters.
+ */
+void loggingGetStats(LogStats_t *stats)
+{
+  taskENTER_CRITICAL();
+  *stats = log_stats;
+  taskEXIT_CRITICAL();
+
+#if LOG_PIPELINE_STATS
+  stats->produced = atomic_load_explicit(&log_produced, memory_order_relaxed);
+  stats->truncated = atomic_load_explicit(&log_truncated, memory_order_relaxed);
+  stats->record_max = atomic_load_explicit(&log_record_max, memory_order_relaxed);
+  stats->pending_max = atomic_load_explicit(&log_pending_max, memory_order_relaxed);
+  stats->buffer_max = atomic_load_explicit(&log_buffer_max, memory_order_relaxed);
+  if(log_task_handle != NULL)
+    stats->stack_free_min = uxTaskGetStackHighWaterMark(log_task_handle) * sizeof(StackType_t);
+#endif
+}
+
+/**
+ * Hashes a module tag the same way LOG_MODULE_HASH does at compile time.
+ */
+static uint32_t log_module_hash(const char *module)
+{
+  uint32_t hash = 0;
+  uint32_t factor = 1;
+
+  for(size_t i = 0; i < LOG_MODULE_TAG_MAX && module[i] != '\0'; i++)
+  {
+    hash += (uint8_t)module[i] * factor;
+    factor *= 31;
+  }
+
+  return hash;
+}
+
+/**
+ * Sets the runtime level of a module. Every call site tagged with the
+ * module is enabled if its level is at or below the given level and
+ * disabled otherwise. Levels compiled out with SET_LOG_LEVEL_* cannot be
+ * enabled again, their call sites do not exist.
+ *
+ * Call: loggingSetModuleLevel("main", LOG_LEVEL_WARNING);
+ *
+ * @param module The LOG_MODULE tag of the module.
+ * @param level Most verbose level still logged, LOG_LEVEL_NONE silences it.
+ * @return Number of call sites of the module, 0 if the tag is unknown.
+ */
+int loggingSetModuleLevel(const char *module, LogLevel_e level)
+{
+  uint32_t hash = log_module_hash(module);
+  int count = 0;
+
+  for(const LogCallSite_t *site = __start_log_callsites; site < __stop_log_callsites; site++)
+  {
+    if(site->module != hash)
+      continue;
+
+    site->state->enabled = (site->level <= level);
+    count++;
+  }
+
+  return count;
+}
+
+/**
+ * Enables or disables a single call site, independent of its module level.
+ *
+ * @param id Call-site ID as reported by the binary wire format.
+ * @param enabled 1 to log the call site, 0 to skip it.
+ * @return 0 on success, -1 if there is no call site with that ID.
+ */
+int loggingSetCallSiteEnabled(uint16_t id, uint8_t enabled)
+{
+  if(id >= (uint32_t)(__stop_log_callsites - __start_log_callsites))
+    return -1;
+
+  __start_log_callsites[id].state->enabled = (enabled != 0);
+
+  return 0;
+}
@@ -0,0 +1,201 @@
+/*****************************************************************************
+* | File        : logring.c
+* | Author      : Luke Mulder
+* | Function    : Lock-free multi-producer single-consumer record ring
+* | Info        :
+*   Every record starts with a 32-bit header word holding the space the
+*   record occupies, the payload length committed by the producer and the
+*   state flags. The consumer clears the space of every record it releases,
+*   so a header that has not been written yet always reads as uncommitted.
+*   Head and tail are free running counters, the storage size MUST be a
+*   power of two so positions can be masked instead of using modulus.
+******************************************************************************/
+
+#include "logring.h"
+#include "string.h"
+
+// Header word layout
+#define LOG_RING_SIZE_MASK   0x0000FFFFu  // Bytes occupied, header included
+#define LOG_RING_LEN_SHIFT   16           // Committed payload length
+#define LOG_RING_LEN_MASK    0x3FFFu
+#define LOG_RING_PADDING     0x40000000u  // Filler up to the end of storage
+#define LOG_RING_COMMITTED   0x80000000u
+
+#define LOG_RING_HEADER_SIZE sizeof(uint32_t)
+
+static inline uint32_t log_ring_align(size_t len)
+{
+  return (len + LOG_RING_HEADER_SIZE + 3) & ~3u;
+}
+
+static inline _Atomic uint32_t* log_ring_header(LogRing *ring, uint32_t pos)
+{
+  return (_Atomic uint32_t*)(ring->buf + (pos & (ring->size - 1)));
+}
+
+int log_ring_init(LogRing *ring, uint8_t *storage, size_t size)
+{
+  // Ring size MUST be a power of 2, storage must be word aligned and the
+  // record size has to fit the header's size field
+  if(ring == NULL || storage == NULL || size == 0 || (size & (size - 1)) != 0 ||
+     ((uintptr_t)storage & 3) != 0 || size > LOG_RING_SIZE_MASK + 1)
+  {
+    return -1;
+  }
+
+  memset(storage, 0, size);
+
+  ring->buf = storage;
+  ring->size = size;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->dropped, 0);
+
+  return 0;
+}
+
+/**
+ * Claims space for a record of len payload bytes, len must not be 0.
+ * Safe to call from any number of tasks concurrently, the call never blocks.
+ *
+ * @return Pointer to the payload or NULL when the ring has no room.
+ */
+void* log_ring_reserve(LogRing *ring, size_t len)
+{
+  uint32_t need, total, head, tail, pos, contiguous;
+
+  if(len == 0)
+  {
+    return NULL;
+  }
+
+  if(len > LOG_RING_MAX_RECORD || log_ring_align(len) > ring->size / 2)
+  {
+    atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+    return NULL;
+  }
+
+  need = log_ring_align(len);
+  head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  do
+  {
+    tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    pos = head & (ring->size - 1);
+    contiguous = ring->size - pos;
+
+    // Records never wrap, skip to the start of storage instead
+    total = (need > contiguous) ? contiguous + need : need;
+
+    if(head + total - tail > ring->size)
+    {
+      atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+      return NULL;
+    }
+  } while(!atomic_compare_exchange_weak_explicit(&ring->head, &head, head + total,
+                                                 memory_order_acquire, memory_order_relaxed));
+
+  if(total != need)
+  {
+    atomic_store_explicit(log_ring_header(ring, head),
+                          LOG_RING_COMMITTED | LOG_RING_PADDING | contiguous,
+                          memory_order_release);
+    head += contiguous;
+  }
+
+  // Size is known by now, the record stays invisible until committed
+  atomic_store_explicit(log_ring_header(ring, head), need, memory_order_relaxed);
+
+  return ring->buf + (head & (ring->size - 1)) + LOG_RING_HEADER_SIZE;
+}
+
+/**
+ * Publishes a record returned by log_ring_reserve. len may be smaller
+ * than the reserved length, the remaining space is skipped by the consumer.
+ */
+void log_ring_commit(LogRing *ring, void *record, size_t len)
+{
+  _Atomic uint32_t *header = (_Atomic uint32_t*)((uint8_t*)record - LOG_RING_HEADER_SIZE);
+  uint32_t value = atomic_load_explicit(header, memory_order_relaxed);
+
+  value |= LOG_RING_COMMITTED | ((len & LOG_RING_LEN_MASK) << LOG_RING_LEN_SHIFT);
+
+  atomic_store_explicit(header, value, memory_order_release);
+}
+
+/**
+ * Withdraws a record returned by log_ring_reserve. Its space is published
+ * as padding, the consumer skips it like the filler in front of a wrap.
+ */
+void log_ring_cancel(LogRing *ring, void *record)
+{
+  _Atomic uint32_t *header = (_Atomic uint32_t*)((uint8_t*)record - LOG_RING_HEADER_SIZE);
+  uint32_t value = atomic_load_explicit(header, memory_order_relaxed);
+
+  value = LOG_RING_COMMITTED | LOG_RING_PADDING | (value & LOG_RING_SIZE_MASK);
+
+  atomic_store_explicit(header, value, memory_order_release);
+}
+
+/**
+ * Returns the oldest record if it has been committed. Records are handed
+ * out strictly in reservation order, the record stays valid until
+ * log_ring_release is called. Single consumer only.
+ *
+ * @return Payload length of the record, 0 when nothing is ready.
+ */
+size_t log_ring_peek(LogRing *ring, void **record)
+{
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t header;
+
+  for(;;)
+  {
+    if(tail == atomic_load_explicit(&ring->head, memory_order_acquire))
+      return 0;
+
+    header = atomic_load_explicit(log_ring_header(ring, tail), memory_order_acquire);
+
+    if(!(header & LOG_RING_COMMITTED))
+      return 0;
+
+    if(!(header & LOG_RING_PADDING))
+      break;
+
+    // Clear and skip the padding in front of a wrapped record
+    memset(ring->buf + (tail & (ring->size - 1)), 0, header & LOG_RING_SIZE_MASK);
+    tail += header & LOG_RING_SIZE_MASK;
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  }
+
+  *record = ring->buf + (tail & (ring->size - 1)) + LOG_RING_HEADER_SIZE;
+
+  return (header >> LOG_RING_LEN_SHIFT) & LOG_RING_LEN_MASK;
+}
+
+/**
+ * Releases the record returned by the last successful log_ring_peek and
+ * hands its space back to the producers.
+ */
+void log_ring_release(LogRing *ring)
+{
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t size = atomic_load_explicit(log_ring_header(ring, tail), memory_order_relaxed) & LOG_RING_SIZE_MASK;
+
+  // Cleared space reads as uncommitted once producers reuse it
+  memset(ring->buf + (tail & (ring->size - 1)), 0, size);
+
+  atomic_store_explicit(&ring->tail, tail + size, memory_order_release);
+}
+
+uint32_t log_ring_dropped(LogRing *ring)
+{
+  return atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+}
+
+// Storage claimed by producers and not yet released, padding included
+uint32_t log_ring_used(LogRing *ring)
+{
+  return atomic_load_explicit(&ring->head, memory_order_relaxed) -
+         atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
@@ -0,0 +1,136 @@
+/*****************************************************************************
+* | File        : logrtt.c
+* | Author      : Luke Mulder
+* | Function    : Memory mapped log channel read by a debug probe
+* | Info        :
+*   Offsets are kept within [0, size) as SEGGER RTT readers expect, so the
+*   size does not need to be a power of two. The probe updates rd_off at
+*   any time, it is read once per write and checked before use.
+******************************************************************************/
+
+#include "logrtt.h"
+#include "stm32f7xx_hal.h"
+#include <string.h>
+#include <stdatomic.h>
+
+#define LOG_RTT_CACHE_LINE 32
+
+// Writes cached bytes back to RAM where the probe reads them
+static void log_rtt_clean(const void *addr, size_t len)
+{
+  uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(LOG_RTT_CACHE_LINE - 1);
+  uintptr_t end = ((uintptr_t)addr + len + LOG_RTT_CACHE_LINE - 1) & ~(uintptr_t)(LOG_RTT_CACHE_LINE - 1);
+
+  if(len > 0 && (SCB->CCR & SCB_CCR_DC_Msk))
+    SCB_CleanDCache_by_Addr((uint32_t*)start, end - start);
+}
+
+// Drops the cached copy of the control block so rd_off is read from RAM.
+// The block is only written in log_rtt_init and log_rtt_write, which clean
+// it right away, so no dirty line is lost here.
+static void log_rtt_fetch(LogRttControlBlock *cb)
+{
+  if(SCB->CCR & SCB_CCR_DC_Msk)
+    SCB_InvalidateDCache_by_Addr((uint32_t*)cb, sizeof(*cb));
+}
+
+/**
+ * Sets up the control block with one up-buffer. The ID is written last,
+ * a probe scanning RAM finds the block only once it is usable.
+ *
+ * @param name Channel name shown by the probe software.
+ * @param storage Ring storage of size bytes, it must outlive the block.
+ * @param mode LOG_RTT_MODE_NO_BLOCK_SKIP or LOG_RTT_MODE_NO_BLOCK_TRIM.
+ * @return 0 on success, -1 if an argument is not usable.
+ */
+int log_rtt_init(LogRttControlBlock *cb, const char *name, uint8_t *storage, size_t size, uint32_t mode)
+{
+  if(cb == NULL || storage == NULL || size < 2 || size > UINT32_MAX ||
+     mode > LOG_RTT_MODE_NO_BLOCK_TRIM)
+  {
+    return -1;
+  }
+
+  memset(cb, 0, sizeof(*cb));
+
+  cb->max_up = 1;
+  cb->max_down = 0;
+  cb->up[0].name = name;
+  cb->up[0].buf = storage;
+  cb->up[0].size = size;
+  cb->up[0].wr_off = 0;
+  cb->up[0].rd_off = 0;
+  cb->up[0].flags = mode;
+
+  atomic_thread_fence(memory_order_release);
+  memcpy(cb->id, LOG_RTT_ID, sizeof(LOG_RTT_ID));
+
+  log_rtt_clean(cb, sizeof(*cb));
+
+  return 0;
+}
+
+static uint32_t log_rtt_free(const LogRttBuffer *up, uint32_t wr, uint32_t rd)
+{
+  // One byte stays free so a full ring is told apart from an empty one
+  return (rd > wr) ? rd - wr - 1 : up->size - (wr - rd) - 1;
+}
+
+/**
+ * Bytes that can be written right now, as far as the probe has read.
+ */
+size_t log_rtt_space(LogRttControlBlock *cb)
+{
+  LogRttBuffer *up = &cb->up[0];
+  uint32_t rd;
+
+  log_rtt_fetch(cb);
+  rd = up->rd_off;
+
+  if(rd >= up->size)
+    return 0;
+
+  return log_rtt_free(up, up->wr_off, rd);
+}
+
+/**
+ * Copies data into the up-buffer and publishes it to the probe. Never
+ * waits: what does not fit is dropped according to the buffer's mode.
+ * Only one task may write.
+ *
+ * @return Number of bytes written, less than len if some were dropped.
+ */
+size_t log_rtt_write(LogRttControlBlock *cb, const void *data, size_t len)
+{
+  LogRttBuffer *up = &cb->up[0];
+  uint32_t wr = up->wr_off;
+  uint32_t avail, first;
+
+  avail = log_rtt_space(cb);
+
+  if(len > avail)
+  {
+    if((up->flags & LOG_RTT_MODE_MASK) == LOG_RTT_MODE_NO_BLOCK_SKIP)
+      return 0;
+    len = avail;
+  }
+
+  first = (up->size - wr < len) ? up->size - wr : len;
+  memcpy(up->buf + wr, data, first);
+  memcpy(up->buf, (const uint8_t*)data + first, len - first);
+
+  log_rtt_clean(up->buf + wr, first);
+  log_rtt_clean(up->buf, len - first);
+
+  // The bytes must be in RAM before the probe sees the new offset
+  atomic_thread_fence(memory_order_release);
+
+  wr += len;
+  if(wr >= up->size)
+    wr -= up->size;
+  up->wr_off = wr;
+
+  log_rtt_clean(cb, sizeof(*cb));
+
+  return len;
+}
@@ -0,0 +1,208 @@
+/*****************************************************************************
+* | File        : logsink.c
+* | Author      : Luke Mulder
+* | Function    : Log outputs and the record ring they read from
+* | Info        :
+*   Every entry starts with a 32-bit header word holding the payload
+*   length, the record's level and the padding flag. Head, tail and the
+*   sink cursors are free running counters, the storage size MUST be a
+*   power of two so positions can be masked instead of using modulus.
+*   The tail is the slowest cursor, or the head while no sink is attached.
+******************************************************************************/
+
+#include "logsink.h"
+#include <string.h>
+
+// Header word layout
+#define LOG_SINK_LEN_MASK    0x0000FFFFu  // Payload bytes
+#define LOG_SINK_LEVEL_SHIFT 16
+#define LOG_SINK_PADDING     0x80000000u  // Filler up to the end of storage
+
+#define LOG_SINK_HEADER_SIZE sizeof(uint32_t)
+
+// Bytes an entry occupies, header included
+static inline uint32_t log_sink_align(uint32_t len)
+{
+  return (len + LOG_SINK_HEADER_SIZE + 3) & ~3u;
+}
+
+static inline uint32_t* log_sink_header(LogSinkRing *ring, uint32_t pos)
+{
+  return (uint32_t*)(ring->buf + (pos & (ring->size - 1)));
+}
+
+// Moves the tail up to the slowest cursor, freeing what every sink has read
+static void log_sink_ring_trim(LogSinkRing *ring)
+{
+  uint32_t behind = ring->head - ring->tail;
+
+  for(LogSink *sink = ring->sinks; sink != NULL; sink = sink->next)
+  {
+    if(sink->cursor - ring->tail < behind)
+      behind = sink->cursor - ring->tail;
+  }
+
+  ring->tail += behind;
+}
+
+// Room for len payload bytes at the head, padding to the end included
+static uint32_t log_sink_ring_needed(LogSinkRing *ring, size_t len)
+{
+  uint32_t to_end = ring->size - (ring->head & (ring->size - 1));
+  uint32_t needed = log_sink_align(len);
+
+  return (needed > to_end) ? to_end + needed : needed;
+}
+
+int log_sink_ring_init(LogSinkRing *ring, uint8_t *storage, size_t size)
+{
+  // Ring size MUST be a power of 2, storage must be word aligned and a
+  // padding entry has to fit the header's length field
+  if(ring == NULL || storage == NULL || size < 2 * LOG_SINK_HEADER_SIZE || (size & (size - 1)) != 0 ||
+     ((uintptr_t)storage & 3) != 0 || size > LOG_SINK_LEN_MASK + 1)
+  {
+    return -1;
+  }
+
+  ring->buf = storage;
+  ring->size = size;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->sinks = NULL;
+
+  return 0;
+}
+
+/**
+ * Adds a sink behind the ones already attached. It reads from the next
+ * entry pushed, what is in the ring already is not for it.
+ */
+int log_sink_attach(LogSinkRing *ring, LogSink *sink)
+{
+  LogSink **link = &ring->sinks;
+
+  if(sink == NULL)
+    return -1;
+
+  while(*link != NULL)
+  {
+    // Twice in the list would make it a loop
+    if(*link == sink)
+      return -1;
+    link = &(*link)->next;
+  }
+
+  sink->next = NULL;
+  sink->cursor = ring->head;
+  sink->dropped = 0;
+  *link = sink;
+
+  return 0;
+}
+
+/**
+ * Checks whether an entry of len payload bytes can be pushed without
+ * dropping anything a sink has not read yet.
+ */
+uint8_t log_sink_ring_fits(LogSinkRing *ring, size_t len)
+{
+  log_sink_ring_trim(ring);
+
+  return ring->size - (ring->head - ring->tail) >= log_sink_ring_needed(ring, len);
+}
+
+/**
+ * Copies an entry into the ring. Should it be full, the oldest entries
+ * are dropped to make room: every sink that had not read one of them yet,
+ * and would not have stepped over it for its level, counts it as dropped
+ * and moves on to the next.
+ *
+ * @param len Payload bytes, not 0, the entry takes at most half the ring.
+ * @param level Level of the record, compared with each sink's level.
+ * @return Number of entries dropped for sinks, -1 if len does not fit.
+ */
+int log_sink_ring_push(LogSinkRing *ring, const void *data, size_t len, uint8_t level)
+{
+  uint32_t needed;
+  int dropped = 0;
+
+  if(len == 0 || len > LOG_SINK_LEN_MASK || log_sink_align(len) > ring->size / 2)
+    return -1;
+
+  log_sink_ring_trim(ring);
+  needed = log_sink_ring_needed(ring, len);
+
+  while(ring->size - (ring->head - ring->tail) < needed)
+  {
+    uint32_t header = *log_sink_header(ring, ring->tail);
+    uint32_t size = log_sink_align(header & LOG_SINK_LEN_MASK);
+    uint8_t entry_level = header >> LOG_SINK_LEVEL_SHIFT;
+
+    for(LogSink *sink = ring->sinks; sink != NULL; sink = sink->next)
+    {
+      if(sink->cursor != ring->tail)
+        continue;
+
+      if(!(header & LOG_SINK_PADDING) && entry_level <= sink->level)
+      {
+        sink->dropped++;
+        dropped++;
+      }
+      sink->cursor += size;
+    }
+
+    ring->tail += size;
+  }
+
+  // Too close to the end, the entry starts over at the beginning
+  if(needed > log_sink_align(len))
+  {
+    uint32_t to_end = needed - log_sink_align(len);
+
+    *log_sink_header(ring, ring->head) = LOG_SINK_PADDING | (to_end - LOG_SINK_HEADER_SIZE);
+    ring->head += to_end;
+  }
+
+  *log_sink_header(ring, ring->head) = ((uint32_t)level << LOG_SINK_LEVEL_SHIFT) | len;
+  memcpy(log_sink_header(ring, ring->head) + 1, data, len);
+  ring->head += log_sink_align(len);
+
+  // Nobody left to read it, it is gone at once
+  if(ring->sinks == NULL)
+    ring->tail = ring->head;
+
+  return dropped;
+}
+
+/**
+ * Finds the next entry for a sink, stepping over entries above its level.
+ * The entry stays in place until the sink advances past it.
+ *
+ * @param entry Receives a pointer to the payload.
+ * @return Length of the payload, 0 when the sink has read everything.
+ */
+size_t log_sink_ring_peek(LogSinkRing *ring, LogSink *sink, void **entry)
+{
+  while(sink->cursor != ring->head)
+  {
+    uint32_t *header = log_sink_header(ring, sink->cursor);
+    uint8_t level = *header >> LOG_SINK_LEVEL_SHIFT;
+
+    if(!(*header & LOG_SINK_PADDING) && level <= sink->level)
+    {
+      *entry = header + 1;
+      return *header & LOG_SINK_LEN_MASK;
+    }
+
+    sink->cursor += log_sink_align(*header & LOG_SINK_LEN_MASK);
+  }
+
+  return 0;
+}
+
+// Moves a sink past the entry log_sink_ring_peek returned
+void log_sink_ring_advance(LogSinkRing *ring, LogSink *sink)
+{
+  if(sink->cursor != ring->head)
+    sink->cursor += log_sink_align(*log_sink_header(ring, sink->cursor) & LOG_SINK_LEN_MASK);
+}
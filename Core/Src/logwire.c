@@ -0,0 +1,92 @@
+/*****************************************************************************
+* | File        : logwire.c
+* | Author      : Luke Mulder
+* | Function    : Compact binary frames for the log wire
+* | Info        :
+*   Zigzag maps signed values onto unsigned ones by magnitude, 0, -1, 1,
+*   -2, ... become 0, 1, 2, 3, ... so a small negative delta or argument
+*   still fits a one byte varint.
+******************************************************************************/
+
+#include "logwire.h"
+#include <string.h>
+
+static uint64_t log_wire_zigzag(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+/**
+ * Prepares an encoder, its first frame carries the absolute time.
+ *
+ * @param sync_interval Most frames between two absolute timestamps, 1
+ *                      makes every frame absolute.
+ */
+void log_wire_init(LogWireEncoder *enc, uint32_t sync_interval)
+{
+  enc->last = 0;
+  enc->sync_interval = sync_interval ? sync_interval : 1;
+  enc->since_absolute = enc->sync_interval;
+}
+
+/**
+ * Writes value as a LEB128 varint.
+ *
+ * @param out Room for LOG_WIRE_VARINT_MAX bytes.
+ * @return Number of bytes written, 1 to LOG_WIRE_VARINT_MAX.
+ */
+size_t log_wire_varint(uint64_t value, uint8_t *out)
+{
+  size_t len = 0;
+
+  while(value >= 0x80)
+  {
+    out[len++] = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  out[len++] = (uint8_t)value;
+
+  return len;
+}
+
+/**
+ * Encodes a frame, see logwire.h for the layout. The timestamp is sent
+ * relative to the previous frame unless an absolute one is due.
+ *
+ * @param size Room in out, frames are only written whole.
+ * @return Length of the frame written to out, 0 if it may not fit. The
+ *         encoder is left unchanged then.
+ */
+size_t log_wire_encode(LogWireEncoder *enc, const LogWireFrame *frame, uint8_t *out, size_t size)
+{
+  uint8_t absolute = (enc->since_absolute >= enc->sync_interval);
+  size_t len = 0;
+
+  if(size < LOG_WIRE_FRAME_MAX(frame->nwords, frame->arena_len))
+    return 0;
+
+  out[len++] = LOG_WIRE_SYNC;
+  out[len++] = (frame->flags & (LOG_WIRE_LEVEL_MASK | LOG_WIRE_REPORT)) | (absolute ? LOG_WIRE_ABSOLUTE : 0);
+  len += log_wire_varint(frame->id, out + len);
+
+  // Records are not strictly in time order, two tasks may queue theirs the
+  // other way round, so the delta is signed
+  if(absolute)
+    len += log_wire_varint(frame->timestamp, out + len);
+  else
+    len += log_wire_varint(log_wire_zigzag((int64_t)(frame->timestamp - enc->last)), out + len);
+
+  len += log_wire_varint(frame->nwords, out + len);
+  for(uint32_t i = 0; i < frame->nwords; i++)
+    len += log_wire_varint(log_wire_zigzag((int32_t)frame->words[i]), out + len);
+
+  len += log_wire_varint(frame->arena_len, out + len);
+  if(frame->arena_len > 0)
+    memcpy(out + len, frame->arena, frame->arena_len);
+  len += frame->arena_len;
+
+  enc->last = frame->timestamp;
+  enc->since_absolute = absolute ? 1 : enc->since_absolute + 1;
+
+  return len;
+}
@@ -17,46 +17,79 @@ int is_power_of_two(size_t value) {
     return value != 0 && (value & (value - 1)) == 0;
 }
 
-int str_buf_init_custom_size(StringBuffer *sb, size_t buf_size, size_t str_size)
+// Header word of a padding entry, the low bits hold the bytes it spans.
+// The length takes all 31 bits so no storage size limits an entry.
+#define STR_BUF_PADDING 0x80000000u
+#define STR_BUF_LEN_MASK 0x7FFFFFFFu
+
+static inline uint32_t* str_buf_header(StringBuffer *sb, size_t pos)
+{
+  // Again the size MUST be a power of 2 to avoid modulus
+  return (uint32_t*)(sb->buf + (pos & (sb->buf_size - 1)));
+}
+
+/**
+ * Sets up a buffer on caller provided storage, nothing is allocated.
+ * STR_BUF_DEFINE instances are set up already, this resets them.
+ *
+ * @param storage Word aligned storage of buf_size bytes.
+ * @return 0 on success, -1 if the sizes or the storage are not usable.
+ */
+int str_buf_init_static(StringBuffer *sb, uint8_t *storage, size_t buf_size, size_t str_size)
 {
   // String buffer size MUST be a power of 2
   // Otherwise overflow optimizations will not work in push/pop
-  if(!is_power_of_two(buf_size) || str_size > STRING_BUFFER_MAX_LENGTH )
+  // The largest entry has to fit twice so it can always be placed after a
+  // padding entry
+  if(sb == NULL || storage == NULL || ((uintptr_t)storage & 3) != 0 ||
+     !is_power_of_two(buf_size) || str_size > STRING_BUFFER_MAX_LENGTH ||
+     STR_BUF_ENTRY_SIZE(str_size) > buf_size / 2)
   {
     return -1;
   }
 
+  sb->buf = storage;
   sb->head = 0;
   sb->tail = 0;
   sb->count = 0;
   sb->buf_size = buf_size;
   sb->str_size = str_size;
+  sb->policy = STR_BUF_OVERWRITE_OLDEST;
+  sb->dropped = 0;
+  sb->dropped_bytes = 0;
+  sb->leased = 0;
+  sb->lease_pos = 0;
+  sb->wrap_pos = 0;
+  sb->allocated = 0;
 
-  sb->buf = (char**)malloc(sizeof(char*) * sb->buf_size);
+  return 0;
+}
 
-  if(sb->buf == NULL)
+int str_buf_init_custom_size(StringBuffer *sb, size_t buf_size, size_t str_size)
+{
+  uint8_t *storage;
+
+  if(!is_power_of_two(buf_size))
   {
     return -1;
   }
 
-  // Memory allocation for buffer string
-  for(int i = 0; i < sb->buf_size; i++)
+  // A single block for all entries, word aligned by malloc
+  storage = (uint8_t*)malloc(buf_size);
+
+  if(storage == NULL)
   {
-    sb->buf[i] = (char*)malloc(sizeof(char) * sb->str_size);
+    return -1;
+  }
 
-    if(sb->buf[i] == NULL)
-    {
-      // If failed to allocate buffer entry return previously allocated
-      while(i-- > 0)
-      {
-          free(sb->buf[i]);
-      }
-      free(sb->buf);
-
-      return -1;
-    }
+  if(str_buf_init_static(sb, storage, buf_size, str_size) != 0)
+  {
+    free(storage);
+    return -1;
   }
-  
+
+  sb->allocated = 1;
+
   return 0;
 }
 
@@ -67,42 +100,304 @@ int str_buf_init(StringBuffer *sb)
 
 int str_buf_free(StringBuffer *sb)
 {
-  // Deallocate all buffer memory on the heap
-  for(int i = 0; i < sb->buf_size; i++)
+  // Deallocate all buffer memory on the heap, static storage stays
+  if(sb->allocated)
+  {
+    free(sb->buf);
+  }
+
+  sb->buf = NULL;
+  sb->allocated = 0;
+
+  return 0;
+}
+
+int str_buf_set_policy(StringBuffer *sb, StringBufferPolicy_e policy)
+{
+  if(sb == NULL || policy > STR_BUF_BLOCK)
   {
-    free(sb->buf[i]);
+    return -1;
   }
 
-  free(sb->buf);
+  sb->policy = policy;
 
   return 0;
 }
 
+/**
+ * Skips the padding entry at the tail, if any.
+ *
+ * @return Header of the oldest entry, NULL if the buffer is empty.
+ */
+static uint32_t* str_buf_oldest(StringBuffer *sb)
+{
+  uint32_t *header;
+
+  if(sb->count == 0)
+  {
+    return NULL;
+  }
+
+  header = str_buf_header(sb, sb->tail);
+
+  if(*header & STR_BUF_PADDING)
+  {
+    sb->tail += *header & STR_BUF_LEN_MASK;
+    header = str_buf_header(sb, sb->tail);
+
+    if(sb->leased == 0)
+      sb->lease_pos = sb->tail;
+  }
+
+  return header;
+}
+
+/**
+ * Removes the oldest entry.
+ *
+ * @return Length of the entry removed.
+ */
+static size_t str_buf_advance_tail(StringBuffer *sb)
+{
+  size_t len = *str_buf_oldest(sb) & STR_BUF_LEN_MASK;
+
+  sb->tail += STR_BUF_ENTRY_SIZE(len);
+  sb->count--;
+
+  return len;
+}
+
+/**
+ * Applies the overflow policy, only called when the entry does not fit.
+ *
+ * @param len Length of the entry being pushed.
+ * @param total Storage the entry needs, padding included.
+ * @return STR_BUF_OVERWROTE if room was made, STR_BUF_FULL otherwise.
+ */
+static int str_buf_overflow(StringBuffer *sb, size_t len, size_t total)
+{
+  if(sb->policy == STR_BUF_BLOCK)
+  {
+    // Not lost yet, the caller may still retry
+    return STR_BUF_FULL;
+  }
+
+  // The oldest entries are leased, the new entry is lost instead
+  if(sb->policy == STR_BUF_OVERWRITE_OLDEST && sb->leased == 0)
+  {
+    // Init guarantees the entry fits once the buffer is empty
+    while(sb->head + total - sb->tail > sb->buf_size)
+    {
+      sb->dropped++;
+      sb->dropped_bytes += str_buf_advance_tail(sb);
+    }
+    sb->lease_pos = sb->tail;
+    return STR_BUF_OVERWROTE;
+  }
+
+  sb->dropped++;
+  sb->dropped_bytes += len;
+  return STR_BUF_FULL;
+}
+
+/**
+ * Claims storage for an entry of len bytes and writes its length prefix.
+ * The entry is stored as soon as this returns, the caller fills it in.
+ *
+ * @param status Receives 0, STR_BUF_OVERWROTE or STR_BUF_FULL.
+ * @return Pointer to the entry, NULL when it was not stored.
+ */
+static uint8_t* str_buf_claim(StringBuffer *sb, size_t len, int *status)
+{
+  size_t need = STR_BUF_ENTRY_SIZE(len);
+  size_t contiguous = sb->buf_size - (sb->head & (sb->buf_size - 1));
+  // Entries never wrap, skip to the start of storage instead
+  size_t total = (need > contiguous) ? contiguous + need : need;
+  uint8_t *entry;
+
+  *status = 0;
+
+  // Room left is the common case, the policy only matters when full
+  if(sb->head + total - sb->tail > sb->buf_size)
+  {
+    *status = str_buf_overflow(sb, len, total);
+    if(*status == STR_BUF_FULL)
+      return NULL;
+  }
+
+  if(total != need)
+  {
+    *str_buf_header(sb, sb->head) = STR_BUF_PADDING | contiguous;
+    sb->wrap_pos = sb->head;
+    sb->head += contiguous;
+  }
+
+  *str_buf_header(sb, sb->head) = len;
+  entry = (uint8_t*)str_buf_header(sb, sb->head) + STR_BUF_HEADER_SIZE;
+
+  sb->head += need;
+  sb->count++;
+
+  return entry;
+}
+
 int str_buf_push(StringBuffer *sb, const char* str) {
+  uint8_t *entry;
+  size_t len;
+  int status;
+
   if(sb == NULL || str == NULL)
   {
     return -1;
   }
 
-  strncpy(sb->buf[sb->head], str, sb->str_size - 1);
-  sb->buf[sb->head][sb->str_size - 1] = '\0';
+  // Strings are stored with their terminator
+  len = strnlen(str, sb->str_size - 1);
 
-  // Again the size MUST be a power of 2 to avoid modulus
-  sb->head = (sb->head + 1) & (sb->buf_size - 1);
+  entry = str_buf_claim(sb, len + 1, &status);
+  if(entry == NULL)
+    return status;
+
+  memcpy(entry, str, len);
+  entry[len] = '\0';
+
+  return status;
+}
+
+int str_buf_push_data(StringBuffer *sb, const void* data, size_t len) {
+  uint8_t *entry;
+  int status;
+
+  if(sb == NULL || data == NULL || len > sb->str_size)
+  {
+    return -1;
+  }
+
+  entry = str_buf_claim(sb, len, &status);
+  if(entry == NULL)
+    return status;
+
+  // Binary entries are copied as is, no termination is added
+  memcpy(entry, data, len);
+
+  return status;
+}
+
+/**
+ * Reserves an entry of up to len bytes to be written in place instead of
+ * copied in with str_buf_push_data. The overflow policy applies to the
+ * full len. Nothing else may be pushed or read until the entry is
+ * committed or cancelled, callers sharing the buffer hold their lock
+ * across the whole sequence.
+ *
+ * @param status Receives 0, STR_BUF_OVERWROTE, STR_BUF_FULL or -1.
+ * @return Pointer to the entry, NULL when it was not reserved.
+ */
+void* str_buf_reserve(StringBuffer *sb, size_t len, int *status)
+{
+  if(sb == NULL || len > sb->str_size)
+  {
+    *status = -1;
+    return NULL;
+  }
+
+  return str_buf_claim(sb, len, status);
+}
 
-  // if head overwrites tail
-  if(sb->head == sb->tail)
-    sb->tail = (sb->tail + 1) & (sb->buf_size - 1);
+// Header of a reserved entry, NULL if entry is not the newest entry
+static uint32_t* str_buf_reservation(StringBuffer *sb, void* entry)
+{
+  uint32_t *header;
 
-  // Size is the max count
-  if(sb->count < sb->buf_size)
-    sb->count++;
+  if(sb == NULL || entry == NULL || sb->count == 0)
+  {
+    return NULL;
+  }
+
+  header = (uint32_t*)entry - 1;
+
+  if(header != str_buf_header(sb, sb->head - STR_BUF_ENTRY_SIZE(*header & STR_BUF_LEN_MASK)))
+  {
+    return NULL;
+  }
+
+  return header;
+}
+
+/**
+ * Stores a reserved entry with its final length, at most the reserved one.
+ * The unused end of the reservation is handed back.
+ *
+ * @return 0 on success, -1 if entry is not the reservation or len too large.
+ */
+int str_buf_commit(StringBuffer *sb, void* entry, size_t len)
+{
+  uint32_t *header = str_buf_reservation(sb, entry);
+
+  if(header == NULL || len > (*header & STR_BUF_LEN_MASK))
+  {
+    return -1;
+  }
+
+  sb->head -= STR_BUF_ENTRY_SIZE(*header & STR_BUF_LEN_MASK) - STR_BUF_ENTRY_SIZE(len);
+  *header = len;
+
+  return 0;
+}
+
+/**
+ * Withdraws a reserved entry, e.g. a log record found to be a duplicate
+ * once written. Entries overwritten to make room for it stay lost.
+ *
+ * @return 0 on success, -1 if entry is not the reservation.
+ */
+int str_buf_cancel(StringBuffer *sb, void* entry)
+{
+  uint32_t *header = str_buf_reservation(sb, entry);
+  uint32_t *padding;
+
+  if(header == NULL)
+  {
+    return -1;
+  }
+
+  sb->head -= STR_BUF_ENTRY_SIZE(*header & STR_BUF_LEN_MASK);
+  sb->count--;
+
+  // Take back the padding the reservation put in front of itself, a
+  // padding entry is always followed by an entry
+  padding = str_buf_header(sb, sb->wrap_pos);
+  if((sb->head & (sb->buf_size - 1)) == 0 && sb->head - sb->wrap_pos < sb->buf_size &&
+     (*padding & STR_BUF_PADDING) && sb->wrap_pos + (*padding & STR_BUF_LEN_MASK) == sb->head)
+  {
+    sb->head = sb->wrap_pos;
+    // Behind every entry from now on, str_buf_lease_spans ignores it
+    sb->wrap_pos = sb->head - sb->buf_size - 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Counts an entry as lost without storing it, used by STR_BUF_BLOCK callers
+ * that gave up waiting for room.
+ */
+int str_buf_discard(StringBuffer *sb, size_t len)
+{
+  if(sb == NULL)
+  {
+    return -1;
+  }
+
+  sb->dropped++;
+  sb->dropped_bytes += len;
 
   return 0;
 }
 
 int str_buf_pop(StringBuffer *sb, char** str_container) {
-  if(sb == NULL || str_container == NULL)
+  // Leased entries are taken with str_buf_release only
+  if(sb == NULL || str_container == NULL || sb->leased != 0)
   {
     return -1;
   }
@@ -114,14 +409,215 @@ int str_buf_pop(StringBuffer *sb, char** str_container) {
     return 0;
   }
 
-  *str_container = sb->buf[sb->tail];
+  // The entry is read in place, it stays intact until the next push
+  *str_container = (char*)(str_buf_oldest(sb) + 1);
 
-  sb->tail = (sb->tail + 1) & (sb->buf_size - 1);
-  sb->count--;
+  str_buf_advance_tail(sb);
+  sb->lease_pos = sb->tail;
+
+  return 0;
+}
+
+/**
+ * Same as str_buf_pop, also returns the entry's length as stored by the
+ * push so the caller never has to measure it.
+ *
+ * @param data Receives a pointer to the entry, NULL if the buffer is empty.
+ * @return Length of the entry, 0 if the buffer is empty, entries are
+ *         leased or sb or data is NULL.
+ */
+size_t str_buf_pop_data(StringBuffer *sb, void** data)
+{
+  size_t len;
+
+  if(sb == NULL || data == NULL)
+  {
+    return 0;
+  }
+
+  len = str_buf_peek_data(sb, data);
+
+  if(*data == NULL || sb->leased != 0)
+  {
+    *data = NULL;
+    return 0;
+  }
+
+  // The entry is read in place, it stays intact until the next push
+  str_buf_advance_tail(sb);
+  sb->lease_pos = sb->tail;
+
+  return len;
+}
+
+int str_buf_peek(StringBuffer *sb, char** str_container) {
+  if(sb == NULL || str_container == NULL)
+  {
+    return -1;
+  }
+
+  // Same as pop but the entry stays queued
+  str_buf_peek_data(sb, (void**)str_container);
 
   return 0;
 }
 
+/**
+ * Returns the oldest entry in place, without copying it. The entry stays
+ * queued until str_buf_pop.
+ *
+ * @param data Receives a pointer to the entry, NULL if the buffer is empty.
+ * @return Length of the entry, 0 if the buffer is empty or sb or data is NULL.
+ */
+size_t str_buf_peek_data(StringBuffer *sb, void** data)
+{
+  uint32_t *header;
+
+  if(sb == NULL || data == NULL)
+  {
+    return 0;
+  }
+
+  header = str_buf_oldest(sb);
+  if(header == NULL)
+  {
+    *data = NULL;
+    return 0;
+  }
+
+  *data = header + 1;
+
+  return *header & STR_BUF_LEN_MASK;
+}
+
+/**
+ * Leases the oldest entry not leased yet. The entry is read in place and
+ * stays intact until it is released, pushes never overwrite it, so it can
+ * be handed to a DMA transfer without copying. Call repeatedly to lease
+ * several entries, they are handed out in order.
+ *
+ * @param data Receives a pointer to the entry, NULL if none is left.
+ * @return Length of the entry, 0 if none is left or sb or data is NULL.
+ */
+size_t str_buf_lease(StringBuffer *sb, void** data)
+{
+  uint32_t *header;
+
+  if(sb == NULL || data == NULL)
+  {
+    return 0;
+  }
+
+  if(sb->leased == sb->count)
+  {
+    *data = NULL;
+    return 0;
+  }
+
+  header = str_buf_header(sb, sb->lease_pos);
+
+  // Skip the padding in front of a wrapped entry
+  if(*header & STR_BUF_PADDING)
+  {
+    sb->lease_pos += *header & STR_BUF_LEN_MASK;
+    header = str_buf_header(sb, sb->lease_pos);
+  }
+
+  sb->lease_pos += STR_BUF_ENTRY_SIZE(*header & STR_BUF_LEN_MASK);
+  sb->leased++;
+
+  *data = header + 1;
+
+  return *header & STR_BUF_LEN_MASK;
+}
+
+/**
+ * Releases the oldest leased entries and hands their storage back to
+ * the producers.
+ *
+ * @param n Number of entries to release, at most the number leased.
+ * @return 0 on success, -1 if fewer than n entries are leased.
+ */
+int str_buf_release(StringBuffer *sb, size_t n)
+{
+  if(sb == NULL || n > sb->leased)
+  {
+    return -1;
+  }
+
+  while(n-- > 0)
+  {
+    str_buf_advance_tail(sb);
+    sb->leased--;
+  }
+
+  return 0;
+}
+
+/**
+ * Leases every entry not leased yet and describes the storage holding them
+ * as at most two contiguous regions, the one before the wrap and the one
+ * after it. The regions hold the entries with their length prefixes, so a
+ * single DMA transfer per region moves all of them without a copy. Release
+ * the entries with str_buf_release once the transfers are done.
+ *
+ * @param spans Receives the regions, spans[1] is empty when only one is used.
+ * @return Number of entries leased, 0 if none was pending or sb or spans
+ *         is NULL.
+ */
+size_t str_buf_lease_spans(StringBuffer *sb, StrBufSpan spans[2])
+{
+  size_t start;
+  size_t entries;
+  uint32_t *header;
+
+  if(sb == NULL || spans == NULL)
+  {
+    return 0;
+  }
+
+  start = sb->lease_pos;
+  entries = sb->count - sb->leased;
+
+  spans[0].data = NULL;
+  spans[0].len = 0;
+  spans[1].data = NULL;
+  spans[1].len = 0;
+
+  if(entries == 0)
+  {
+    return 0;
+  }
+
+  // Skip the padding in front of a wrapped entry
+  header = str_buf_header(sb, start);
+  if(*header & STR_BUF_PADDING)
+  {
+    start += *header & STR_BUF_LEN_MASK;
+  }
+
+  spans[0].data = (uint8_t*)str_buf_header(sb, start);
+  spans[0].len = sb->head - start;
+
+  // Entries continue at the start of storage, either behind a padding
+  // entry or because the last one before the wrap ended exactly at the end
+  if((start & (sb->buf_size - 1)) + spans[0].len > sb->buf_size)
+  {
+    if(sb->wrap_pos - start < sb->head - start)
+      spans[0].len = sb->wrap_pos - start;
+    else
+      spans[0].len = sb->buf_size - (start & (sb->buf_size - 1));
+
+    spans[1].data = sb->buf;
+    spans[1].len = sb->head & (sb->buf_size - 1);
+  }
+
+  sb->leased = sb->count;
+  sb->lease_pos = sb->head;
+
+  return entries;
+}
+
 size_t str_buff_count(StringBuffer *sb)
 {
   return sb->count;
@@ -130,4 +626,20 @@ size_t str_buff_count(StringBuffer *sb)
 size_t str_buff_max_str_len(StringBuffer *sb)
 {
   return sb->str_size;
-}
\ No newline at end of file
+}
+
+size_t str_buff_dropped(StringBuffer *sb)
+{
+  return sb->dropped;
+}
+
+size_t str_buff_dropped_bytes(StringBuffer *sb)
+{
+  return sb->dropped_bytes;
+}
+
+// Storage taken by the stored entries, headers and padding included
+size_t str_buff_used_bytes(StringBuffer *sb)
+{
+  return sb->head - sb->tail;
+}
@@ -0,0 +1,252 @@
+/*****************************************************************************
+* | File        : bench_logging.c
+* | Author      : Luke Mulder
+* | Function    : Host microbenchmarks of the logging hot paths
+* | Info        :
+*   Times the producer side (LOG_* and LOG_*_FROM_ISR captures), logTask's
+*   render and batch path per record, the formatter next to the C
+*   library's snprintf, and the buffers underneath. Output
+*   follows the Google Benchmark layout so runs can be compared with the
+*   usual tools. Each benchmark only times its own work: queues are filled
+*   or drained outside the timed sections, the clock step that keeps the
+*   rate limit open is timed with the captures.
+*
+*   The Makefile builds this file twice, the second time with
+*   LOG_DEFERRED_FORMATTING=0. Run with "capture" only the LOG_INFO capture
+*   is timed and no table header printed, so the eager build's row goes
+*   right under the deferred one: what the caller pays with log_vsnprintf
+*   on its own stack next to capturing the argument words.
+*
+*   Host numbers only tell how changes compare, not what the Cortex-M7
+*   takes. Stub critical sections and semaphores cost nothing here.
+******************************************************************************/
+
+#define SET_LOG_LEVEL_INFO
+#include "../Core/Src/logging.c"
+#include "typedring.h"
+#include <time.h>
+
+#define BENCH_RECORDS 200000
+// Records captured between two untimed drains
+#define BENCH_BATCH 32
+
+#if LOG_DEFERRED_FORMATTING
+  #define BENCH_MODE "deferred"
+#else
+  #define BENCH_MODE "eager"
+#endif
+
+typedef struct {
+  double wall;
+  double cpu;
+} BenchTime_t;
+
+typedef struct {
+  uint32_t seq;
+  uint16_t channel[3];
+} BenchSample_t;
+
+TYPED_RING_DEFINE_SPSC(bench_ring, BenchSample_t, 64);
+
+static double bench_clock(clockid_t clock)
+{
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_start(BenchTime_t *start)
+{
+  start->wall = bench_clock(CLOCK_MONOTONIC);
+  start->cpu = bench_clock(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+static void bench_stop(const BenchTime_t *start, BenchTime_t *total)
+{
+  total->wall += bench_clock(CLOCK_MONOTONIC) - start->wall;
+  total->cpu += bench_clock(CLOCK_PROCESS_CPUTIME_ID) - start->cpu;
+}
+
+static void bench_report(const char *name, const BenchTime_t *total, long iterations)
+{
+  printf("%-32s %10.1f ns %12.1f ns %12ld\n", name,
+         total->wall / iterations, total->cpu / iterations, iterations);
+}
+
+// Moves the clock past the rate limit interval so no record is dropped
+static void bench_tick(void)
+{
+#if LOG_RATE_LIMIT_PER_SEC
+  DWT->CYCCNT += SystemCoreClock / LOG_RATE_LIMIT_PER_SEC;
+#else
+  DWT->CYCCNT += SystemCoreClock / 1000;
+#endif
+  log_timestamp();
+}
+
+// Sends everything queued, like logTask
+static void bench_drain(void)
+{
+  while(log_pump())
+    ;
+  stub_uart_reset();
+}
+
+static void bench_log_capture(void)
+{
+  BenchTime_t total = {0};
+  BenchTime_t start;
+
+  for(long i = 0; i < BENCH_RECORDS; i += BENCH_BATCH)
+  {
+    bench_start(&start);
+    for(int n = 0; n < BENCH_BATCH; n++)
+    {
+      bench_tick();
+      LOG_INFO("sample %d of %u at %s", (int)i, (unsigned)n, "rate");
+    }
+    bench_stop(&start, &total);
+    bench_drain();
+  }
+
+  bench_report("BM_LogInfoCapture/" BENCH_MODE, &total, BENCH_RECORDS);
+}
+
+static void bench_log_isr_capture(void)
+{
+  BenchTime_t total = {0};
+  BenchTime_t start;
+
+  for(long i = 0; i < BENCH_RECORDS; i += LOG_ISR_BUFFER_SIZE)
+  {
+    bench_start(&start);
+    for(int n = 0; n < LOG_ISR_BUFFER_SIZE; n++)
+    {
+      bench_tick();
+      LOG_INFO_FROM_ISR("irq %u %u", (unsigned)i, (unsigned)n);
+    }
+    bench_stop(&start, &total);
+    bench_drain();
+  }
+
+  bench_report("BM_LogInfoFromIsrCapture", &total, BENCH_RECORDS);
+}
+
+static void bench_log_render(void)
+{
+  BenchTime_t total = {0};
+  BenchTime_t start;
+
+  for(long i = 0; i < BENCH_RECORDS; i += BENCH_BATCH)
+  {
+    for(int n = 0; n < BENCH_BATCH; n++)
+    {
+      bench_tick();
+      LOG_INFO("sample %d of %u at %s", (int)i, (unsigned)n, "rate");
+    }
+    bench_start(&start);
+    bench_drain();
+    bench_stop(&start, &total);
+  }
+
+  bench_report("BM_LogRenderAndSend", &total, BENCH_RECORDS);
+}
+
+// The same line through log_snprintf or the C library's snprintf
+#define BENCH_FORMAT_LINE(fn, buf, i) \
+  fn(buf, sizeof(buf), "[%lu.%06lu%03lu] [%s] %s:%d %s() - sample %d of %u at %5.2f", \
+     (unsigned long)(i) / 1000, (unsigned long)(i) % 1000000, 123ul, "INFO", "Core/Src/main.c", 425, \
+     "StartDefaultTask", -(int)(i), (unsigned)(i) * 7u, (i) * 0.25)
+
+static void bench_format(void)
+{
+  BenchTime_t total = {0};
+  BenchTime_t start;
+  char line[LOG_LINE_BUFFER_SIZE];
+  volatile size_t sink = 0;
+
+  bench_start(&start);
+  for(long i = 0; i < BENCH_RECORDS; i++)
+    sink += BENCH_FORMAT_LINE(log_snprintf, line, i);
+  bench_stop(&start, &total);
+
+  bench_report("BM_LogSnprintf", &total, BENCH_RECORDS);
+
+  memset(&total, 0, sizeof(total));
+  bench_start(&start);
+  for(long i = 0; i < BENCH_RECORDS; i++)
+    sink += BENCH_FORMAT_LINE(snprintf, line, i);
+  bench_stop(&start, &total);
+
+  bench_report("BM_LibcSnprintf", &total, BENCH_RECORDS);
+}
+
+static void bench_str_buf(void)
+{
+  BenchTime_t total = {0};
+  BenchTime_t start;
+  StringBuffer sb;
+  uint8_t record[48];
+  void *entry;
+
+  memset(record, 'x', sizeof(record));
+  str_buf_init_custom_size(&sb, LOG_BUFFER_BYTES, LOG_MSG_BUFFER_SIZE);
+
+  bench_start(&start);
+  for(long i = 0; i < BENCH_RECORDS; i++)
+  {
+    str_buf_push_data(&sb, record, sizeof(record) - (i & 7));
+    str_buf_pop_data(&sb, &entry);
+  }
+  bench_stop(&start, &total);
+
+  str_buf_free(&sb);
+
+  bench_report("BM_StrBufPushPop", &total, BENCH_RECORDS);
+}
+
+static void bench_typed_ring(void)
+{
+  static bench_ring_t ring;
+  BenchTime_t total = {0};
+  BenchTime_t start;
+  BenchSample_t sample = {0};
+
+  bench_start(&start);
+  for(long i = 0; i < BENCH_RECORDS; i++)
+  {
+    sample.seq = i;
+    bench_ring_push(&ring, &sample);
+    bench_ring_pop(&ring, &sample);
+  }
+  bench_stop(&start, &total);
+
+  bench_report("BM_TypedRingPushPop", &total, BENCH_RECORDS);
+}
+
+int main(int argc, char **argv)
+{
+  loggingInit();
+  bench_drain();
+
+  if(argc > 1 && strcmp(argv[1], "capture") == 0)
+  {
+    bench_log_capture();
+    return 0;
+  }
+
+  printf("%-32s %13s %15s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+  printf("--------------------------------------------------------------------------------\n");
+
+  bench_log_isr_capture();
+  bench_log_render();
+  bench_format();
+  bench_str_buf();
+  bench_typed_ring();
+  // Last, the other formatting mode's capture follows
+  bench_log_capture();
+
+  return 0;
+}
@@ -0,0 +1,153 @@
+/*****************************************************************************
+* | File        : bench_stringbuffer.c
+* | Author      : Luke Mulder
+* | Function    : Host benchmark of the packed StringBuffer
+* | Info        :
+*   Compares the packed StringBuffer from Core/Src/stringbuffer.c with the
+*   previous design of fixed-size slots, using the same RAM for both: how
+*   many records of typical log length fit, and what a push/pop pair costs.
+*   Record lengths are drawn between MIN_RECORD and MAX_RECORD bytes, the
+*   log header included, which matches the lines we see on the target.
+*
+*   Built and run by "make -C Tests bench" after the logging benchmarks.
+*
+*   Timings are host numbers, only the ratio between the designs carries
+*   over to the Cortex-M7.
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "stringbuffer.h"
+
+// Same geometry as log_buffer in Core/Src/logging.c
+#define SLOT_COUNT 64
+#define SLOT_SIZE 128
+#define STORAGE_BYTES (SLOT_COUNT * SLOT_SIZE)
+
+#define MIN_RECORD 40
+#define MAX_RECORD 60
+
+#define ITERATIONS 10000000
+
+// The slot design as it was before the packed ring, one slot per entry
+typedef struct {
+  char buf[SLOT_COUNT][SLOT_SIZE];
+  size_t head;
+  size_t tail;
+  size_t count;
+} SlotBuffer;
+
+static int slot_push_data(SlotBuffer *sb, const void *data, size_t len)
+{
+  if(sb->count == SLOT_COUNT)
+    return STR_BUF_FULL;
+
+  memcpy(sb->buf[sb->head], data, len);
+  sb->head = (sb->head + 1) & (SLOT_COUNT - 1);
+  sb->count++;
+
+  return 0;
+}
+
+static int slot_pop(SlotBuffer *sb, char **data)
+{
+  if(sb->count == 0)
+  {
+    *data = NULL;
+    return 0;
+  }
+
+  *data = sb->buf[sb->tail];
+  sb->tail = (sb->tail + 1) & (SLOT_COUNT - 1);
+  sb->count--;
+
+  return 0;
+}
+
+// Small xorshift so both designs see the same length sequence
+static uint32_t bench_rand_state = 2463534242u;
+
+static size_t bench_record_len(void)
+{
+  bench_rand_state ^= bench_rand_state << 13;
+  bench_rand_state ^= bench_rand_state >> 17;
+  bench_rand_state ^= bench_rand_state << 5;
+
+  return MIN_RECORD + bench_rand_state % (MAX_RECORD - MIN_RECORD + 1);
+}
+
+static double bench_seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+  static SlotBuffer slots;
+  static uint8_t record[SLOT_SIZE];
+  StringBuffer packed;
+  size_t slot_capacity = 0;
+  size_t packed_capacity = 0;
+  volatile uintptr_t sink = 0;
+  double start, slot_ns, packed_ns;
+  char *out;
+
+  memset(record, 'x', sizeof(record));
+
+  if(str_buf_init_custom_size(&packed, STORAGE_BYTES, SLOT_SIZE) != 0 ||
+     str_buf_set_policy(&packed, STR_BUF_DROP_NEWEST) != 0)
+  {
+    fprintf(stderr, "str_buf_init_custom_size failed\n");
+    return 1;
+  }
+
+  // Capacity: fill both until the first push is refused
+  bench_rand_state = 2463534242u;
+  while(slot_push_data(&slots, record, bench_record_len()) == 0)
+    slot_capacity++;
+
+  bench_rand_state = 2463534242u;
+  while(str_buf_push_data(&packed, record, bench_record_len()) == 0)
+    packed_capacity++;
+
+  printf("%u bytes, records of %u to %u bytes\n", STORAGE_BYTES, MIN_RECORD, MAX_RECORD);
+  printf("  capacity   slots: %4zu records   packed: %4zu records (x%.2f)\n",
+         slot_capacity, packed_capacity, (double)packed_capacity / slot_capacity);
+
+  // Cost: steady state push/pop pairs with the buffers half full
+  while(slot_capacity-- > SLOT_COUNT / 2)
+    slot_pop(&slots, &out);
+  while(str_buff_count(&packed) > packed_capacity / 2)
+    str_buf_pop(&packed, &out);
+
+  bench_rand_state = 2463534242u;
+  start = bench_seconds();
+  for(long i = 0; i < ITERATIONS; i++)
+  {
+    slot_push_data(&slots, record, bench_record_len());
+    slot_pop(&slots, &out);
+    sink += (uintptr_t)out;
+  }
+  slot_ns = (bench_seconds() - start) * 1e9 / ITERATIONS;
+
+  bench_rand_state = 2463534242u;
+  start = bench_seconds();
+  for(long i = 0; i < ITERATIONS; i++)
+  {
+    str_buf_push_data(&packed, record, bench_record_len());
+    str_buf_pop(&packed, &out);
+    sink += (uintptr_t)out;
+  }
+  packed_ns = (bench_seconds() - start) * 1e9 / ITERATIONS;
+
+  printf("  push+pop   slots: %6.1f ns         packed: %6.1f ns\n", slot_ns, packed_ns);
+
+  str_buf_free(&packed);
+
+  return 0;
+}
@@ -0,0 +1,83 @@
+/*****************************************************************************
+* | File        : fuzz_driver.c
+* | Author      : Luke Mulder
+* | Function    : Stand-in for libFuzzer where clang is not available
+* | Info        :
+*   Calls LLVMFuzzerTestOneInput with inputs from a fixed seed random
+*   generator, so a run is repeatable and checks what the sanitizers catch
+*   without coverage guidance. Files given on the command line are replayed
+*   instead, e.g. a crash input saved by libFuzzer.
+*
+*   Usage: smoke_<target> [runs] | smoke_<target> file...
+******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#define FUZZ_MAX_INPUT 1024
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static uint32_t fuzz_rand_state = 2463534242u;
+
+static uint32_t fuzz_rand(void)
+{
+  fuzz_rand_state ^= fuzz_rand_state << 13;
+  fuzz_rand_state ^= fuzz_rand_state >> 17;
+  fuzz_rand_state ^= fuzz_rand_state << 5;
+
+  return fuzz_rand_state;
+}
+
+static int fuzz_replay(const char *path)
+{
+  static uint8_t input[FUZZ_MAX_INPUT];
+  FILE *file = fopen(path, "rb");
+  size_t size;
+
+  if(file == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+
+  size = fread(input, 1, sizeof(input), file);
+  fclose(file);
+
+  LLVMFuzzerTestOneInput(input, size);
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  static uint8_t input[FUZZ_MAX_INPUT];
+  long runs = 10000;
+
+  if(argc > 1 && !isdigit((unsigned char)argv[1][0]))
+  {
+    for(int i = 1; i < argc; i++)
+      if(fuzz_replay(argv[i]) != 0)
+        return 1;
+    return 0;
+  }
+
+  if(argc > 1)
+    runs = strtol(argv[1], NULL, 10);
+
+  for(long run = 0; run < runs; run++)
+  {
+    size_t size = fuzz_rand() % sizeof(input);
+
+    for(size_t i = 0; i < size; i++)
+      input[i] = (uint8_t)fuzz_rand();
+
+    LLVMFuzzerTestOneInput(input, size);
+  }
+
+  printf("%ld runs done\n", runs);
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+/*****************************************************************************
+* | File        : fuzz_format.c
+* | Author      : Luke Mulder
+* | Function    : Fuzz target of the deferred record renderer
+* | Info        :
+*   logTask trusts nothing but the record layout the capture writes: the
+*   format string comes from the call site and the argument words and
+*   string arena from the record. This target feeds
+*   log_parse_spec and log_render_args a fuzzed format and a fuzzed record
+*   with the same layout, the arena terminated as capture leaves it.
+*
+*   Format bytes are mapped onto the characters printf cares about, so
+*   random inputs reach the conversion parser instead of plain text.
+*   The first input byte picks the format length and the output size.
+******************************************************************************/
+
+#define SET_LOG_LEVEL_INFO
+#include "../Core/Src/logging.c"
+#include <ctype.h>
+
+static const char fuzz_format_chars[] = "%%%%-+ #0*.19hlLjztdiuoxXcfeEgGaApsn%ab";
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  static union {
+    LogRecord_t header;
+    uint8_t bytes[LOG_MSG_BUFFER_SIZE];
+  } record;
+  char format[64];
+  char out[LOG_LINE_BUFFER_SIZE];
+  size_t format_len;
+  size_t payload_len;
+  size_t out_size;
+  size_t len;
+
+  if(size < 1)
+    return 0;
+
+  format_len = (data[0] & 0x3F) % sizeof(format);
+  out_size = 1 + (data[0] >> 6) * (sizeof(out) / 4);
+  data++;
+  size--;
+
+  if(format_len > size)
+    format_len = size;
+
+  for(size_t i = 0; i < format_len; i++)
+    format[i] = fuzz_format_chars[data[i] % (sizeof(fuzz_format_chars) - 1)];
+  format[format_len] = '\0';
+
+  // Widths spelled out in the format are the firmware's own, only '*'
+  // widths come from the record. Keep them to two digits.
+  for(size_t i = 2; i < format_len; i++)
+    if(isdigit((unsigned char)format[i]) && isdigit((unsigned char)format[i - 1]) &&
+       isdigit((unsigned char)format[i - 2]))
+      return 0;
+
+  data += format_len;
+  size -= format_len;
+
+  // Payload: argument words, then a terminated string arena
+  payload_len = (size < LOG_RECORD_PAYLOAD_SIZE) ? size : LOG_RECORD_PAYLOAD_SIZE;
+  memset(&record, 0, sizeof(record));
+  memcpy(&record.header + 1, data, payload_len);
+
+  record.header.nwords = payload_len / sizeof(uint32_t);
+  if(record.header.nwords > LOG_MAX_ARG_WORDS)
+    record.header.nwords = LOG_MAX_ARG_WORDS;
+  record.header.len = payload_len;
+  if(payload_len > record.header.nwords * sizeof(uint32_t))
+    ((uint8_t*)(&record.header + 1))[payload_len - 1] = '\0';
+
+  len = log_render_args(out, out_size, format, &record.header);
+
+  if(len >= out_size || out[len] != '\0')
+    abort();
+
+  return 0;
+}
@@ -0,0 +1,265 @@
+/*****************************************************************************
+* | File        : fuzz_stringbuffer.c
+* | Author      : Luke Mulder
+* | Function    : Fuzz target of the packed StringBuffer
+* | Info        :
+*   The input picks the geometry and the overflow policy, then drives a
+*   sequence of pushes, reservations, pops, peeks, leases, releases and
+*   span leases.
+*   A shadow queue of the accepted entries is kept alongside, every entry
+*   read back must match it in order, length and content, lie inside the
+*   storage and the entry count must agree after each operation.
+*
+*   Built with libFuzzer (make fuzz) or with fuzz_driver.c (make fuzz-smoke).
+******************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stringbuffer.h"
+
+#define FUZZ_SHADOW_SIZE 1024
+
+typedef struct {
+  uint32_t seq;
+  size_t len;
+} FuzzEntry_t;
+
+static FuzzEntry_t shadow[FUZZ_SHADOW_SIZE];
+static size_t shadow_head;
+static size_t shadow_tail;
+// Shadow entries leased, always the oldest ones
+static size_t shadow_leased;
+
+static uint8_t fuzz_byte(uint32_t seq, size_t i)
+{
+  return (uint8_t)(seq * 7 + i);
+}
+
+// Aborts if entry does not hold the oldest unread shadow entry
+static void fuzz_check_entry(StringBuffer *sb, size_t index, const uint8_t *entry, size_t len)
+{
+  const FuzzEntry_t *expect;
+
+  if(index >= shadow_head - shadow_tail)
+    abort();
+
+  expect = &shadow[(shadow_tail + index) % FUZZ_SHADOW_SIZE];
+
+  if(len != expect->len)
+    abort();
+  if(entry < sb->buf || entry + len > sb->buf + sb->buf_size)
+    abort();
+
+  for(size_t i = 0; i < len; i++)
+    if(entry[i] != fuzz_byte(expect->seq, i))
+      abort();
+}
+
+// Walks the entries of a span, returns how many it holds
+static size_t fuzz_check_span(StringBuffer *sb, const StrBufSpan *span, size_t index)
+{
+  size_t offset = 0;
+  size_t n = 0;
+
+  if(span->len == 0)
+    return 0;
+  if(span->data < sb->buf || span->data + span->len > sb->buf + sb->buf_size)
+    abort();
+
+  while(offset < span->len)
+  {
+    uint32_t header;
+    size_t len;
+
+    memcpy(&header, span->data + offset, sizeof(header));
+    len = header & 0xFFFF;
+
+    // Spans hold entries only, never padding
+    if(header & 0x80000000u)
+      abort();
+    if(offset + STR_BUF_ENTRY_SIZE(len) > span->len)
+      abort();
+
+    fuzz_check_entry(sb, index + n, span->data + offset + STR_BUF_HEADER_SIZE, len);
+
+    offset += STR_BUF_ENTRY_SIZE(len);
+    n++;
+  }
+
+  return n;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  StringBuffer sb;
+  size_t buf_size;
+  size_t str_size;
+  uint32_t seq = 0;
+  uint8_t entry[STRING_BUFFER_MAX_LENGTH];
+
+  if(size < 2)
+    return 0;
+
+  buf_size = (size_t)64 << (data[0] & 3);
+  str_size = 1 + (data[0] >> 2);
+
+  if(str_buf_init_custom_size(&sb, buf_size, str_size) != 0)
+    return 0;
+  str_buf_set_policy(&sb, (StringBufferPolicy_e)(data[1] % 3));
+
+  shadow_head = 0;
+  shadow_tail = 0;
+  shadow_leased = 0;
+
+  for(size_t i = 2; i < size; i++)
+  {
+    uint8_t arg = (i + 1 < size) ? data[i + 1] : 0;
+    void *out;
+    size_t len;
+    int status;
+
+    switch(data[i] % 7)
+    {
+      case 0: // Push
+      {
+        len = arg % (str_size + 1);
+
+        for(size_t k = 0; k < len; k++)
+          entry[k] = fuzz_byte(seq, k);
+
+        status = str_buf_push_data(&sb, entry, len);
+
+        if(status == STR_BUF_OVERWROTE)
+        {
+          // Only unleased entries are ever overwritten
+          if(shadow_leased != 0)
+            abort();
+          while(shadow_head - shadow_tail >= sb.count)
+            shadow_tail++;
+        }
+        else if(status != 0 && status != STR_BUF_FULL)
+          abort();
+
+        if(status != STR_BUF_FULL)
+        {
+          shadow[shadow_head % FUZZ_SHADOW_SIZE].seq = seq;
+          shadow[shadow_head % FUZZ_SHADOW_SIZE].len = len;
+          shadow_head++;
+        }
+        seq++;
+        i++;
+        break;
+      }
+      case 6: // Reserve, then commit shorter or cancel
+      {
+        uint8_t *slot;
+        size_t count = sb.count;
+
+        len = arg % (str_size + 1);
+        slot = str_buf_reserve(&sb, len, &status);
+
+        if(slot == NULL)
+        {
+          if(status != STR_BUF_FULL)
+            abort();
+        }
+        else
+        {
+          if(status == STR_BUF_OVERWROTE)
+          {
+            if(shadow_leased != 0)
+              abort();
+            while(shadow_head - shadow_tail >= sb.count)
+              shadow_tail++;
+          }
+          else if(status != 0 || sb.count != count + 1)
+            abort();
+
+          if(data[i] & 0x80)
+          {
+            if(str_buf_cancel(&sb, slot) != 0)
+              abort();
+          }
+          else
+          {
+            len = (len + (data[i] & 1)) / 2;
+            for(size_t k = 0; k < len; k++)
+              slot[k] = fuzz_byte(seq, k);
+            if(str_buf_commit(&sb, slot, len) != 0)
+              abort();
+
+            shadow[shadow_head % FUZZ_SHADOW_SIZE].seq = seq;
+            shadow[shadow_head % FUZZ_SHADOW_SIZE].len = len;
+            shadow_head++;
+          }
+        }
+        seq++;
+        i++;
+        break;
+      }
+      case 1: // Pop
+        if(shadow_leased != 0)
+          break;
+        len = str_buf_pop_data(&sb, &out);
+        if(shadow_head == shadow_tail)
+        {
+          if(out != NULL || len != 0)
+            abort();
+          break;
+        }
+        fuzz_check_entry(&sb, 0, out, len);
+        shadow_tail++;
+        break;
+      case 2: // Peek
+        if(shadow_leased != 0 || shadow_head == shadow_tail)
+          break;
+        len = str_buf_peek_data(&sb, &out);
+        fuzz_check_entry(&sb, 0, out, len);
+        break;
+      case 3: // Lease
+        len = str_buf_lease(&sb, &out);
+        if(shadow_leased == shadow_head - shadow_tail)
+        {
+          if(out != NULL || len != 0)
+            abort();
+          break;
+        }
+        fuzz_check_entry(&sb, shadow_leased, out, len);
+        shadow_leased++;
+        break;
+      case 4: // Release
+        len = arg % (shadow_leased + 1);
+        if(str_buf_release(&sb, len) != 0)
+          abort();
+        shadow_tail += len;
+        shadow_leased -= len;
+        i++;
+        break;
+      case 5: // Span lease
+      {
+        StrBufSpan spans[2];
+        size_t n = str_buf_lease_spans(&sb, spans);
+        size_t found;
+
+        if(n != shadow_head - shadow_tail - shadow_leased)
+          abort();
+
+        found = fuzz_check_span(&sb, &spans[0], shadow_leased);
+        found += fuzz_check_span(&sb, &spans[1], shadow_leased + found);
+        if(found != n)
+          abort();
+
+        shadow_leased += n;
+        break;
+      }
+    }
+
+    if(str_buff_count(&sb) != shadow_head - shadow_tail)
+      abort();
+  }
+
+  str_buf_free(&sb);
+
+  return 0;
+}
@@ -0,0 +1,33 @@
+/*****************************************************************************
+* | File        : FreeRTOS.h
+* | Author      : Luke Mulder
+* | Function    : Host stand-in for the FreeRTOS kernel
+* | Info        :
+*   Single threaded stand-in for the kernel calls made by logging.c. Tasks
+*   are never switched: semaphores and notifications only keep counts,
+*   critical sections do nothing and timeouts expire at once. This is
+*   enough to drive the logger's capture and render paths from one thread.
+******************************************************************************/
+#ifndef STUB_FREERTOS_H
+#define STUB_FREERTOS_H
+
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE  ((BaseType_t)1)
+#define pdPASS  pdTRUE
+
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFu)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+#define configMINIMAL_STACK_SIZE ((uint16_t)128)
+
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+#endif // STUB_FREERTOS_H
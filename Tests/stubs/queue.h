@@ -0,0 +1,11 @@
+/*****************************************************************************
+* | File        : queue.h
+* | Author      : Luke Mulder
+* | Function    : Host stand-in for the FreeRTOS queue API, see FreeRTOS.h
+******************************************************************************/
+#ifndef STUB_QUEUE_H
+#define STUB_QUEUE_H
+
+#include "FreeRTOS.h"
+
+#endif // STUB_QUEUE_H
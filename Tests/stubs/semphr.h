@@ -0,0 +1,25 @@
+/*****************************************************************************
+* | File        : semphr.h
+* | Author      : Luke Mulder
+* | Function    : Host stand-in for the FreeRTOS semaphore API, see FreeRTOS.h
+******************************************************************************/
+#ifndef STUB_SEMPHR_H
+#define STUB_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+typedef struct {
+  UBaseType_t count;
+  uint32_t takes;     // xSemaphoreTake calls, the tests read and clear it
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t* SemaphoreHandle_t;
+typedef SemaphoreHandle_t xSemaphoreHandle;
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer);
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken);
+
+#endif // STUB_SEMPHR_H
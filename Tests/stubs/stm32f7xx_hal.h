@@ -0,0 +1,98 @@
+/*****************************************************************************
+* | File        : stm32f7xx_hal.h
+* | Author      : Luke Mulder
+* | Function    : Host stand-in for the STM32F7 HAL
+* | Info        :
+*   Provides just the HAL, CMSIS and core register definitions used by
+*   logging.c so it builds on the host. DWT->CYCCNT is plain memory the
+*   tests advance by hand, UART transmissions are appended to
+*   stub_uart_output.
+******************************************************************************/
+#ifndef STUB_STM32F7XX_HAL_H
+#define STUB_STM32F7XX_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+  HAL_OK = 0,
+  HAL_ERROR,
+  HAL_BUSY,
+  HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+typedef struct {
+  struct {
+    uint32_t BaudRate;
+  } Init;
+  uint32_t gState;      // HAL_UART_STATE_BUSY_TX while a transmission runs
+  uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+#define HAL_UART_STATE_READY   0x00000020U
+#define HAL_UART_STATE_BUSY_TX 0x00000021U
+
+#define HAL_UART_ERROR_NONE 0x00000000U
+#define HAL_UART_ERROR_PE   0x00000001U
+#define HAL_UART_ERROR_NE   0x00000002U
+#define HAL_UART_ERROR_FE   0x00000004U
+#define HAL_UART_ERROR_ORE  0x00000008U
+#define HAL_UART_ERROR_DMA  0x00000010U
+
+typedef struct {
+  uint32_t CTRL;
+  uint32_t CYCCNT;
+  uint32_t LAR;
+} StubDWT_Type;
+
+typedef struct {
+  uint32_t DEMCR;
+} StubCoreDebug_Type;
+
+typedef struct {
+  uint32_t CCR;
+} StubSCB_Type;
+
+extern StubDWT_Type stub_dwt;
+extern StubCoreDebug_Type stub_core_debug;
+extern StubSCB_Type stub_scb;
+
+#define DWT (&stub_dwt)
+#define CoreDebug (&stub_core_debug)
+#define SCB (&stub_scb)
+
+#define DWT_CTRL_CYCCNTENA_Msk 0x00000001u
+#define CoreDebug_DEMCR_TRCENA_Msk 0x01000000u
+#define SCB_CCR_DC_Msk 0x00010000u
+
+extern uint32_t SystemCoreClock;
+
+// Everything sent over the UART, for the tests to compare
+extern char stub_uart_output[];
+extern size_t stub_uart_output_len;
+void stub_uart_reset(void);
+// Set to keep DMA transfers running until stub_uart_dma_complete
+extern uint8_t stub_uart_dma_hold;
+void stub_uart_dma_complete(UART_HandleTypeDef *huart);
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+static inline void SCB_CleanDCache_by_Addr(uint32_t *addr, int32_t size)
+{
+  (void)addr;
+  (void)size;
+}
+
+static inline void SCB_InvalidateDCache_by_Addr(uint32_t *addr, int32_t size)
+{
+  (void)addr;
+  (void)size;
+}
+
+#define assert_param(expr) ((expr) ? (void)0 : stub_assert_failed(__FILE__, __LINE__))
+void stub_assert_failed(const char *file, int line);
+
+#endif // STUB_STM32F7XX_HAL_H
@@ -0,0 +1,208 @@
+/*****************************************************************************
+* | File        : stubs.c
+* | Author      : Luke Mulder
+* | Function    : Host stand-ins for the HAL and FreeRTOS calls of logging.c
+* | Info        :
+*   Everything runs on the calling thread. A DMA transfer completes inside
+*   HAL_UART_Transmit_DMA unless stub_uart_dma_hold is set, a semaphore
+*   take never waits and a timeout has always expired, so no test can hang
+*   on the kernel.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f7xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#define STUB_UART_OUTPUT_SIZE (64 * 1024)
+
+StubDWT_Type stub_dwt;
+StubCoreDebug_Type stub_core_debug;
+StubSCB_Type stub_scb;
+
+uint32_t SystemCoreClock = 216000000;
+
+UART_HandleTypeDef huart1 = { .Init.BaudRate = 115200, .gState = HAL_UART_STATE_READY };
+
+char stub_uart_output[STUB_UART_OUTPUT_SIZE];
+size_t stub_uart_output_len;
+
+uint8_t stub_uart_dma_hold;
+
+uint32_t stub_task_notified;
+UBaseType_t stub_task_stack_free;
+
+// Completion callback, weak like the HAL's so logging.c can override it
+__attribute__((weak)) void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  (void)huart;
+}
+
+void stub_assert_failed(const char *file, int line)
+{
+  fprintf(stderr, "assert_param failed at %s:%d\n", file, line);
+  abort();
+}
+
+void stub_uart_reset(void)
+{
+  stub_uart_output_len = 0;
+  stub_uart_output[0] = '\0';
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+  (void)timeout;
+
+  // Keep the newest output if the tests let it grow
+  if(stub_uart_output_len + size >= STUB_UART_OUTPUT_SIZE)
+    stub_uart_reset();
+
+  memcpy(stub_uart_output + stub_uart_output_len, data, size);
+  stub_uart_output_len += size;
+  stub_uart_output[stub_uart_output_len] = '\0';
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size)
+{
+  if(huart->gState == HAL_UART_STATE_BUSY_TX)
+    return HAL_BUSY;
+
+  HAL_UART_Transmit(huart, data, size, 0);
+  huart->gState = HAL_UART_STATE_BUSY_TX;
+
+  if(!stub_uart_dma_hold)
+    stub_uart_dma_complete(huart);
+
+  return HAL_OK;
+}
+
+// Ends a transfer the way the HAL does once the last byte left
+void stub_uart_dma_complete(UART_HandleTypeDef *huart)
+{
+  huart->gState = HAL_UART_STATE_READY;
+  HAL_UART_TxCpltCallback(huart);
+}
+
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart)
+{
+  huart->gState = HAL_UART_STATE_READY;
+
+  return HAL_OK;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  return &stub_task_notified;
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+  // Blocking callers give up at once, nobody would drain for them
+  return taskSCHEDULER_NOT_STARTED;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  (void)task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+  (void)task;
+
+  return stub_task_stack_free;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+  (void)task;
+  (void)action;
+
+  stub_task_notified |= value;
+
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+  *woken = pdFALSE;
+
+  return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t timeout)
+{
+  (void)clear_on_entry;
+  (void)timeout;
+
+  if(stub_task_notified == 0)
+    return pdFALSE;
+
+  if(value != NULL)
+    *value = stub_task_notified;
+  stub_task_notified &= ~clear_on_exit;
+
+  return pdTRUE;
+}
+
+void vTaskSetTimeOutState(TimeOut_t *timeout)
+{
+  timeout->entered = 0;
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *timeout, TickType_t *remaining)
+{
+  (void)timeout;
+
+  *remaining = 0;
+
+  return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+  buffer->count = 1;
+
+  return buffer;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+  buffer->count = 0;
+
+  return buffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t timeout)
+{
+  (void)timeout;
+
+  sem->takes++;
+
+  if(sem->count == 0)
+    return pdFALSE;
+
+  sem->count--;
+
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  sem->count = 1;
+
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+  *woken = pdFALSE;
+
+  return xSemaphoreGive(sem);
+}
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""
+test_logdecode.py - Tools/logdecode.py against frames encoded by logwire.c
+
+Runs wire_frames, which encodes a set of records with the firmware's
+encoder and writes the lines the target would print for them, then
+decodes the frames and compares line by line. The call sites are built
+here instead of read from an ELF, each one with the level NONE so the
+level printed can only come from the frame.
+
+Usage:
+    python3 test_logdecode.py build/wire_frames
+"""
+
+import io
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Tools"))
+import logdecode  # noqa: E402
+
+WIRE_FRAMES = None
+
+
+class DecodeTest(unittest.TestCase):
+    def setUp(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            frames_path = os.path.join(tmp, "frames.bin")
+            expected_path = os.path.join(tmp, "expected.txt")
+            subprocess.run([WIRE_FRAMES, frames_path, expected_path], check=True)
+            with open(frames_path, "rb") as f:
+                self.frames = f.read()
+            with open(expected_path) as f:
+                entries = [line.rstrip("\n").split("\t") for line in f]
+
+        self.sites = [{"file": "wire_frames.c", "func": "main", "format": fmt, "line": int(site_id),
+                       "level": "NONE"} for site_id, fmt, _ in entries]
+        self.expected = [line for _, _, line in entries]
+
+    def decode(self, data):
+        out = io.StringIO()
+        logdecode.decode_stream(io.BytesIO(data), self.sites, out, logdecode.DEFAULT_CLOCK_HZ)
+        return out.getvalue().splitlines()
+
+    def test_lines_match_the_target_output(self):
+        decoded = self.decode(self.frames)
+
+        self.assertEqual(len(decoded), len(self.expected))
+        for got, want in zip(decoded, self.expected):
+            self.assertEqual(got, want)
+
+    def test_stream_joined_late_waits_for_the_absolute_time(self):
+        # Garbage first, the decoder resynchronises on the next frame
+        decoded = self.decode(b"\x00\x13" + self.frames[3:])
+
+        self.assertTrue(decoded[0].startswith("[?] "))
+        self.assertEqual(decoded[-1], self.expected[-1])
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.stderr.write(__doc__)
+        sys.exit(2)
+    WIRE_FRAMES = os.path.abspath(sys.argv.pop(1))
+    unittest.main()
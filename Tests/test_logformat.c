@@ -0,0 +1,240 @@
+/*****************************************************************************
+* | File        : test_logformat.c
+* | Author      : Luke Mulder
+* | Function    : Differential tests of the log formatter
+* | Info        :
+*   Everything inside the subset logformat.h supports is checked against
+*   glibc's vsnprintf: output and return value, in a roomy buffer and in
+*   one that cuts the output short. Hand picked edge cases come first,
+*   then seeded random integers and doubles below 2^64. The documented
+*   differences to the C library are checked on their own.
+******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include "logformat.h"
+#include "unittest.h"
+
+#define RANDOM_RUNS 20000
+
+// Mismatches printed in full before the rest are only counted
+#define MISMATCH_PRINT_MAX 10
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+static int mismatches;
+
+static uint64_t random_next(void)
+{
+  // xorshift64*
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+
+  return random_state * 0x2545F4914F6CDD1Dull;
+}
+
+__attribute__((format(printf, 2, 3)))
+static void check_same(int line, const char *format, ...)
+{
+  char expect[512];
+  char got[512];
+  char expect_short[6];
+  char got_short[6];
+  int expect_len;
+  int got_len;
+  va_list args;
+
+  va_start(args, format);
+  expect_len = vsnprintf(expect, sizeof(expect), format, args);
+  va_end(args);
+  va_start(args, format);
+  got_len = log_vsnprintf(got, sizeof(got), format, args);
+  va_end(args);
+
+  va_start(args, format);
+  vsnprintf(expect_short, sizeof(expect_short), format, args);
+  va_end(args);
+  memset(got_short, 0x55, sizeof(got_short));
+  va_start(args, format);
+  log_vsnprintf(got_short, sizeof(got_short), format, args);
+  va_end(args);
+
+  if(got_len != expect_len || strcmp(got, expect) != 0 || strcmp(got_short, expect_short) != 0)
+  {
+    if(mismatches++ < MISMATCH_PRINT_MAX)
+      printf("  %s:%d: \"%s\": expected \"%s\" (%d), got \"%s\" (%d), cut \"%s\" vs \"%s\"\n",
+             __FILE__, line, format, expect, expect_len, got, got_len, expect_short, got_short);
+    unittest_failures++;
+    unittest_test_failed = 1;
+  }
+}
+
+#define CHECK_SAME(...) check_same(__LINE__, __VA_ARGS__)
+
+static void test_integers(void)
+{
+  const int values[] = { INT_MIN, -1000, -1, 0, 1, 7, 42, 99, 100, 65535, INT_MAX };
+
+  for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+  {
+    int v = values[i];
+    CHECK_SAME("%d %i %u", v, v, (unsigned)v);
+    // Including the flags that are ignored next to another, which gcc warns about
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+    CHECK_SAME("[%5d] [%-5d] [%05d] [%+d] [% d] [%+ d]", v, v, v, v, v, v);
+    CHECK_SAME("[%.3d] [%.0d] [%8.3d] [%-+8.3d] [%08.3d]", v, v, v, v, v);
+#pragma GCC diagnostic pop
+    CHECK_SAME("%x %X %#x %#X %08x %#010x %-#10x|", v, v, v, v, v, v, v);
+    CHECK_SAME("%o %#o %#.0o %.0x %#.3o %5o", v, v, v, v, v, v);
+    CHECK_SAME("%hhd %hd %hhu %hu %hhx", v, v, v, v, v);
+  }
+
+  CHECK_SAME("%ld %lu %lx", LONG_MIN, ULONG_MAX, LONG_MAX);
+  CHECK_SAME("%lld %llu %llx %#llo", LLONG_MIN, ULLONG_MAX, 0x123456789ABCDEFull, ULLONG_MAX);
+  CHECK_SAME("%jd %zu %zd %td", INTMAX_MIN, (size_t)SIZE_MAX, (ssize_t)-5, (ptrdiff_t)-123456789);
+  CHECK_SAME("%lld %llu", 4294967296ll, 10000000000000000000ull);
+  CHECK_SAME("%20lld|%-20llu|%020lld", -1234567890123ll, 999999999999999999ull, -1ll);
+}
+
+static void test_stars(void)
+{
+  CHECK_SAME("[%*d] [%*d] [%-*d]", 6, 42, -6, 42, 3, 42);
+  CHECK_SAME("[%.*d] [%.*d] [%*.*d]", 4, 42, -1, 42, 8, 5, -42);
+  CHECK_SAME("[%.*s] [%*s]", 2, "abcdef", -4, "ab");
+  CHECK_SAME("[%*.*f]", 10, 3, 3.14159);
+}
+
+static void test_strings_and_chars(void)
+{
+  CHECK_SAME("%s|%10s|%-10s|%.2s|%10.2s|%.0s|", "hello", "hello", "hello", "hello", "hello", "hello");
+  CHECK_SAME("%s%s", "", "x");
+  CHECK_SAME("%c|%3c|%-3c|%c", 'a', 'b', 'c', 0x141);
+  CHECK_SAME("100%% done, %d%%", 5);
+  CHECK_SAME("plain text without conversions");
+  CHECK_SAME("%s", "a string longer than the short buffer");
+}
+
+static void test_pointers(void)
+{
+  CHECK_SAME("%p %20p %-20p|", (void*)0x1234, (void*)0x20001000, (void*)(uintptr_t)UINTPTR_MAX);
+}
+
+static void test_floats(void)
+{
+  const double values[] = { 0.0, -0.0, 1.0, -1.5, 0.5, 1.5, 2.5, 0.125, 0.375, 3.14159, 1e-10, 1e-300,
+                            DBL_MIN, DBL_TRUE_MIN, 0.1, 0.7, 0.9999999999, 9.5, 99.995, 123456789.987654321,
+                            4294967296.5, 1e15, 9007199254740993.0, 1.8e19, 18446744073709549568.0 };
+
+  for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+  {
+    double v = values[i];
+    CHECK_SAME("%f %F %.0f %.1f %.2f %.3f %.9f", v, v, v, v, v, v, v);
+    CHECK_SAME("[%12.4f] [%-12.4f] [%012.4f] [%+.2f] [% .2f] [%#.0f] [%+08.3f]", v, v, v, v, v, v, v);
+  }
+
+  CHECK_SAME("%f %F %5f %-5f| %+f %f", INFINITY, INFINITY, INFINITY, -INFINITY, INFINITY, -INFINITY);
+  CHECK_SAME("%f %F %5f %010f", NAN, NAN, NAN, NAN);
+  CHECK_SAME("%Lf %.2Lf", 2.5L, -0.125L);
+  CHECK_SAME("value %d %s %u %5.2f %c", -5, "abc", 7u, 3.14159, 'x');
+}
+
+static void test_random_integers(void)
+{
+  for(int i = 0; i < RANDOM_RUNS; i++)
+  {
+    // Every magnitude, not just huge values
+    uint64_t v = random_next() >> (random_next() % 64);
+    int width = random_next() % 24;
+    int precision = (int)(random_next() % 24) - 1;
+
+    CHECK_SAME("%d %u %x %o %lld %llu %llX", (int)v, (unsigned)v, (unsigned)v, (unsigned)v,
+               (long long)v, (unsigned long long)v, (unsigned long long)v);
+    CHECK_SAME("[%*.*lld] [%-*.*llu] [%0*lld] [%#0*llx] [%+*d]", width, precision, (long long)v,
+               width, precision, (unsigned long long)v, width, (long long)v, width,
+               (unsigned long long)v, width, (int)v);
+  }
+}
+
+static void test_random_floats(void)
+{
+  int runs = 0;
+
+  while(runs < RANDOM_RUNS)
+  {
+    uint64_t bits = random_next();
+    int width = random_next() % 30;
+    int precision = random_next() % (LOG_FMT_FLOAT_DIGITS + 1);
+    double v;
+
+    // Half of the values from the range logs print, the rest from all
+    // exponents
+    if(runs & 1)
+      bits = (bits & 0x800FFFFFFFFFFFFFull) | ((uint64_t)(1023 - 40 + random_next() % 70) << 52);
+    memcpy(&v, &bits, sizeof(v));
+    if(isnan(v) || fabs(v) >= 18446744073709551616.0)
+      continue;
+
+    CHECK_SAME("%.*f", precision, v);
+    CHECK_SAME("[%*.*f] [%-+*.*f] [%0*.*f]", width, precision, v, width, precision, v, width, precision, v);
+    runs++;
+  }
+}
+
+static void test_truncation(void)
+{
+  char buf[8];
+
+  memset(buf, 'x', sizeof(buf));
+  CHECK(log_snprintf(buf, sizeof(buf), "value %d", 123456) == 12);
+  CHECK(strcmp(buf, "value 1") == 0);
+
+  CHECK(log_snprintf(NULL, 0, "%s %d", "abc", 42) == 6);
+
+  // Padding past the end is only counted
+  CHECK(log_snprintf(buf, sizeof(buf), "%*d", 100000000, 1) == 100000000);
+  CHECK(strcmp(buf, "       ") == 0);
+
+  CHECK(log_snprintf(buf, 1, "abc") == 3 && buf[0] == '\0');
+}
+
+static void test_documented_differences(void)
+{
+  char buf[64];
+  int count = -1;
+
+  log_snprintf(buf, sizeof(buf), "%p", NULL);
+  CHECK(strcmp(buf, "0x0") == 0);
+
+  log_snprintf(buf, sizeof(buf), "%e %g %.1a", 2.5, 2.5, 2.5);
+  CHECK(strcmp(buf, "2.500000 2.500000 2.5") == 0);
+
+  // Precision past LOG_FMT_FLOAT_DIGITS is padded with zeros
+  log_snprintf(buf, sizeof(buf), "%.12f", 0.1);
+  CHECK(strcmp(buf, "0.100000000000") == 0);
+
+  log_snprintf(buf, sizeof(buf), "%.0f", 1e30);
+  CHECK(strlen(buf) == 31 && strncmp(buf, "1000000000000000", 16) == 0);
+
+  log_snprintf(buf, sizeof(buf), "%d%n", 5, &count);
+  CHECK(strcmp(buf, "5") == 0 && count == -1);
+}
+
+int main(void)
+{
+  RUN_TEST(test_integers);
+  RUN_TEST(test_stars);
+  RUN_TEST(test_strings_and_chars);
+  RUN_TEST(test_pointers);
+  RUN_TEST(test_floats);
+  RUN_TEST(test_random_integers);
+  RUN_TEST(test_random_floats);
+  RUN_TEST(test_truncation);
+  RUN_TEST(test_documented_differences);
+
+  return unittest_result();
+}
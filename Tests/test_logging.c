@@ -0,0 +1,703 @@
+/*****************************************************************************
+* | File        : test_logging.c
+* | Author      : Luke Mulder
+* | Function    : Unit tests of the logger's capture and render paths
+* | Info        :
+*   logging.c is included directly so the tests can drain the queues the
+*   way logTask does without running its endless loop. The core clock is
+*   the stub DWT->CYCCNT, advanced by hand to step over rate limits and
+*   report intervals. Everything logTask sends ends up in
+*   stub_uart_output.
+******************************************************************************/
+
+#define SET_LOG_LEVEL_INFO
+#include "../Core/Src/logging.c"
+#include "unittest.h"
+
+#define CYCLES_PER_MS (216000000u / 1000)
+
+// Spacing that keeps repeated calls of one site under its rate limit
+#if LOG_RATE_LIMIT_PER_SEC
+  #define PACE_MS (1000 / LOG_RATE_LIMIT_PER_SEC)
+#else
+  #define PACE_MS 1
+#endif
+
+// Most tests read the text lines the UART sink sends. Configurations
+// without them only run the tests that bring their own sink.
+#define TEST_UART_TEXT (LOG_OUTPUT_UART && !LOG_WIRE_BINARY)
+
+static void advance_ms(uint32_t ms)
+{
+  // Small steps so every CYCCNT wrap is seen
+  while(ms > 1000)
+  {
+    DWT->CYCCNT += 1000 * CYCLES_PER_MS;
+    log_timestamp();
+    ms -= 1000;
+  }
+  DWT->CYCCNT += ms * CYCLES_PER_MS;
+}
+
+// Sends everything queued, one batch after the other like logTask
+static void drain(void)
+{
+  while(log_pump())
+    ;
+}
+
+// Output of a sink a test adds next to the UART
+typedef struct {
+  char out[16 * 1024];
+  size_t len;
+  uint32_t writes;
+  uint8_t stuck;      // Writes stay in progress until cleared
+  uint8_t busy;
+} TestSink_t;
+
+static int test_sink_write(LogSink *sink, const uint8_t *data, size_t len)
+{
+  TestSink_t *test = sink->ctx;
+
+  if(test->len + len < sizeof(test->out))
+  {
+    memcpy(test->out + test->len, data, len);
+    test->len += len;
+    test->out[test->len] = '\0';
+  }
+  test->writes++;
+  test->busy = test->stuck;
+
+  return 0;
+}
+
+static int test_sink_flush(LogSink *sink, uint32_t timeout_ms)
+{
+  TestSink_t *test = sink->ctx;
+
+  test->busy = test->stuck;
+
+  return test->busy;
+}
+
+// Starts a test with an empty output and no report pending
+static void fresh_output(void)
+{
+  advance_ms(LOG_REPORT_INTERVAL_MS + 1);
+  drain();
+  stub_uart_reset();
+}
+
+static void test_text_sink_gets_the_records(void)
+{
+  static TestSink_t text_out;
+  static uint8_t text_buf[LOG_TX_BATCH_SIZE];
+  static LogSink text = { .name = "text", .level = LOG_LEVEL_INFO, .encoding = LOG_SINK_TEXT,
+                          .write = test_sink_write, .flush = test_sink_flush, .ctx = &text_out,
+                          .buf = text_buf, .buf_size = sizeof(text_buf) };
+
+  fresh_output();
+  CHECK(loggingAddSink(&text) == 0);
+
+  LOG_INFO("to every sink %d", 1);
+  advance_ms(1);
+  LOG_WARNING_FROM_ISR("from an interrupt %u", 2);
+  drain();
+
+  CHECK_STR_CONTAINS(text_out.out, "[INFO] ");
+  CHECK_STR_CONTAINS(text_out.out, "to every sink 1\r\n");
+  CHECK_STR_CONTAINS(text_out.out, "[WARNING] ");
+  CHECK_STR_CONTAINS(text_out.out, "from an interrupt 2\r\n");
+
+  text.level = LOG_LEVEL_NONE;
+}
+
+#if TEST_UART_TEXT
+static void test_deferred_arguments_are_rendered(void)
+{
+  fresh_output();
+
+  LOG_INFO("value %d %s %u %5.2f %c", -5, "abc", 7u, 3.14159, 'x');
+  LOG_WARNING("no arguments");
+  // Strings ahead of later words, the arena starts behind the last one
+  LOG_INFO("%s=%*d %s %lld", "key", 4, 9, "end", -3ll);
+  drain();
+
+  CHECK_STR_CONTAINS(stub_uart_output, "[INFO] ");
+  CHECK_STR_CONTAINS(stub_uart_output, "value -5 abc 7  3.14 x\r\n");
+  CHECK_STR_CONTAINS(stub_uart_output, "[WARNING] ");
+  CHECK_STR_CONTAINS(stub_uart_output, "test_deferred_arguments_are_rendered() - no arguments\r\n");
+  CHECK_STR_CONTAINS(stub_uart_output, "key=   9 end -3\r\n");
+}
+
+static void test_long_strings_are_truncated(void)
+{
+  char longer[300];
+
+  fresh_output();
+
+  memset(longer, 'a', sizeof(longer) - 1);
+  longer[sizeof(longer) - 1] = '\0';
+
+  LOG_INFO("%s|%d", longer, 42);
+  drain();
+
+  // The line stays terminated and within LOG_LINE_BUFFER_SIZE
+  CHECK_STR_CONTAINS(stub_uart_output, "aaaa");
+  CHECK(stub_uart_output_len <= LOG_LINE_BUFFER_SIZE);
+  CHECK(stub_uart_output_len >= 2 && strcmp(stub_uart_output + stub_uart_output_len - 2, "\r\n") == 0);
+}
+
+static void test_isr_records_are_merged_by_time(void)
+{
+  char *first;
+  char *second;
+  char *third;
+
+  fresh_output();
+
+  LOG_INFO("task first");
+  advance_ms(1);
+  LOG_INFO_FROM_ISR("isr second %u", 2);
+  advance_ms(1);
+  LOG_INFO("task third");
+  drain();
+
+  first = strstr(stub_uart_output, "task first");
+  second = strstr(stub_uart_output, "isr second 2");
+  third = strstr(stub_uart_output, "task third");
+
+  CHECK(first != NULL && second != NULL && third != NULL);
+  CHECK(first < second && second < third);
+}
+
+#if !LOG_USE_LOCKFREE_RING
+static void test_drain_locks_only_to_swap(void)
+{
+  LogRecord_t *rec;
+  char line[LOG_LINE_BUFFER_SIZE];
+  char *last;
+  char *after;
+
+  fresh_output();
+
+  for(uint32_t i = 0; i < 8; i++)
+  {
+    LOG_INFO("before swap %u", i);
+    advance_ms(PACE_MS);
+  }
+
+  // Taking the first record swaps the producer side over to logTask
+  logMutex->takes = 0;
+  CHECK(log_next() == 1);
+  CHECK(logMutex->takes == 1);
+  CHECK(log_sink_ring_peek(&log_sink_ring, &log_uart_sink, (void**)&rec) > 0);
+  log_render(rec, line, sizeof(line));
+  CHECK_STR_CONTAINS(line, "before swap 0\r\n");
+
+  // Logged into the other side while logTask is still draining
+  LOG_INFO("after swap");
+
+  // Seven records and a swap, but the lock is only taken to swap, not
+  // again once nothing is queued
+  logMutex->takes = 0;
+  drain();
+  CHECK(logMutex->takes <= 3);
+
+  last = strstr(stub_uart_output, "before swap 7\r\n");
+  after = strstr(stub_uart_output, "after swap\r\n");
+  CHECK(last != NULL && after != NULL && last < after);
+}
+
+static void test_isr_records_drain_without_the_lock(void)
+{
+  fresh_output();
+
+  for(uint32_t i = 0; i < 4; i++)
+  {
+    LOG_INFO_FROM_ISR("isr only %u", i);
+    advance_ms(PACE_MS);
+  }
+
+  // Nothing on the producer side to swap in, logMutex is left alone
+  logMutex->takes = 0;
+  drain();
+  CHECK(logMutex->takes == 0);
+  CHECK_STR_CONTAINS(stub_uart_output, "isr only 3\r\n");
+}
+#endif
+
+#if LOG_RATE_LIMIT_PER_SEC
+static void test_rate_limit_is_reported(void)
+{
+  LogStats_t stats;
+  uint32_t suppressed;
+
+  fresh_output();
+  loggingGetStats(&stats);
+  suppressed = stats.suppressed;
+
+  for(int i = 0; i < LOG_RATE_LIMIT_BURST + 5; i++)
+    LOG_INFO("burst %d", i);
+
+  drain();
+  CHECK_STR_CONTAINS(stub_uart_output, "burst 9\r\n");
+  CHECK(strstr(stub_uart_output, "burst 10\r\n") == NULL);
+
+  // Reported once the interval is over
+  advance_ms(LOG_REPORT_INTERVAL_MS + 1);
+  drain();
+  CHECK_STR_CONTAINS(stub_uart_output, "5 messages rate limited");
+
+  loggingGetStats(&stats);
+  CHECK(stats.suppressed - suppressed == 5);
+}
+#endif
+
+#if LOG_SUPPRESS_DUPLICATES
+static void test_duplicates_are_collapsed(void)
+{
+  fresh_output();
+
+  for(int i = 0; i < 5; i++)
+  {
+    LOG_INFO("same %d", 1);
+    advance_ms(100);
+  }
+  drain();
+
+  CHECK_STR_CONTAINS(stub_uart_output, "same 1\r\n");
+
+  advance_ms(LOG_REPORT_INTERVAL_MS + 1);
+  drain();
+  CHECK_STR_CONTAINS(stub_uart_output, "last message repeated 4 times");
+
+  // Other arguments are a new message
+  LOG_INFO("same %d", 2);
+  LOG_INFO("same %d", 2);
+  drain();
+  CHECK_STR_CONTAINS(stub_uart_output, "same 2\r\n");
+}
+#else
+static void test_repeats_are_logged(void)
+{
+  const char *line = stub_uart_output;
+  int lines = 0;
+
+  fresh_output();
+
+  // The demo's heartbeat, faster than LOG_REPORT_INTERVAL_MS
+  for(int i = 0; i < 3; i++)
+  {
+    LOG_INFO("Hello World!");
+    advance_ms(300);
+  }
+  drain();
+
+  while((line = strstr(line, "Hello World!\r\n")) != NULL)
+  {
+    lines++;
+    line++;
+  }
+  CHECK(lines == 3);
+}
+#endif
+
+static void test_isr_overflow_is_reported(void)
+{
+  LogStats_t stats;
+  uint32_t lost;
+
+  fresh_output();
+  loggingGetStats(&stats);
+  lost = stats.lost;
+
+  // Paced below the rate limit, distinct so nothing is collapsed
+  for(uint32_t i = 0; i < LOG_ISR_BUFFER_SIZE + 8; i++)
+  {
+    LOG_INFO_FROM_ISR("isr %u", i);
+    advance_ms(PACE_MS);
+  }
+
+  advance_ms(LOG_REPORT_INTERVAL_MS + 1);
+  drain();
+
+  CHECK_STR_CONTAINS(stub_uart_output, "isr 31\r\n");
+  CHECK(strstr(stub_uart_output, "isr 32\r\n") == NULL);
+  CHECK_STR_CONTAINS(stub_uart_output, "ISR log buffer full, 8 records lost");
+
+  loggingGetStats(&stats);
+  CHECK(stats.lost - lost == 8);
+}
+
+static void test_task_overflow_is_reported(void)
+{
+  fresh_output();
+
+  // Enough records to overrun LOG_BUFFER_BYTES
+  for(uint32_t i = 0; i < LOG_BUFFER_BYTES / 16; i++)
+  {
+    LOG_INFO("task %u", i);
+    advance_ms(PACE_MS);
+  }
+
+#if LOG_USE_LOCKFREE_RING
+  CHECK(log_ring_dropped(&log_ring) > 0);
+#else
+  CHECK(str_buff_dropped(log_fill) > 0);
+#endif
+
+  advance_ms(LOG_REPORT_INTERVAL_MS + 1);
+  drain();
+
+#if LOG_USE_LOCKFREE_RING
+  CHECK_STR_CONTAINS(stub_uart_output, "log ring full");
+#else
+  CHECK_STR_CONTAINS(stub_uart_output, "log buffer full");
+#endif
+
+  if(LOG_USE_LOCKFREE_RING || LOG_BUFFER_POLICY != STR_BUF_OVERWRITE_OLDEST)
+  {
+    // The new records are lost, the oldest survive. STR_BUF_BLOCK gives up
+    // at once, there is no scheduler to wait for.
+    CHECK_STR_CONTAINS(stub_uart_output, "task 0\r\n");
+    CHECK(strstr(stub_uart_output, "task 511\r\n") == NULL);
+  }
+  else
+  {
+    // The newest records survive overwrite-oldest
+    CHECK(strstr(stub_uart_output, "task 0\r\n") == NULL);
+    CHECK_STR_CONTAINS(stub_uart_output, "task 511\r\n");
+  }
+}
+
+#if LOG_PIPELINE_STATS
+static uint32_t latency_total(const LogStats_t *stats)
+{
+  uint32_t total = 0;
+
+  for(int i = 0; i < LOG_LATENCY_BUCKETS; i++)
+    total += stats->latency[i];
+
+  return total;
+}
+
+static void test_pipeline_stats_are_collected(void)
+{
+  LogStats_t before;
+  LogStats_t after;
+  char longer[200];
+
+  fresh_output();
+  loggingGetStats(&before);
+
+  memset(longer, 'b', sizeof(longer) - 1);
+  longer[sizeof(longer) - 1] = '\0';
+
+  LOG_INFO("stats %u", 1u);
+  LOG_INFO("stats %u", 2u);
+  LOG_INFO("cut %s", longer);
+
+  // 5 ms from the calls to the end of the transfer
+  advance_ms(5);
+  drain();
+  loggingGetStats(&after);
+
+  CHECK(after.produced - before.produced == 3);
+  CHECK(after.truncated - before.truncated == 1);
+  CHECK(after.pending_max >= 3);
+  CHECK(after.buffer_max > 0 && after.buffer_max <= LOG_BUFFER_BYTES / 2);
+  // The cut string fills the arena behind the one word used
+  CHECK(after.record_max > LOG_MSG_BUFFER_SIZE - LOG_MAX_ARG_WORDS * sizeof(uint32_t));
+  CHECK(after.record_max <= LOG_MSG_BUFFER_SIZE);
+  // The RTT sink is sent the same text
+  CHECK(after.wire_bytes - before.wire_bytes == stub_uart_output_len * (1 + LOG_OUTPUT_RTT));
+
+  // 4096 to 8191 us, generated reports are not counted
+  CHECK(latency_total(&after) - latency_total(&before) == 3);
+  CHECK(after.latency[12] - before.latency[12] == 3);
+  CHECK(after.latency_max >= 5000);
+
+  // Read from logTask's stack once it runs
+  CHECK(after.stack_free_min == 0);
+  stub_task_stack_free = 300;
+  log_task_handle = xTaskGetCurrentTaskHandle();
+  loggingGetStats(&after);
+  log_task_handle = NULL;
+  CHECK(after.stack_free_min == 300 * sizeof(StackType_t));
+}
+
+static void test_stats_summary_is_logged(void)
+{
+  fresh_output();
+
+  LOG_INFO("before the summary");
+  advance_ms(LOG_STATS_INTERVAL_MS + 1);
+  drain();
+
+  CHECK_STR_CONTAINS(stub_uart_output, "log stats: ");
+  CHECK_STR_CONTAINS(stub_uart_output, " produced, ");
+  CHECK_STR_CONTAINS(stub_uart_output, "log latency: 50% < ");
+
+  // Nothing logged since, no summary
+  stub_uart_reset();
+  advance_ms(LOG_STATS_INTERVAL_MS + 1);
+  drain();
+
+  CHECK(strstr(stub_uart_output, "log stats: ") == NULL);
+}
+#endif
+
+static void test_module_level_switches_call_sites(void)
+{
+  fresh_output();
+
+  CHECK(loggingSetModuleLevel("logging", LOG_LEVEL_WARNING) > 0);
+  CHECK(loggingSetModuleLevel("no such module", LOG_LEVEL_INFO) == 0);
+
+  LOG_INFO("hidden info");
+  LOG_WARNING("shown warning");
+  drain();
+
+  CHECK(strstr(stub_uart_output, "hidden info") == NULL);
+  CHECK_STR_CONTAINS(stub_uart_output, "shown warning");
+
+  loggingSetModuleLevel("logging", LOG_LEVEL_INFO);
+}
+
+#if LOG_UART_DMA
+static void test_uart_rx_error_leaves_the_transfer_running(void)
+{
+  fresh_output();
+  stub_uart_dma_hold = 1;
+
+  LOG_INFO("in flight");
+  drain();
+  CHECK(log_uart_sink.busy);
+
+  // Overrun on the receive side while the DMA still sends
+  huart1.ErrorCode = HAL_UART_ERROR_ORE;
+  HAL_UART_ErrorCallback(&huart1);
+
+  LOG_INFO("next batch");
+  drain();
+  CHECK(log_uart_sink.busy);
+  CHECK(strstr(stub_uart_output, "next batch") == NULL);
+
+  stub_uart_dma_complete(&huart1);
+  drain();
+  CHECK_STR_CONTAINS(stub_uart_output, "next batch\r\n");
+  stub_uart_dma_complete(&huart1);
+  drain();
+  CHECK(!log_uart_sink.busy);
+
+  // A DMA error ends the transfer, the sink is free again right away
+  LOG_INFO("failing");
+  drain();
+  CHECK(log_uart_sink.busy);
+  huart1.gState = HAL_UART_STATE_READY;
+  huart1.ErrorCode = HAL_UART_ERROR_DMA;
+  HAL_UART_ErrorCallback(&huart1);
+  drain();
+  CHECK(!log_uart_sink.busy);
+
+  // Nothing in flight, a late error must not complete the next transfer
+  HAL_UART_ErrorCallback(&huart1);
+  LOG_INFO("after error");
+  drain();
+  CHECK(log_uart_sink.busy);
+
+  stub_uart_dma_hold = 0;
+  huart1.ErrorCode = HAL_UART_ERROR_NONE;
+  stub_uart_dma_complete(&huart1);
+  drain();
+  CHECK(!log_uart_sink.busy);
+}
+
+static void test_uart_timeout_follows_the_baud_rate(void)
+{
+  void *entry;
+
+  fresh_output();
+  stub_uart_dma_hold = 1;
+  huart1.Init.BaudRate = 9600;
+
+  // A batch of most of LOG_TX_BATCH_SIZE, about a second at 9600 baud
+  for(uint32_t i = 0; i < 6; i++)
+  {
+    LOG_INFO("%s %u", "a line long enough that six of them fill most of a batch", i);
+    advance_ms(PACE_MS);
+  }
+  drain();
+  CHECK(stub_uart_output_len > LOG_TX_BATCH_SIZE / 2);
+  CHECK(log_sink_ring_peek(&log_sink_ring, &log_uart_sink, &entry) == 0);
+  CHECK(log_uart_sink.busy);
+
+  // Well past LOG_TX_TIMEOUT_MS, but the bytes are still going out
+  advance_ms(stub_uart_output_len * 10 * 1000 / 9600 - 100);
+  drain();
+  CHECK(log_uart_sink.busy);
+
+  // No completion after all, aborted
+  advance_ms(12 * 1000 * LOG_TX_BATCH_SIZE / 9600 + LOG_TX_TIMEOUT_MS);
+  drain();
+  CHECK(!log_uart_sink.busy);
+  CHECK(huart1.gState == HAL_UART_STATE_READY);
+
+  stub_uart_dma_hold = 0;
+  huart1.Init.BaudRate = 115200;
+}
+#endif
+
+static void test_sinks_get_their_own_levels(void)
+{
+  static TestSink_t errors_out;
+  static TestSink_t frames_out;
+  static uint8_t frames_buf[LOG_TX_BATCH_SIZE];
+  static LogSink errors = { .name = "errors", .level = LOG_LEVEL_ERROR, .encoding = LOG_SINK_TEXT,
+                            .write = test_sink_write, .ctx = &errors_out };
+  static LogSink frames = { .name = "frames", .level = LOG_LEVEL_INFO, .encoding = LOG_SINK_BINARY,
+                            .write = test_sink_write, .flush = test_sink_flush, .ctx = &frames_out,
+                            .buf = frames_buf, .buf_size = sizeof(frames_buf) };
+  static LogSink incomplete = { .name = "incomplete", .write = test_sink_write, .flush = test_sink_flush };
+
+  fresh_output();
+
+  CHECK(loggingAddSink(&errors) == 0);
+  // Frames carry the captured arguments, there are none to send otherwise
+  CHECK(loggingAddSink(&frames) == (LOG_DEFERRED_FORMATTING ? 0 : -1));
+  CHECK(loggingAddSink(&errors) == -1);
+  // Writes in the background without a staging buffer of its own
+  CHECK(loggingAddSink(&incomplete) == -1);
+
+  LOG_INFO("routed info");
+  LOG_ERROR("routed error %d", 7);
+  drain();
+
+  CHECK_STR_CONTAINS(stub_uart_output, "routed info\r\n");
+  CHECK_STR_CONTAINS(stub_uart_output, "routed error 7\r\n");
+  CHECK(strstr(errors_out.out, "routed info") == NULL);
+  CHECK_STR_CONTAINS(errors_out.out, "[ERROR] ");
+  CHECK_STR_CONTAINS(errors_out.out, "routed error 7\r\n");
+
+#if LOG_DEFERRED_FORMATTING
+  // Two frames, the first one with the absolute time
+  CHECK(frames_out.len > 0 && (uint8_t)frames_out.out[0] == LOG_WIRE_SYNC);
+  CHECK(frames_out.out[1] & LOG_WIRE_ABSOLUTE);
+  CHECK((frames_out.out[1] & LOG_WIRE_LEVEL_MASK) == LOG_LEVEL_INFO);
+  CHECK(strstr(frames_out.out, "routed") == NULL);
+#endif
+
+  errors.level = LOG_LEVEL_NONE;
+  frames.level = LOG_LEVEL_NONE;
+}
+
+static void test_slow_sink_does_not_stall_the_others(void)
+{
+  static TestSink_t slow_out = { .stuck = 1 };
+  static uint8_t slow_buf[LOG_TX_BATCH_SIZE];
+  static LogSink slow = { .name = "slow", .level = LOG_LEVEL_INFO, .encoding = LOG_SINK_TEXT,
+                          .write = test_sink_write, .flush = test_sink_flush, .ctx = &slow_out,
+                          .buf = slow_buf, .buf_size = sizeof(slow_buf) };
+  const uint32_t records = 2 * LOG_SINK_RING_SIZE / 32;
+  LogStats_t before;
+  LogStats_t after;
+  char expect[64];
+
+  fresh_output();
+  loggingGetStats(&before);
+  CHECK(loggingAddSink(&slow) == 0);
+
+  LOG_INFO("slow first");
+  drain();
+  CHECK(slow_out.writes == 1);
+  CHECK_STR_CONTAINS(slow_out.out, "slow first\r\n");
+
+  // Twice what the sink ring holds, while the slow sink never completes
+  for(uint32_t i = 0; i < records; i++)
+  {
+    LOG_INFO("while slow %u", i);
+    advance_ms(PACE_MS);
+    if(i % 16 == 15)
+      drain();
+  }
+  drain();
+
+  CHECK_STR_CONTAINS(stub_uart_output, "while slow 0\r\n");
+  snprintf(expect, sizeof(expect), "while slow %u\r\n", (unsigned)(records - 1));
+  CHECK_STR_CONTAINS(stub_uart_output, expect);
+  CHECK(slow_out.writes == 1);
+  CHECK(slow.dropped > 0);
+
+  // Done at last, it goes on with what the ring still holds
+  slow_out.stuck = 0;
+  advance_ms(LOG_REPORT_INTERVAL_MS + 1);
+  drain();
+  loggingGetStats(&after);
+
+  CHECK(slow_out.writes > 1);
+  CHECK(strstr(slow_out.out, "while slow 0\r\n") == NULL);
+  CHECK_STR_CONTAINS(slow_out.out, expect);
+
+  // Reported once per interval while it fell behind, the counts add up
+  CHECK_STR_CONTAINS(stub_uart_output, "log sink slow fell behind, ");
+  CHECK_STR_CONTAINS(slow_out.out, "log sink slow fell behind, ");
+  CHECK(after.sink_dropped - before.sink_dropped == slow.dropped_reported);
+  CHECK(slow.dropped_reported > 0);
+
+  slow.level = LOG_LEVEL_NONE;
+}
+#elif LOG_OUTPUT_UART
+static void test_uart_sends_frames(void)
+{
+  fresh_output();
+
+  LOG_INFO("framed %u", 5u);
+  drain();
+
+  CHECK(stub_uart_output_len > 2 && (uint8_t)stub_uart_output[0] == LOG_WIRE_SYNC);
+  CHECK((stub_uart_output[1] & LOG_WIRE_LEVEL_MASK) == LOG_LEVEL_INFO);
+  CHECK(strstr(stub_uart_output, "framed") == NULL);
+}
+#endif // TEST_UART_TEXT
+
+int main(void)
+{
+  loggingInit();
+
+  RUN_TEST(test_text_sink_gets_the_records);
+#if TEST_UART_TEXT
+  RUN_TEST(test_deferred_arguments_are_rendered);
+  RUN_TEST(test_long_strings_are_truncated);
+  RUN_TEST(test_isr_records_are_merged_by_time);
+#if !LOG_USE_LOCKFREE_RING
+  RUN_TEST(test_drain_locks_only_to_swap);
+  RUN_TEST(test_isr_records_drain_without_the_lock);
+#endif
+#if LOG_RATE_LIMIT_PER_SEC
+  RUN_TEST(test_rate_limit_is_reported);
+#endif
+#if LOG_SUPPRESS_DUPLICATES
+  RUN_TEST(test_duplicates_are_collapsed);
+#else
+  RUN_TEST(test_repeats_are_logged);
+#endif
+  RUN_TEST(test_isr_overflow_is_reported);
+  RUN_TEST(test_task_overflow_is_reported);
+#if LOG_PIPELINE_STATS
+  RUN_TEST(test_pipeline_stats_are_collected);
+  RUN_TEST(test_stats_summary_is_logged);
+#endif
+  RUN_TEST(test_module_level_switches_call_sites);
+#if LOG_UART_DMA
+  RUN_TEST(test_uart_rx_error_leaves_the_transfer_running);
+  RUN_TEST(test_uart_timeout_follows_the_baud_rate);
+#endif
+  RUN_TEST(test_sinks_get_their_own_levels);
+  RUN_TEST(test_slow_sink_does_not_stall_the_others);
+#elif LOG_OUTPUT_UART
+  RUN_TEST(test_uart_sends_frames);
+#endif
+
+  return unittest_result();
+}
@@ -0,0 +1,332 @@
+/*****************************************************************************
+* | File        : test_logring.c
+* | Author      : Luke Mulder
+* | Function    : Unit and stress tests of the lock-free record ring
+* | Info        :
+*   The stress test runs STRESS_PRODUCERS pthreads against one consumer,
+*   the test's main thread, on a small ring so it is full most of the
+*   time. Every record carries its producer and sequence number and a fill
+*   pattern derived from both, the consumer checks that each producer's
+*   records arrive once, in order and whole. Producers retry a record the
+*   full ring refused, so every record must come through. Some
+*   reservations are committed shorter or cancelled on the way.
+*
+*   Host threads stand in for tasks preempting each other on the target,
+*   the throughput printed is only good for comparing changes.
+******************************************************************************/
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "logring.h"
+#include "unittest.h"
+
+#define RING_SIZE 1024
+
+#define STRESS_PRODUCERS 4
+#define STRESS_RECORDS 200000
+// Every so many records a producer also cancels a reservation
+#define STRESS_CANCEL_EVERY 16
+// Longest the consumer waits without any record before giving up, ms
+#define STRESS_STALL_MS 5000
+
+static uint8_t storage[RING_SIZE] __attribute__((aligned(4)));
+
+typedef struct {
+  uint32_t producer;
+  uint32_t seq;
+  uint8_t fill[];
+} StressRecord_t;
+
+typedef struct {
+  LogRing *ring;
+  uint32_t producer;
+  uint64_t refused;     // Reservations the full ring refused
+} StressProducer_t;
+
+static void push(LogRing *ring, const char *text)
+{
+  size_t len = strlen(text) + 1;
+  void *rec = log_ring_reserve(ring, len);
+
+  CHECK(rec != NULL);
+  if(rec == NULL)
+    return;
+
+  memcpy(rec, text, len);
+  log_ring_commit(ring, rec, len);
+}
+
+// Text of the oldest record, released, NULL if nothing is ready
+static const char* pop(LogRing *ring, char *out, size_t size)
+{
+  void *rec;
+  size_t len = log_ring_peek(ring, &rec);
+
+  if(len == 0)
+    return NULL;
+
+  snprintf(out, size, "%.*s", (int)len, (const char*)rec);
+  log_ring_release(ring);
+
+  return out;
+}
+
+static void test_records_come_out_in_order(void)
+{
+  LogRing ring;
+  char text[32];
+
+  CHECK(log_ring_init(&ring, storage, sizeof(storage)) == 0);
+
+  push(&ring, "one");
+  push(&ring, "two");
+  push(&ring, "three");
+
+  CHECK(pop(&ring, text, sizeof(text)) != NULL && strcmp(text, "one") == 0);
+  CHECK(pop(&ring, text, sizeof(text)) != NULL && strcmp(text, "two") == 0);
+  CHECK(pop(&ring, text, sizeof(text)) != NULL && strcmp(text, "three") == 0);
+  CHECK(pop(&ring, text, sizeof(text)) == NULL);
+  CHECK(log_ring_used(&ring) == 0);
+}
+
+static void test_uncommitted_record_holds_back_later_ones(void)
+{
+  LogRing ring;
+  char text[32];
+  void *first;
+  void *second;
+
+  log_ring_init(&ring, storage, sizeof(storage));
+
+  first = log_ring_reserve(&ring, 16);
+  second = log_ring_reserve(&ring, 16);
+  CHECK(first != NULL && second != NULL);
+
+  strcpy(second, "second");
+  log_ring_commit(&ring, second, 7);
+  CHECK(pop(&ring, text, sizeof(text)) == NULL);
+
+  // Cancelled, it is skipped like padding
+  log_ring_cancel(&ring, first);
+  CHECK(pop(&ring, text, sizeof(text)) != NULL && strcmp(text, "second") == 0);
+  CHECK(log_ring_used(&ring) == 0);
+}
+
+static void test_full_ring_drops_the_new_record(void)
+{
+  LogRing ring;
+  char text[32];
+  uint32_t pushed = 0;
+  void *rec;
+
+  log_ring_init(&ring, storage, sizeof(storage));
+
+  while((rec = log_ring_reserve(&ring, 28)) != NULL)
+  {
+    snprintf(rec, 28, "record %u", (unsigned)pushed++);
+    log_ring_commit(&ring, rec, 28);
+  }
+
+  CHECK(pushed == RING_SIZE / 32);
+  CHECK(log_ring_dropped(&ring) == 1);
+
+  // Too large for the ring at all
+  CHECK(log_ring_reserve(&ring, RING_SIZE) == NULL);
+  CHECK(log_ring_dropped(&ring) == 2);
+
+  CHECK(pop(&ring, text, sizeof(text)) != NULL && strcmp(text, "record 0") == 0);
+}
+
+static void test_records_stay_whole_across_the_wrap(void)
+{
+  LogRing ring;
+  uint8_t entry[100];
+  uint32_t seed = 1;
+
+  log_ring_init(&ring, storage, sizeof(storage));
+
+  for(uint32_t i = 0; i < 1000; i++)
+  {
+    size_t len = 1 + (seed = seed * 1103515245u + 12345u) % sizeof(entry);
+    uint8_t *rec = log_ring_reserve(&ring, len);
+    void *read;
+
+    CHECK(rec != NULL);
+    if(rec == NULL)
+      return;
+
+    memset(entry, (uint8_t)i, len);
+    memcpy(rec, entry, len);
+    log_ring_commit(&ring, rec, len);
+
+    CHECK(log_ring_peek(&ring, &read) == len && memcmp(read, entry, len) == 0);
+    CHECK((uint8_t*)read + len <= storage + sizeof(storage));
+    log_ring_release(&ring);
+  }
+}
+
+static void test_init_rejects_bad_storage(void)
+{
+  LogRing ring;
+
+  CHECK(log_ring_init(&ring, storage, 1000) == -1);
+  CHECK(log_ring_init(&ring, storage + 1, 512) == -1);
+  CHECK(log_ring_init(&ring, NULL, 512) == -1);
+  CHECK(log_ring_init(&ring, storage, 0) == -1);
+}
+
+// Payload length of a producer's record, header fields included
+static size_t stress_len(uint32_t producer, uint32_t seq)
+{
+  return sizeof(StressRecord_t) + (seq * 7 + producer) % 57;
+}
+
+static uint8_t stress_fill(uint32_t producer, uint32_t seq, size_t i)
+{
+  return (uint8_t)(producer * 31 + seq + i);
+}
+
+static void* stress_producer(void *arg)
+{
+  StressProducer_t *self = arg;
+
+  for(uint32_t seq = 0; seq < STRESS_RECORDS; seq++)
+  {
+    size_t len = stress_len(self->producer, seq);
+    StressRecord_t *rec;
+
+    if(seq % STRESS_CANCEL_EVERY == 0)
+    {
+      if((rec = log_ring_reserve(self->ring, len)) != NULL)
+      {
+        memset(rec, 0xEE, len);
+        log_ring_cancel(self->ring, rec);
+      }
+      else
+      {
+        self->refused++;
+      }
+    }
+
+    // Reserved longer than needed every other time, committed short
+    while((rec = log_ring_reserve(self->ring, len + (seq & 1) * 16)) == NULL)
+    {
+      self->refused++;
+      sched_yield();
+    }
+
+    rec->producer = self->producer;
+    rec->seq = seq;
+    for(size_t i = 0; i < len - sizeof(StressRecord_t); i++)
+      rec->fill[i] = stress_fill(self->producer, seq, i);
+
+    log_ring_commit(self->ring, rec, len);
+  }
+
+  return NULL;
+}
+
+static double stress_now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void test_producers_race_one_consumer(void)
+{
+  static LogRing ring;
+  StressProducer_t producers[STRESS_PRODUCERS];
+  pthread_t threads[STRESS_PRODUCERS];
+  uint32_t next[STRESS_PRODUCERS] = {0};
+  uint64_t total = 0;
+  uint64_t refused = 0;
+  uint32_t bad = 0;
+  double start;
+  double last_seen;
+  double elapsed;
+
+  CHECK(log_ring_init(&ring, storage, sizeof(storage)) == 0);
+
+  start = stress_now_ms();
+  for(uint32_t p = 0; p < STRESS_PRODUCERS; p++)
+  {
+    producers[p] = (StressProducer_t){ &ring, p, 0 };
+    CHECK(pthread_create(&threads[p], NULL, stress_producer, &producers[p]) == 0);
+  }
+
+  last_seen = start;
+  while(total < (uint64_t)STRESS_PRODUCERS * STRESS_RECORDS)
+  {
+    StressRecord_t *rec;
+    size_t len = log_ring_peek(&ring, (void**)&rec);
+
+    if(len == 0)
+    {
+      // A lost record would leave the consumer waiting forever
+      if(stress_now_ms() - last_seen > STRESS_STALL_MS)
+        break;
+      sched_yield();
+      continue;
+    }
+    last_seen = stress_now_ms();
+
+    if(len < sizeof(StressRecord_t) || rec->producer >= STRESS_PRODUCERS)
+    {
+      bad++;
+    }
+    else
+    {
+      uint32_t p = rec->producer;
+
+      // Each producer's records once and in order, each one whole
+      if(rec->seq != next[p] || len != stress_len(p, rec->seq))
+        bad++;
+      for(size_t i = 0; i < len - sizeof(StressRecord_t); i++)
+      {
+        if(rec->fill[i] != stress_fill(p, rec->seq, i))
+        {
+          bad++;
+          break;
+        }
+      }
+      next[p] = rec->seq + 1;
+    }
+
+    log_ring_release(&ring);
+    total++;
+  }
+  elapsed = stress_now_ms() - start;
+
+  for(uint32_t p = 0; p < STRESS_PRODUCERS; p++)
+  {
+    pthread_join(threads[p], NULL);
+    refused += producers[p].refused;
+    CHECK(next[p] == STRESS_RECORDS);
+  }
+
+  CHECK(bad == 0);
+  CHECK(total == (uint64_t)STRESS_PRODUCERS * STRESS_RECORDS);
+  CHECK(log_ring_used(&ring) == 0);
+  CHECK(log_ring_dropped(&ring) == refused);
+
+  printf("  %llu records from %d producers in %.0f ms, %.1f ns per record, %llu refused by the full ring\n",
+         (unsigned long long)total, STRESS_PRODUCERS, elapsed, elapsed * 1e6 / (total ? total : 1),
+         (unsigned long long)refused);
+}
+
+int main(void)
+{
+  RUN_TEST(test_records_come_out_in_order);
+  RUN_TEST(test_uncommitted_record_holds_back_later_ones);
+  RUN_TEST(test_full_ring_drops_the_new_record);
+  RUN_TEST(test_records_stay_whole_across_the_wrap);
+  RUN_TEST(test_init_rejects_bad_storage);
+  RUN_TEST(test_producers_race_one_consumer);
+
+  return unittest_result();
+}
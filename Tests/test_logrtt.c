@@ -0,0 +1,188 @@
+/*****************************************************************************
+* | File        : test_logrtt.c
+* | Author      : Luke Mulder
+* | Function    : Unit tests of the RTT style log channel
+* | Info        :
+*   The probe side is played by rtt_read_dump, which sees nothing but a
+*   RAM image: it scans for the ID, walks the descriptor with the target's
+*   pointer size and copies out the unread bytes, translating addresses
+*   back into the image. It then moves rd_off in the live block the way a
+*   probe writes it through the debug port.
+******************************************************************************/
+
+#include <stdint.h>
+#include "logrtt.h"
+#include "unittest.h"
+
+// Control block and storage back to back, dumped as one RAM region
+static struct {
+  LogRttControlBlock cb;
+  uint8_t storage[64];
+} ram;
+
+static uint32_t dump_word(const uint8_t *dump, size_t offset)
+{
+  uint32_t value;
+
+  memcpy(&value, dump + offset, sizeof(value));
+
+  return value;
+}
+
+static uintptr_t dump_pointer(const uint8_t *dump, size_t offset)
+{
+  uintptr_t value;
+
+  memcpy(&value, dump + offset, sizeof(value));
+
+  return value;
+}
+
+/**
+ * Reads the unread bytes of up-buffer 0 out of a RAM image starting at
+ * base, then acknowledges them in the live block.
+ *
+ * @return Number of bytes copied to out, -1 if the image is not usable.
+ */
+static int rtt_read_dump(const uint8_t *dump, size_t dump_size, uintptr_t base, char *out, size_t out_size)
+{
+  const size_t ptr = sizeof(void*);
+  size_t cb = 0;
+  size_t desc, buf;
+  uint32_t size, wr, rd;
+  int n = 0;
+
+  // Scan for the ID like a probe that was given a RAM range
+  while(cb + LOG_RTT_ID_SIZE <= dump_size && memcmp(dump + cb, LOG_RTT_ID, sizeof(LOG_RTT_ID)) != 0)
+    cb += 4;
+  if(cb + LOG_RTT_ID_SIZE > dump_size)
+    return -1;
+
+  if((int32_t)dump_word(dump, cb + LOG_RTT_ID_SIZE) < 1)
+    return -1;
+
+  // up[0]: name, buf, size, wr_off, rd_off, flags
+  desc = cb + LOG_RTT_ID_SIZE + 2 * sizeof(int32_t);
+  buf = dump_pointer(dump, desc + ptr) - base;
+  size = dump_word(dump, desc + 2 * ptr);
+  wr = dump_word(dump, desc + 2 * ptr + 4);
+  rd = dump_word(dump, desc + 2 * ptr + 8);
+
+  if(buf + size > dump_size || wr >= size || rd >= size)
+    return -1;
+
+  while(rd != wr && (size_t)n < out_size)
+  {
+    out[n++] = dump[buf + rd];
+    rd = (rd + 1 < size) ? rd + 1 : 0;
+  }
+
+  ((LogRttControlBlock*)(base + cb))->up[0].rd_off = rd;
+
+  return n;
+}
+
+static int rtt_read(char *out, size_t out_size)
+{
+  uint8_t dump[sizeof(ram)];
+  int n;
+
+  memcpy(dump, &ram, sizeof(ram));
+  n = rtt_read_dump(dump, sizeof(dump), (uintptr_t)&ram, out, out_size - 1);
+  if(n >= 0)
+    out[n] = '\0';
+
+  return n;
+}
+
+static void test_init_publishes_the_block(void)
+{
+  CHECK(log_rtt_init(&ram.cb, "Terminal", ram.storage, 1, LOG_RTT_MODE_NO_BLOCK_SKIP) == -1);
+  CHECK(log_rtt_init(&ram.cb, "Terminal", ram.storage, sizeof(ram.storage), 7) == -1);
+  CHECK(log_rtt_init(&ram.cb, "Terminal", ram.storage, sizeof(ram.storage), LOG_RTT_MODE_NO_BLOCK_SKIP) == 0);
+
+  CHECK(strcmp(ram.cb.id, LOG_RTT_ID) == 0);
+  CHECK(ram.cb.max_up == 1 && ram.cb.max_down == 0);
+  CHECK(strcmp(ram.cb.up[0].name, "Terminal") == 0);
+  // One byte always stays free
+  CHECK(log_rtt_space(&ram.cb) == sizeof(ram.storage) - 1);
+}
+
+static void test_dump_is_parsed(void)
+{
+  char out[128];
+
+  log_rtt_init(&ram.cb, "Terminal", ram.storage, sizeof(ram.storage), LOG_RTT_MODE_NO_BLOCK_SKIP);
+
+  CHECK(rtt_read(out, sizeof(out)) == 0);
+
+  CHECK(log_rtt_write(&ram.cb, "hello\r\n", 7) == 7);
+  CHECK(log_rtt_write(&ram.cb, "world\r\n", 7) == 7);
+  CHECK(rtt_read(out, sizeof(out)) == 14);
+  CHECK(strcmp(out, "hello\r\nworld\r\n") == 0);
+
+  // Acknowledged, nothing left
+  CHECK(rtt_read(out, sizeof(out)) == 0);
+  CHECK(log_rtt_space(&ram.cb) == sizeof(ram.storage) - 1);
+}
+
+static void test_writes_wrap(void)
+{
+  char line[24];
+  char out[128];
+
+  log_rtt_init(&ram.cb, "Terminal", ram.storage, sizeof(ram.storage), LOG_RTT_MODE_NO_BLOCK_SKIP);
+
+  // 24 byte lines into 64 bytes, every third write wraps
+  for(int i = 0; i < 10; i++)
+  {
+    snprintf(line, sizeof(line), "line %02d ..............\n", i);
+    CHECK(log_rtt_write(&ram.cb, line, 23) == 23);
+    CHECK(rtt_read(out, sizeof(out)) == 23);
+    CHECK(memcmp(out, line, 23) == 0);
+  }
+}
+
+static void test_full_ring_skips_or_trims(void)
+{
+  char data[64];
+  char out[128];
+
+  memset(data, 'x', sizeof(data));
+
+  // Nobody reads: skip keeps whole writes only
+  log_rtt_init(&ram.cb, "Terminal", ram.storage, sizeof(ram.storage), LOG_RTT_MODE_NO_BLOCK_SKIP);
+  CHECK(log_rtt_write(&ram.cb, data, 40) == 40);
+  CHECK(log_rtt_write(&ram.cb, data, 40) == 0);
+  CHECK(log_rtt_write(&ram.cb, data, 23) == 23);
+  CHECK(log_rtt_space(&ram.cb) == 0);
+  CHECK(rtt_read(out, sizeof(out)) == 63);
+
+  // Trim fills up to the last free byte
+  log_rtt_init(&ram.cb, "Terminal", ram.storage, sizeof(ram.storage), LOG_RTT_MODE_NO_BLOCK_TRIM);
+  CHECK(log_rtt_write(&ram.cb, data, 40) == 40);
+  CHECK(log_rtt_write(&ram.cb, data, 40) == 23);
+  CHECK(log_rtt_write(&ram.cb, data, 1) == 0);
+  CHECK(rtt_read(out, sizeof(out)) == 63);
+}
+
+static void test_bad_read_offset_is_ignored(void)
+{
+  log_rtt_init(&ram.cb, "Terminal", ram.storage, sizeof(ram.storage), LOG_RTT_MODE_NO_BLOCK_TRIM);
+
+  // A probe writing garbage must not make the target write out of bounds
+  ram.cb.up[0].rd_off = 1000;
+  CHECK(log_rtt_space(&ram.cb) == 0);
+  CHECK(log_rtt_write(&ram.cb, "abc", 3) == 0);
+}
+
+int main(void)
+{
+  RUN_TEST(test_init_publishes_the_block);
+  RUN_TEST(test_dump_is_parsed);
+  RUN_TEST(test_writes_wrap);
+  RUN_TEST(test_full_ring_skips_or_trims);
+  RUN_TEST(test_bad_read_offset_is_ignored);
+
+  return unittest_result();
+}
@@ -0,0 +1,255 @@
+/*****************************************************************************
+* | File        : test_logsink.c
+* | Author      : Luke Mulder
+* | Function    : Unit tests of the sink ring
+* | Info        :
+*   Entries are numbered strings so every check can tell which entry a
+*   sink got. A small ring makes the wrap and the full cases come quickly.
+******************************************************************************/
+
+#include <stdint.h>
+#include "logsink.h"
+#include "unittest.h"
+
+#define RING_SIZE 256
+
+static uint8_t storage[RING_SIZE] __attribute__((aligned(4)));
+
+static void sink_setup(LogSink *sink, const char *name, uint8_t level)
+{
+  memset(sink, 0, sizeof(*sink));
+  sink->name = name;
+  sink->level = level;
+}
+
+static void push(LogSinkRing *ring, uint32_t n, uint8_t level)
+{
+  char entry[16];
+
+  snprintf(entry, sizeof(entry), "entry %u", (unsigned)n);
+  CHECK(log_sink_ring_push(ring, entry, strlen(entry) + 1, level) >= 0);
+}
+
+// Number of the sink's next entry, -1 if it has read everything
+static int next(LogSinkRing *ring, LogSink *sink)
+{
+  void *entry;
+  unsigned n;
+
+  if(log_sink_ring_peek(ring, sink, &entry) == 0)
+    return -1;
+
+  CHECK(sscanf(entry, "entry %u", &n) == 1);
+  log_sink_ring_advance(ring, sink);
+
+  return n;
+}
+
+static void test_sinks_read_at_their_own_pace(void)
+{
+  LogSinkRing ring;
+  LogSink fast;
+  LogSink slow;
+
+  CHECK(log_sink_ring_init(&ring, storage, sizeof(storage)) == 0);
+  sink_setup(&fast, "fast", 3);
+  sink_setup(&slow, "slow", 3);
+  CHECK(log_sink_attach(&ring, &fast) == 0);
+  CHECK(log_sink_attach(&ring, &slow) == 0);
+  CHECK(log_sink_attach(&ring, &fast) == -1);
+  CHECK(ring.sinks == &fast && fast.next == &slow);
+
+  for(uint32_t i = 0; i < 3; i++)
+    push(&ring, i, 3);
+
+  CHECK(next(&ring, &fast) == 0);
+  CHECK(next(&ring, &fast) == 1);
+  CHECK(next(&ring, &fast) == 2);
+  CHECK(next(&ring, &fast) == -1);
+
+  // Still all there for the other one
+  CHECK(next(&ring, &slow) == 0);
+
+  push(&ring, 3, 3);
+  CHECK(next(&ring, &fast) == 3);
+  CHECK(next(&ring, &slow) == 1);
+  CHECK(next(&ring, &slow) == 2);
+  CHECK(next(&ring, &slow) == 3);
+  CHECK(next(&ring, &slow) == -1);
+}
+
+static void test_entries_above_the_level_are_skipped(void)
+{
+  LogSinkRing ring;
+  LogSink all;
+  LogSink warnings;
+  LogSink muted;
+
+  log_sink_ring_init(&ring, storage, sizeof(storage));
+  sink_setup(&all, "all", 3);
+  sink_setup(&warnings, "warnings", 2);
+  sink_setup(&muted, "muted", 0);
+  log_sink_attach(&ring, &all);
+  log_sink_attach(&ring, &warnings);
+  log_sink_attach(&ring, &muted);
+
+  push(&ring, 0, 3);
+  push(&ring, 1, 1);
+  push(&ring, 2, 3);
+  push(&ring, 3, 2);
+
+  CHECK(next(&ring, &all) == 0);
+  CHECK(next(&ring, &all) == 1);
+  CHECK(next(&ring, &all) == 2);
+  CHECK(next(&ring, &all) == 3);
+  CHECK(next(&ring, &warnings) == 1);
+  CHECK(next(&ring, &warnings) == 3);
+  CHECK(next(&ring, &warnings) == -1);
+  CHECK(next(&ring, &muted) == -1);
+}
+
+static void test_late_sink_starts_at_the_head(void)
+{
+  LogSinkRing ring;
+  LogSink early;
+  LogSink late;
+
+  log_sink_ring_init(&ring, storage, sizeof(storage));
+  sink_setup(&early, "early", 3);
+  sink_setup(&late, "late", 3);
+  log_sink_attach(&ring, &early);
+
+  push(&ring, 0, 3);
+  log_sink_attach(&ring, &late);
+  push(&ring, 1, 3);
+
+  CHECK(next(&ring, &early) == 0);
+  CHECK(next(&ring, &late) == 1);
+  CHECK(next(&ring, &late) == -1);
+}
+
+static void test_full_ring_drops_for_the_slow_sink_only(void)
+{
+  LogSinkRing ring;
+  LogSink fast;
+  LogSink slow;
+  uint32_t pushed = 0;
+  int dropped = 0;
+  int n;
+
+  log_sink_ring_init(&ring, storage, sizeof(storage));
+  sink_setup(&fast, "fast", 3);
+  sink_setup(&slow, "slow", 3);
+  log_sink_attach(&ring, &fast);
+  log_sink_attach(&ring, &slow);
+
+  // Fill up while the slow sink reads nothing
+  while(log_sink_ring_fits(&ring, 16))
+  {
+    push(&ring, pushed++, 3);
+    CHECK(next(&ring, &fast) == (int)pushed - 1);
+  }
+
+  // The fast sink has read everything, the slow one holds the space
+  CHECK(next(&ring, &fast) == -1);
+  CHECK(!log_sink_ring_fits(&ring, 16));
+
+  for(uint32_t i = 0; i < 5; i++)
+  {
+    char entry[16];
+
+    snprintf(entry, sizeof(entry), "entry %u", (unsigned)pushed);
+    dropped += log_sink_ring_push(&ring, entry, strlen(entry) + 1, 3);
+    CHECK(next(&ring, &fast) == (int)pushed);
+    pushed++;
+  }
+
+  CHECK(dropped > 0);
+  CHECK(slow.dropped == (uint32_t)dropped);
+  CHECK(fast.dropped == 0);
+
+  // The slow sink goes on with the oldest entry still there, in order
+  CHECK(next(&ring, &slow) == dropped);
+  while((n = next(&ring, &slow)) >= 0)
+    CHECK(n < (int)pushed);
+  CHECK(next(&ring, &slow) == -1);
+}
+
+static void test_skipped_entries_are_not_counted_as_dropped(void)
+{
+  LogSinkRing ring;
+  LogSink errors;
+  LogSink all;
+
+  log_sink_ring_init(&ring, storage, sizeof(storage));
+  sink_setup(&errors, "errors", 1);
+  sink_setup(&all, "all", 3);
+  log_sink_attach(&ring, &errors);
+  log_sink_attach(&ring, &all);
+
+  // Neither sink reads, the errors sink would skip all of these anyway
+  for(uint32_t i = 0; i < 64; i++)
+    push(&ring, i, 3);
+
+  CHECK(all.dropped > 0);
+  CHECK(errors.dropped == 0);
+}
+
+static void test_entries_stay_whole_across_the_wrap(void)
+{
+  LogSinkRing ring;
+  LogSink sink;
+  uint8_t entry[100];
+  uint32_t seed = 1;
+
+  log_sink_ring_init(&ring, storage, sizeof(storage));
+  sink_setup(&sink, "sink", 3);
+  log_sink_attach(&ring, &sink);
+
+  for(uint32_t i = 0; i < 500; i++)
+  {
+    size_t len = 1 + (seed = seed * 1103515245u + 12345u) % sizeof(entry);
+    size_t got;
+    void *read;
+
+    memset(entry, (uint8_t)i, len);
+    CHECK(log_sink_ring_fits(&ring, len));
+    CHECK(log_sink_ring_push(&ring, entry, len, 3) == 0);
+
+    got = log_sink_ring_peek(&ring, &sink, &read);
+    CHECK(got == len && memcmp(read, entry, len) == 0);
+    CHECK((uint8_t*)read + len <= storage + sizeof(storage));
+    log_sink_ring_advance(&ring, &sink);
+  }
+
+  CHECK(log_sink_ring_push(&ring, entry, RING_SIZE, 3) == -1);
+  CHECK(log_sink_ring_push(&ring, entry, 0, 3) == -1);
+}
+
+static void test_ring_without_sinks_keeps_nothing(void)
+{
+  LogSinkRing ring;
+
+  CHECK(log_sink_ring_init(&ring, storage, 100) == -1);
+  CHECK(log_sink_ring_init(&ring, storage + 1, 64) == -1);
+  CHECK(log_sink_ring_init(&ring, storage, sizeof(storage)) == 0);
+
+  for(uint32_t i = 0; i < 100; i++)
+  {
+    CHECK(log_sink_ring_fits(&ring, 16));
+    push(&ring, i, 3);
+  }
+}
+
+int main(void)
+{
+  RUN_TEST(test_sinks_read_at_their_own_pace);
+  RUN_TEST(test_entries_above_the_level_are_skipped);
+  RUN_TEST(test_late_sink_starts_at_the_head);
+  RUN_TEST(test_full_ring_drops_for_the_slow_sink_only);
+  RUN_TEST(test_skipped_entries_are_not_counted_as_dropped);
+  RUN_TEST(test_entries_stay_whole_across_the_wrap);
+  RUN_TEST(test_ring_without_sinks_keeps_nothing);
+
+  return unittest_result();
+}
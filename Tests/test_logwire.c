@@ -0,0 +1,215 @@
+/*****************************************************************************
+* | File        : test_logwire.c
+* | Author      : Luke Mulder
+* | Function    : Unit tests of the binary log frames
+* | Info        :
+*   Frames are checked byte by byte where the layout matters and otherwise
+*   read back with wire_decode, a C rendition of the frame loop in
+*   Tools/logdecode.py, so both ends are held to the same layout.
+******************************************************************************/
+
+#include <stdint.h>
+#include "logwire.h"
+#include "unittest.h"
+
+typedef struct {
+  uint8_t flags;
+  uint16_t id;
+  uint64_t timestamp;
+  uint32_t nwords;
+  uint32_t words[8];
+  const uint8_t *arena;
+  size_t arena_len;
+} WireFrame_t;
+
+static size_t wire_varint(const uint8_t *in, size_t len, uint64_t *value)
+{
+  size_t n = 0;
+
+  *value = 0;
+  while(n < len && n < LOG_WIRE_VARINT_MAX)
+  {
+    *value |= (uint64_t)(in[n] & 0x7F) << (7 * n);
+    if(!(in[n++] & 0x80))
+      return n;
+  }
+
+  return 0;
+}
+
+static int64_t wire_unzigzag(uint64_t value)
+{
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * Reads one frame, timestamps are resolved against *last like the host
+ * decoder does.
+ *
+ * @return Length of the frame, 0 if in does not start with a whole frame.
+ */
+static size_t wire_decode(const uint8_t *in, size_t len, uint64_t *last, WireFrame_t *frame)
+{
+  uint64_t value;
+  size_t pos = 2;
+  size_t n;
+
+  if(len < 2 || in[0] != LOG_WIRE_SYNC || (in[1] & 0xF0))
+    return 0;
+  frame->flags = in[1];
+
+  if((n = wire_varint(in + pos, len - pos, &value)) == 0)
+    return 0;
+  frame->id = value;
+  pos += n;
+
+  if((n = wire_varint(in + pos, len - pos, &value)) == 0)
+    return 0;
+  frame->timestamp = (frame->flags & LOG_WIRE_ABSOLUTE) ? value : *last + wire_unzigzag(value);
+  pos += n;
+
+  if((n = wire_varint(in + pos, len - pos, &value)) == 0 || value > 8)
+    return 0;
+  frame->nwords = value;
+  pos += n;
+
+  for(uint32_t i = 0; i < frame->nwords; i++)
+  {
+    if((n = wire_varint(in + pos, len - pos, &value)) == 0)
+      return 0;
+    frame->words[i] = (uint32_t)wire_unzigzag(value);
+    pos += n;
+  }
+
+  if((n = wire_varint(in + pos, len - pos, &value)) == 0 || pos + n + value > len)
+    return 0;
+  frame->arena = in + pos + n;
+  frame->arena_len = value;
+
+  *last = frame->timestamp;
+
+  return pos + n + value;
+}
+
+static void test_varints(void)
+{
+  uint8_t out[LOG_WIRE_VARINT_MAX];
+
+  CHECK(log_wire_varint(0, out) == 1 && out[0] == 0x00);
+  CHECK(log_wire_varint(127, out) == 1 && out[0] == 0x7F);
+  CHECK(log_wire_varint(128, out) == 2 && out[0] == 0x80 && out[1] == 0x01);
+  CHECK(log_wire_varint(300, out) == 2 && out[0] == 0xAC && out[1] == 0x02);
+  CHECK(log_wire_varint(UINT64_MAX, out) == LOG_WIRE_VARINT_MAX && out[9] == 0x01);
+}
+
+static void test_small_record_is_a_few_bytes(void)
+{
+  LogWireEncoder enc;
+  const uint32_t words[] = { 5, (uint32_t)-3 };
+  LogWireFrame frame = { .id = 200, .flags = 3, .nwords = 2, .timestamp = 1000,
+                         .words = words, .arena = NULL, .arena_len = 0 };
+  const uint8_t expect_first[] = { 0xA5, 0x0B, 0xC8, 0x01, 0xE8, 0x07, 0x02, 0x0A, 0x05, 0x00 };
+  const uint8_t expect_next[] = { 0xA5, 0x03, 0xC8, 0x01, 0x90, 0x03, 0x02, 0x0A, 0x05, 0x00 };
+  uint8_t out[64];
+
+  log_wire_init(&enc, 32);
+
+  // First frame: absolute time 1000
+  CHECK(log_wire_encode(&enc, &frame, out, sizeof(out)) == sizeof(expect_first));
+  CHECK(memcmp(out, expect_first, sizeof(expect_first)) == 0);
+
+  // Then 200 cycles later: zigzag delta 400
+  frame.timestamp = 1200;
+  CHECK(log_wire_encode(&enc, &frame, out, sizeof(out)) == sizeof(expect_next));
+  CHECK(memcmp(out, expect_next, sizeof(expect_next)) == 0);
+}
+
+static void test_frames_read_back(void)
+{
+  LogWireEncoder enc;
+  const uint32_t words[] = { 0, 1, 0xFFFFFFFFu, 0x80000000u, 0x7FFFFFFFu, 0x40490FDBu };
+  const uint8_t arena[] = "abc\0de";
+  const uint64_t times[] = { 0x123456789ull, 0x123456789ull + 5000, 0x123456789ull + 4000, 0x123456789ull + (1ull << 40) };
+  LogWireFrame frame = { .id = 7, .flags = 1 | LOG_WIRE_REPORT, .nwords = 6,
+                         .words = words, .arena = arena, .arena_len = sizeof(arena) };
+  uint8_t stream[256];
+  size_t len = 0;
+  uint64_t last = 0;
+  WireFrame_t got;
+  size_t n;
+
+  log_wire_init(&enc, 32);
+
+  // Out of order times too, two tasks may queue their records swapped
+  for(int i = 0; i < 4; i++)
+  {
+    frame.timestamp = times[i];
+    frame.id = 7 + i * 1000;
+    len += log_wire_encode(&enc, &frame, stream + len, sizeof(stream) - len);
+  }
+
+  for(int i = 0; i < 4; i++)
+  {
+    n = wire_decode(stream, len, &last, &got);
+    CHECK(n > 0);
+    CHECK(got.id == 7 + i * 1000);
+    CHECK(got.timestamp == times[i]);
+    CHECK((got.flags & LOG_WIRE_LEVEL_MASK) == 1 && (got.flags & LOG_WIRE_REPORT));
+    CHECK(got.nwords == 6 && memcmp(got.words, words, sizeof(words)) == 0);
+    CHECK(got.arena_len == sizeof(arena) && memcmp(got.arena, arena, sizeof(arena)) == 0);
+    memmove(stream, stream + n, len - n);
+    len -= n;
+  }
+  CHECK(len == 0);
+}
+
+static void test_absolute_time_is_repeated(void)
+{
+  LogWireEncoder enc;
+  LogWireFrame frame = { .id = 1, .flags = 3, .nwords = 0, .words = NULL, .arena = NULL, .arena_len = 0 };
+  uint8_t out[64];
+  int absolute = 0;
+
+  log_wire_init(&enc, 4);
+
+  for(int i = 0; i < 12; i++)
+  {
+    frame.timestamp = 100 * i;
+    CHECK(log_wire_encode(&enc, &frame, out, sizeof(out)) > 0);
+    if(out[1] & LOG_WIRE_ABSOLUTE)
+    {
+      CHECK(i % 4 == 0);
+      absolute++;
+    }
+  }
+
+  CHECK(absolute == 3);
+}
+
+static void test_frame_that_may_not_fit_is_refused(void)
+{
+  LogWireEncoder enc;
+  const uint32_t words[] = { 1, 2 };
+  LogWireFrame frame = { .id = 1, .flags = 3, .nwords = 2, .timestamp = 50,
+                         .words = words, .arena = NULL, .arena_len = 0 };
+  uint8_t out[64];
+
+  log_wire_init(&enc, 32);
+
+  CHECK(log_wire_encode(&enc, &frame, out, LOG_WIRE_FRAME_MAX(2, 0) - 1) == 0);
+
+  // Nothing was sent, the next frame still carries the absolute time
+  CHECK(log_wire_encode(&enc, &frame, out, sizeof(out)) > 0);
+  CHECK(out[1] & LOG_WIRE_ABSOLUTE);
+}
+
+int main(void)
+{
+  RUN_TEST(test_varints);
+  RUN_TEST(test_small_record_is_a_few_bytes);
+  RUN_TEST(test_frames_read_back);
+  RUN_TEST(test_absolute_time_is_repeated);
+  RUN_TEST(test_frame_that_may_not_fit_is_refused);
+
+  return unittest_result();
+}
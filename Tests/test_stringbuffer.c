@@ -0,0 +1,431 @@
+/*****************************************************************************
+* | File        : test_stringbuffer.c
+* | Author      : Luke Mulder
+* | Function    : Unit tests of the packed StringBuffer
+* | Info        :
+*   Covers the wrap behind a padding entry, the overflow policies and their
+*   loss accounting, leases, span leases and static instances. Entries
+*   carry a sequence number in their first word so order and content can
+*   be checked after every wrap.
+******************************************************************************/
+
+#include <stdint.h>
+#include "stringbuffer.h"
+#include "unittest.h"
+
+STR_BUF_DEFINE(static, static_buffer, 256, 32);
+
+// Pushes an entry of len bytes starting with seq
+static int push_seq(StringBuffer *sb, uint32_t seq, size_t len)
+{
+  uint8_t data[STRING_BUFFER_MAX_LENGTH];
+
+  memset(data, (int)seq, sizeof(data));
+  memcpy(data, &seq, sizeof(seq));
+
+  return str_buf_push_data(sb, data, len);
+}
+
+static uint32_t entry_seq(const void *entry)
+{
+  uint32_t seq;
+
+  memcpy(&seq, entry, sizeof(seq));
+
+  return seq;
+}
+
+static void test_init_rejects_bad_sizes(void)
+{
+  StringBuffer sb;
+
+  CHECK(str_buf_init_custom_size(&sb, 100, 16) == -1);
+  CHECK(str_buf_init_custom_size(&sb, 0, 16) == -1);
+  // The largest entry must fit twice
+  CHECK(str_buf_init_custom_size(&sb, 64, 32) == -1);
+  CHECK(str_buf_init_custom_size(&sb, 128, 32) == 0);
+  str_buf_free(&sb);
+}
+
+static void test_push_pop_in_order(void)
+{
+  StringBuffer sb;
+  void *entry;
+
+  CHECK(str_buf_init_custom_size(&sb, 256, 32) == 0);
+
+  for(uint32_t i = 0; i < 5; i++)
+    CHECK(push_seq(&sb, i, 8 + i) == 0);
+
+  CHECK(str_buff_count(&sb) == 5);
+
+  for(uint32_t i = 0; i < 5; i++)
+  {
+    CHECK(str_buf_pop_data(&sb, &entry) == 8 + i);
+    CHECK(entry != NULL && entry_seq(entry) == i);
+  }
+
+  CHECK(str_buf_pop_data(&sb, &entry) == 0);
+  CHECK(entry == NULL);
+
+  str_buf_free(&sb);
+}
+
+static void test_data_reads_reject_null(void)
+{
+  StringBuffer sb;
+  void *entry;
+
+  CHECK(str_buf_init_custom_size(&sb, 256, 32) == 0);
+  CHECK(push_seq(&sb, 1, 8) == 0);
+
+  CHECK(str_buf_peek_data(NULL, &entry) == 0);
+  CHECK(str_buf_peek_data(&sb, NULL) == 0);
+  CHECK(str_buf_pop_data(NULL, &entry) == 0);
+  CHECK(str_buf_pop_data(&sb, NULL) == 0);
+
+  // Nothing was taken
+  CHECK(str_buff_count(&sb) == 1);
+
+  str_buf_free(&sb);
+}
+
+static void test_leases_reject_null(void)
+{
+  StringBuffer sb;
+  StrBufSpan spans[2];
+  void *entry;
+
+  CHECK(str_buf_init_custom_size(&sb, 256, 32) == 0);
+  CHECK(push_seq(&sb, 1, 8) == 0);
+
+  CHECK(str_buf_lease(NULL, &entry) == 0);
+  CHECK(str_buf_lease(&sb, NULL) == 0);
+  CHECK(str_buf_lease_spans(NULL, spans) == 0);
+  CHECK(str_buf_lease_spans(&sb, NULL) == 0);
+
+  // Nothing was leased, the entry can still be popped
+  CHECK(str_buf_pop_data(&sb, &entry) == 8);
+
+  str_buf_free(&sb);
+}
+
+static void test_strings_keep_terminator(void)
+{
+  StringBuffer sb;
+  char *str;
+
+  CHECK(str_buf_init_custom_size(&sb, 256, 16) == 0);
+
+  CHECK(str_buf_push(&sb, "hello") == 0);
+  CHECK(str_buf_push(&sb, "a string longer than sixteen bytes") == 0);
+
+  CHECK(str_buf_pop(&sb, &str) == 0);
+  CHECK(str != NULL && strcmp(str, "hello") == 0);
+  CHECK(str_buf_pop(&sb, &str) == 0);
+  CHECK(str != NULL && strcmp(str, "a string longer") == 0);
+
+  str_buf_free(&sb);
+}
+
+static void test_wrap_keeps_entries_contiguous(void)
+{
+  StringBuffer sb;
+  uint32_t next = 0;
+  void *entry;
+  size_t len;
+
+  CHECK(str_buf_init_custom_size(&sb, 128, 40) == 0);
+
+  // Odd sizes move the wrap point around, every entry must read back whole
+  for(uint32_t i = 0; i < 200; i++)
+  {
+    CHECK(push_seq(&sb, i, 20 + (i % 3) * 7) == 0);
+
+    len = str_buf_pop_data(&sb, &entry);
+    CHECK(len == 20 + (i % 3) * 7);
+    CHECK(entry != NULL && entry_seq(entry) == next);
+    CHECK((uint8_t*)entry + len <= sb.buf + sb.buf_size);
+    next++;
+  }
+
+  CHECK(str_buff_count(&sb) == 0);
+  CHECK(str_buff_dropped(&sb) == 0);
+
+  str_buf_free(&sb);
+}
+
+static void test_large_storage_wraps(void)
+{
+  StringBuffer sb;
+  uint32_t pushed = 0;
+  uint32_t next = 0;
+  void *entry;
+  size_t len;
+
+  // Beyond what a 16-bit length could describe
+  CHECK(str_buf_init_custom_size(&sb, 256 * 1024, STRING_BUFFER_MAX_LENGTH) == 0);
+
+  // Kept about half full so the wrap point moves through the whole storage
+  while(pushed < 5000)
+  {
+    len = 150 + (pushed % 7) * 13;
+    CHECK(push_seq(&sb, pushed, len) == 0);
+    pushed++;
+
+    if(str_buff_used_bytes(&sb) > sb.buf_size / 2)
+    {
+      len = str_buf_pop_data(&sb, &entry);
+      CHECK(len == 150 + (next % 7) * 13);
+      CHECK(entry != NULL && entry_seq(entry) == next);
+      CHECK((uint8_t*)entry + len <= sb.buf + sb.buf_size);
+      next++;
+    }
+  }
+
+  while(str_buf_pop_data(&sb, &entry) != 0)
+    CHECK(entry_seq(entry) == next++);
+
+  CHECK(next == pushed);
+  CHECK(str_buff_dropped(&sb) == 0);
+
+  str_buf_free(&sb);
+}
+
+static void test_overwrite_oldest_counts_losses(void)
+{
+  StringBuffer sb;
+  void *entry;
+  uint32_t seq = 0;
+
+  CHECK(str_buf_init_custom_size(&sb, 128, 28) == 0);
+
+  // 28 bytes plus prefix take 32, four fit
+  while(push_seq(&sb, seq, 28) == 0)
+    seq++;
+
+  CHECK(seq == 4);
+  CHECK(str_buff_dropped(&sb) == 1);
+  CHECK(str_buff_dropped_bytes(&sb) == 28);
+
+  // The oldest entry went, the newest is stored
+  CHECK(str_buf_pop_data(&sb, &entry) == 28);
+  CHECK(entry_seq(entry) == 1);
+  CHECK(str_buff_count(&sb) == 3);
+
+  str_buf_free(&sb);
+}
+
+static void test_drop_newest_keeps_old_entries(void)
+{
+  StringBuffer sb;
+  void *entry;
+
+  CHECK(str_buf_init_custom_size(&sb, 128, 28) == 0);
+  CHECK(str_buf_set_policy(&sb, STR_BUF_DROP_NEWEST) == 0);
+
+  for(uint32_t i = 0; i < 4; i++)
+    CHECK(push_seq(&sb, i, 28) == 0);
+
+  CHECK(push_seq(&sb, 4, 10) == STR_BUF_FULL);
+  CHECK(str_buff_dropped(&sb) == 1);
+  CHECK(str_buff_dropped_bytes(&sb) == 10);
+
+  CHECK(str_buf_pop_data(&sb, &entry) == 28);
+  CHECK(entry_seq(entry) == 0);
+
+  str_buf_free(&sb);
+}
+
+static void test_block_counts_only_discards(void)
+{
+  StringBuffer sb;
+
+  CHECK(str_buf_init_custom_size(&sb, 128, 28) == 0);
+  CHECK(str_buf_set_policy(&sb, STR_BUF_BLOCK) == 0);
+  CHECK(str_buf_set_policy(&sb, (StringBufferPolicy_e)7) == -1);
+
+  for(uint32_t i = 0; i < 4; i++)
+    CHECK(push_seq(&sb, i, 28) == 0);
+
+  // Retrying is free, only giving up counts
+  CHECK(push_seq(&sb, 4, 28) == STR_BUF_FULL);
+  CHECK(push_seq(&sb, 4, 28) == STR_BUF_FULL);
+  CHECK(str_buff_dropped(&sb) == 0);
+
+  CHECK(str_buf_discard(&sb, 28) == 0);
+  CHECK(str_buff_dropped(&sb) == 1);
+  CHECK(str_buff_dropped_bytes(&sb) == 28);
+
+  str_buf_free(&sb);
+}
+
+static void test_reserve_commit_hands_back_the_rest(void)
+{
+  StringBuffer sb;
+  uint8_t *entry;
+  void *out;
+  int status;
+
+  CHECK(str_buf_init_custom_size(&sb, 128, 40) == 0);
+
+  CHECK(str_buf_reserve(&sb, 41, &status) == NULL && status == -1);
+
+  entry = str_buf_reserve(&sb, 40, &status);
+  CHECK(entry != NULL && status == 0);
+  memcpy(entry, "abcdef", 6);
+  CHECK(str_buf_commit(&sb, entry + 4, 6) == -1);
+  CHECK(str_buf_commit(&sb, entry, 41) == -1);
+  CHECK(str_buf_commit(&sb, entry, 6) == 0);
+  CHECK(sb.head == STR_BUF_ENTRY_SIZE(6));
+
+  // Withdrawn as if never reserved
+  entry = str_buf_reserve(&sb, 40, &status);
+  CHECK(entry != NULL && str_buff_count(&sb) == 2);
+  CHECK(str_buf_cancel(&sb, entry) == 0);
+  CHECK(str_buff_count(&sb) == 1);
+  CHECK(sb.head == STR_BUF_ENTRY_SIZE(6));
+
+  CHECK(push_seq(&sb, 9, 8) == 0);
+  CHECK(str_buf_pop_data(&sb, &out) == 6);
+  CHECK(memcmp(out, "abcdef", 6) == 0);
+  CHECK(str_buf_pop_data(&sb, &out) == 8);
+  CHECK(entry_seq(out) == 9);
+
+  str_buf_free(&sb);
+}
+
+static void test_cancel_behind_padding(void)
+{
+  StringBuffer sb;
+  StrBufSpan spans[2];
+  uint8_t *entry;
+  void *out;
+  int status;
+
+  CHECK(str_buf_init_custom_size(&sb, 128, 40) == 0);
+
+  // Tail and head at 96, a 40 byte reservation wraps behind a padding
+  for(uint32_t i = 0; i < 3; i++)
+  {
+    CHECK(push_seq(&sb, i, 28) == 0);
+    CHECK(str_buf_pop_data(&sb, &out) == 28);
+  }
+
+  entry = str_buf_reserve(&sb, 40, &status);
+  CHECK(entry == sb.buf + STR_BUF_HEADER_SIZE);
+  CHECK(str_buf_cancel(&sb, entry) == 0);
+  CHECK(str_buff_count(&sb) == 0);
+  CHECK(str_buf_pop_data(&sb, &out) == 0);
+
+  // The padding went with it, a short entry still fits before the end
+  CHECK(sb.head == sb.tail);
+  CHECK(push_seq(&sb, 7, 20) == 0);
+  CHECK(str_buf_lease_spans(&sb, spans) == 1);
+  CHECK(spans[0].data == sb.buf + 96 && spans[1].len == 0);
+  CHECK(str_buf_release(&sb, 1) == 0);
+
+  CHECK(push_seq(&sb, 8, 20) == 0);
+  CHECK(str_buf_pop_data(&sb, &out) == 20);
+  CHECK(entry_seq(out) == 8);
+  CHECK(str_buff_count(&sb) == 0);
+
+  str_buf_free(&sb);
+}
+
+static void test_leased_entries_are_not_overwritten(void)
+{
+  StringBuffer sb;
+  void *first;
+  void *second;
+  char *str;
+
+  CHECK(str_buf_init_custom_size(&sb, 128, 28) == 0);
+
+  for(uint32_t i = 0; i < 4; i++)
+    CHECK(push_seq(&sb, i, 28) == 0);
+
+  CHECK(str_buf_lease(&sb, &first) == 28);
+  CHECK(str_buf_lease(&sb, &second) == 28);
+  CHECK(entry_seq(first) == 0 && entry_seq(second) == 1);
+
+  // Overwrite-oldest falls back to losing the new entry
+  CHECK(push_seq(&sb, 4, 28) == STR_BUF_FULL);
+  CHECK(entry_seq(first) == 0);
+  CHECK(str_buf_pop(&sb, &str) == -1);
+
+  CHECK(str_buf_release(&sb, 3) == -1);
+  CHECK(str_buf_release(&sb, 2) == 0);
+  CHECK(str_buff_count(&sb) == 2);
+  CHECK(push_seq(&sb, 5, 28) == 0);
+
+  str_buf_free(&sb);
+}
+
+static void test_lease_spans_cover_the_wrap(void)
+{
+  StringBuffer sb;
+  StrBufSpan spans[2];
+  void *entry;
+
+  CHECK(str_buf_init_custom_size(&sb, 128, 40) == 0);
+
+  // Three 32 byte entries, two taken: one pending at 64..96
+  for(uint32_t i = 0; i < 3; i++)
+    CHECK(push_seq(&sb, i, 28) == 0);
+  for(uint32_t i = 0; i < 2; i++)
+    CHECK(str_buf_pop_data(&sb, &entry) == 28);
+
+  // 44 bytes do not fit in the last 32, the entry goes behind a padding
+  CHECK(push_seq(&sb, 3, 40) == 0);
+
+  CHECK(str_buf_lease_spans(&sb, spans) == 2);
+  CHECK(spans[0].data == sb.buf + 64 && spans[0].len == 32);
+  CHECK(spans[1].data == sb.buf && spans[1].len == STR_BUF_ENTRY_SIZE(40));
+  CHECK(entry_seq(spans[0].data + STR_BUF_HEADER_SIZE) == 2);
+  CHECK(entry_seq(spans[1].data + STR_BUF_HEADER_SIZE) == 3);
+
+  CHECK(str_buf_lease_spans(&sb, spans) == 0);
+  CHECK(str_buf_release(&sb, 2) == 0);
+  CHECK(str_buff_count(&sb) == 0);
+
+  str_buf_free(&sb);
+}
+
+static void test_static_instance(void)
+{
+  void *entry;
+
+  // Usable without an init call
+  CHECK(push_seq(&static_buffer, 7, 16) == 0);
+  CHECK(str_buf_pop_data(&static_buffer, &entry) == 16);
+  CHECK(entry_seq(entry) == 7);
+  CHECK((uint8_t*)entry > static_buffer_storage);
+
+  CHECK(str_buf_init_static(&static_buffer, static_buffer_storage + 1, 256, 32) == -1);
+  CHECK(str_buf_init_static(&static_buffer, static_buffer_storage, 256, 32) == 0);
+
+  // Static storage is never freed
+  str_buf_free(&static_buffer);
+}
+
+int main(void)
+{
+  RUN_TEST(test_init_rejects_bad_sizes);
+  RUN_TEST(test_push_pop_in_order);
+  RUN_TEST(test_data_reads_reject_null);
+  RUN_TEST(test_leases_reject_null);
+  RUN_TEST(test_strings_keep_terminator);
+  RUN_TEST(test_wrap_keeps_entries_contiguous);
+  RUN_TEST(test_large_storage_wraps);
+  RUN_TEST(test_overwrite_oldest_counts_losses);
+  RUN_TEST(test_drop_newest_keeps_old_entries);
+  RUN_TEST(test_block_counts_only_discards);
+  RUN_TEST(test_reserve_commit_hands_back_the_rest);
+  RUN_TEST(test_cancel_behind_padding);
+  RUN_TEST(test_leased_entries_are_not_overwritten);
+  RUN_TEST(test_lease_spans_cover_the_wrap);
+  RUN_TEST(test_static_instance);
+
+  return unittest_result();
+}
@@ -0,0 +1,105 @@
+/*****************************************************************************
+* | File        : test_typedring.c
+* | Author      : Luke Mulder
+* | Function    : Unit tests of the generated typed rings
+******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "typedring.h"
+#include "unittest.h"
+
+typedef struct {
+  uint32_t seq;
+  uint16_t channel[3];
+} Sample_t;
+
+TYPED_RING_DEFINE(plain_ring, uint32_t, 8);
+TYPED_RING_DEFINE_SPSC(sample_ring, Sample_t, 16);
+// Elements that end in the middle of a cache line
+TYPED_RING_DEFINE(byte_ring, uint8_t, 4);
+
+static void test_zero_initialized_ring_is_empty(void)
+{
+  static sample_ring_t ring;
+  Sample_t sample;
+
+  CHECK(sample_ring_count(&ring) == 0);
+  CHECK(sample_ring_space(&ring) == 16);
+  CHECK(sample_ring_pop(&ring, &sample) == -1);
+  CHECK(((uintptr_t)ring.items % TYPED_RING_CACHE_LINE) == 0);
+}
+
+static void test_cursors_have_their_own_cache_line(void)
+{
+  // Cleaning or invalidating the elements' lines leaves the cursors alone
+  CHECK(offsetof(byte_ring_t, head) == TYPED_RING_CACHE_LINE);
+  CHECK(offsetof(byte_ring_t, tail) < 2 * TYPED_RING_CACHE_LINE);
+  CHECK(sizeof(byte_ring_t) == 2 * TYPED_RING_CACHE_LINE);
+  CHECK(offsetof(sample_ring_t, head) == sizeof(((sample_ring_t*)0)->items));
+  CHECK(sizeof(sample_ring_t) % TYPED_RING_CACHE_LINE == 0);
+}
+
+static void test_push_until_full(void)
+{
+  plain_ring_t ring;
+  uint32_t value;
+
+  plain_ring_init(&ring);
+
+  for(uint32_t i = 0; i < 8; i++)
+    CHECK(plain_ring_push(&ring, &i) == 0);
+
+  value = 8;
+  CHECK(plain_ring_push(&ring, &value) == -1);
+  CHECK(plain_ring_count(&ring) == 8);
+
+  for(uint32_t i = 0; i < 8; i++)
+  {
+    CHECK(plain_ring_pop(&ring, &value) == 0);
+    CHECK(value == i);
+  }
+}
+
+static void test_bulk_across_the_wrap(void)
+{
+  static sample_ring_t ring;
+  Sample_t in[24];
+  Sample_t out[24];
+  uint32_t next_in = 0;
+  uint32_t next_out = 0;
+
+  for(int round = 0; round < 50; round++)
+  {
+    uint32_t n = 3 + round % 11;
+    uint32_t done;
+
+    for(uint32_t i = 0; i < n; i++)
+      in[i].seq = next_in + i;
+    done = sample_ring_push_bulk(&ring, in, n);
+    CHECK(done <= n);
+    next_in += done;
+
+    done = sample_ring_pop_bulk(&ring, out, 1 + round % 7);
+    for(uint32_t i = 0; i < done; i++)
+    {
+      CHECK(out[i].seq == next_out);
+      next_out++;
+    }
+
+    CHECK(sample_ring_count(&ring) == next_in - next_out);
+  }
+
+  // More than fits is cut to the free space
+  CHECK(sample_ring_push_bulk(&ring, in, 24) == 16 - (next_in - next_out));
+}
+
+int main(void)
+{
+  RUN_TEST(test_zero_initialized_ring_is_empty);
+  RUN_TEST(test_cursors_have_their_own_cache_line);
+  RUN_TEST(test_push_until_full);
+  RUN_TEST(test_bulk_across_the_wrap);
+
+  return unittest_result();
+}
@@ -0,0 +1,53 @@
+/*****************************************************************************
+* | File        : unittest.h
+* | Author      : Luke Mulder
+* | Function    : Minimal unit test helpers for the host test suite
+* | Info        :
+*   CHECK records a failure and carries on, so a run reports every broken
+*   expectation. RUN_TEST prints one line per test, unittest_result is
+*   the exit code of the test program.
+******************************************************************************/
+#ifndef UNITTEST_H
+#define UNITTEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+static int unittest_failures;
+static int unittest_test_failed;
+
+#define CHECK(expr) \
+  do { \
+    if (!(expr)) \
+    { \
+      printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+      unittest_failures++; \
+      unittest_test_failed = 1; \
+    } \
+  } while (0)
+
+#define CHECK_STR_CONTAINS(haystack, needle) \
+  do { \
+    if (strstr((haystack), (needle)) == NULL) \
+    { \
+      printf("  %s:%d: \"%s\" not found in \"%s\"\n", __FILE__, __LINE__, (needle), (haystack)); \
+      unittest_failures++; \
+      unittest_test_failed = 1; \
+    } \
+  } while (0)
+
+#define RUN_TEST(test) \
+  do { \
+    unittest_test_failed = 0; \
+    test(); \
+    printf("%-4s %s\n", unittest_test_failed ? "FAIL" : "ok", #test); \
+  } while (0)
+
+static inline int unittest_result(void)
+{
+  printf("%s, %d failed checks\n", unittest_failures ? "FAILED" : "PASSED", unittest_failures);
+
+  return unittest_failures ? 1 : 0;
+}
+
+#endif // UNITTEST_H
@@ -0,0 +1,141 @@
+/*****************************************************************************
+* | File        : wire_frames.c
+* | Author      : Luke Mulder
+* | Function    : Frames for the host decoder test
+* | Info        :
+*   Encodes a fixed set of records with logwire.c, the way logTask sends
+*   them, and writes next to them the line the target itself would print,
+*   its message formatted by log_snprintf. test_logdecode.py decodes the
+*   frames with Tools/logdecode.py and compares the two, so decoder and
+*   target formatter are held to the same output.
+*
+*   Argument words are laid out as captured on the Cortex-M7: one word per
+*   int, two per long long and double, %s as an offset into the arena.
+*
+*   Usage: wire_frames frames.bin expected.txt
+*   expected.txt holds one "site id<TAB>format<TAB>line" entry per frame.
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "logwire.h"
+#include "logformat.h"
+
+#define CLOCK_HZ 216000000u
+
+static LogWireEncoder encoder;
+static uint64_t now = 5ull * CLOCK_HZ + 12345;
+static uint16_t next_id;
+
+// Seconds with nanosecond digits, as the text output prints them
+static void format_time(char *out, size_t size, uint64_t cycles)
+{
+  uint64_t ns = cycles * 1000000000ull / CLOCK_HZ;
+
+  snprintf(out, size, "%llu.%09llu", (unsigned long long)(ns / 1000000000u), (unsigned long long)(ns % 1000000000u));
+}
+
+static const char* level_name(uint8_t flags)
+{
+  switch(flags & LOG_WIRE_LEVEL_MASK)
+  {
+    case 1:  return "ERROR";
+    case 2:  return "WARNING";
+    case 3:  return "INFO";
+    default: return "NONE";
+  }
+}
+
+/**
+ * Writes one record's frame and the line expected for it. Each record gets
+ * its own site, the decoder test names them after the ID.
+ */
+static void emit(FILE *frames, FILE *expected, uint8_t flags, const char *format, const uint32_t *words,
+                 uint8_t nwords, const char *arena, size_t arena_len, const char *message)
+{
+  LogWireFrame frame = { next_id, flags, nwords, now, words, (const uint8_t*)arena, arena_len };
+  uint8_t out[LOG_WIRE_FRAME_MAX(8, 64)];
+  size_t len = log_wire_encode(&encoder, &frame, out, sizeof(out));
+  char time[32];
+
+  fwrite(out, 1, len, frames);
+  format_time(time, sizeof(time), now);
+  fprintf(expected, "%u\t%s\t[%s] [%s] wire_frames.c:%u main() - %s\n",
+          next_id, format, time, level_name(flags), next_id, message);
+
+  next_id++;
+  // Mixed small and large steps, some deltas take several varint bytes
+  now += (next_id & 1) ? 1000 : 3 * CLOCK_HZ + 7;
+}
+
+#define WORDS(...) (const uint32_t[]){ __VA_ARGS__ }, sizeof((const uint32_t[]){ __VA_ARGS__ }) / sizeof(uint32_t)
+
+// Splits a 64-bit value into the two words it is captured as
+#define LO(v) ((uint32_t)(v))
+#define HI(v) ((uint32_t)((uint64_t)(v) >> 32))
+
+static uint64_t double_bits(double value)
+{
+  uint64_t bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+
+  return bits;
+}
+
+int main(int argc, char **argv)
+{
+  FILE *frames;
+  FILE *expected;
+  char message[128];
+  uint64_t f1 = double_bits(3.14159);
+  uint64_t f2 = double_bits(-2.5);
+  long long ll = -1234567890123ll;
+
+  if(argc != 3)
+  {
+    fprintf(stderr, "usage: %s frames.bin expected.txt\n", argv[0]);
+    return 2;
+  }
+
+  frames = fopen(argv[1], "wb");
+  expected = fopen(argv[2], "w");
+  if(frames == NULL || expected == NULL)
+    return 1;
+
+  // Every few frames carries the absolute time, the rest deltas
+  log_wire_init(&encoder, 4);
+
+  // Short conversions are cut to char and short like the target does
+  log_snprintf(message, sizeof(message), "%hhd %hhu %hd %hu", 200, 300, 40000, 70000);
+  emit(frames, expected, 2, "%hhd %hhu %hd %hu", WORDS(200, 300, 40000, 70000), NULL, 0, message);
+
+  log_snprintf(message, sizeof(message), "%hhx %hX %hhd", 0x1FF, 0x12345, -1);
+  emit(frames, expected, 3, "%hhx %hX %hhd", WORDS(0x1FF, 0x12345, (uint32_t)-1), NULL, 0, message);
+
+  log_snprintf(message, sizeof(message), "%d %u %x %X %o", -5, 4000000000u, 0xbeef, 0xBEEF, 8);
+  emit(frames, expected, 3, "%d %u %x %X %o", WORDS((uint32_t)-5, 4000000000u, 0xbeef, 0xBEEF, 8), NULL, 0, message);
+
+  log_snprintf(message, sizeof(message), "%c%c %5d|%-4u|%+d", 'o', 'k', 42, 7, 3);
+  emit(frames, expected, 1, "%c%c %5d|%-4u|%+d", WORDS('o', 'k', 42, 7, 3), NULL, 0, message);
+
+  log_snprintf(message, sizeof(message), "%s and %s", "one", "two");
+  emit(frames, expected, 3, "%s and %s", WORDS(0, 4), "one\0two", 8, message);
+
+  log_snprintf(message, sizeof(message), "%lld %llu", ll, 18446744073709551615ull);
+  emit(frames, expected, 2, "%lld %llu", WORDS(LO(ll), HI(ll), 0xFFFFFFFFu, 0xFFFFFFFFu), NULL, 0, message);
+
+  log_snprintf(message, sizeof(message), "%.3f %8.2f", 3.14159, -2.5);
+  emit(frames, expected, 3, "%.3f %8.2f", WORDS(LO(f1), HI(f1), LO(f2), HI(f2)), NULL, 0, message);
+
+  log_snprintf(message, sizeof(message), "%*d|%.*s|%%", 6, 42, 2, "abc");
+  emit(frames, expected, 3, "%*d|%.*s|%%", WORDS(6, 42, 2, 0), "abc", 4, message);
+
+  // Suppression report of a site whose format takes no arguments
+  emit(frames, expected, 2 | LOG_WIRE_REPORT, "tick", WORDS(3, 0), NULL, 0, "last message repeated 3 times");
+
+  fclose(frames);
+  fclose(expected);
+
+  return 0;
+}
@@ -0,0 +1,314 @@
+#!/usr/bin/env python3
+"""
+logdecode.py - Host decoder for the binary log wire format
+
+Restores the text log lines from the binary frames sent by logTask when
+LOG_WIRE_BINARY is enabled in Core/Inc/logging.h. The call-site metadata
+(level, file, line, function and format) is read from the "log_callsites"
+section of the firmware ELF, so the ELF must match the running firmware.
+
+Usage:
+    python3 Tools/logdecode.py [--clock HZ] build/stm32f7-disco-led-logging-printf.elf < capture.bin
+    python3 Tools/logdecode.py [--clock HZ] firmware.elf /dev/ttyACM0
+
+    --clock HZ  core clock the timestamps were counted with (default 216000000)
+
+Frame layout (see Core/Inc/logwire.h):
+    sync (0xA5), flags (u8), then LEB128 varints: call-site ID, time,
+    word count, each argument word zigzag encoded, arena length, followed
+    by the %s string arena
+
+    Bits 0-1 of the flags are the level. 0x04 marks a suppression report,
+    its two words are the call site's repeated and rate limited message
+    counts. 0x08 marks an absolute time in core clock cycles, otherwise
+    the time is the zigzag encoded delta to the previous frame. Until the
+    first absolute frame is seen the timestamps are printed as "?".
+"""
+
+import re
+import struct
+import sys
+
+CALL_SITE_SECTION = "log_callsites"
+CALL_SITE_SIZE = 24
+
+FRAME_SYNC = 0xA5
+FRAME_LEVEL_MASK = 0x03
+FRAME_REPORT = 0x04
+FRAME_ABSOLUTE = 0x08
+FRAME_RESERVED = 0xF0
+VARINT_MAX = 10
+
+# Sanity limits of a frame, LOG_MAX_ARG_WORDS and the arena are far below
+FRAME_MAX_WORDS = 64
+FRAME_MAX_ARENA = 4096
+
+DEFAULT_CLOCK_HZ = 216000000
+
+LEVELS = {1: "ERROR", 2: "WARNING", 3: "INFO"}
+
+# Argument sizes on the Cortex-M7 target (ILP32, 64-bit double)
+INT_SIZES = {"": 4, "h": 4, "hh": 4, "l": 4, "ll": 8, "j": 8, "z": 4, "t": 4, "L": 8}
+# Bits the target's formatter keeps of an argument, %hhd prints a char
+INT_BITS = {"h": 16, "hh": 8}
+
+SPEC_RE = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|j|z|t|L)?([diouxXcfFeEgGaApsn%])")
+
+
+class Elf:
+    """Minimal ELF32 little endian reader, just enough to resolve strings."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError("%s is not a 32-bit little endian ELF" % path)
+
+        (shoff,) = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.data, 0x2E)
+
+        headers = [struct.unpack_from("<IIIIIIIIII", self.data, shoff + i * shentsize) for i in range(shnum)]
+        names_offset = headers[shstrndx][4]
+
+        self.sections = {}
+        for name, sh_type, flags, addr, offset, size, _, _, _, _ in headers:
+            self.sections[self.cstring_at(names_offset + name)] = (sh_type, flags, addr, offset, size)
+
+    def cstring_at(self, offset):
+        end = self.data.index(b"\0", offset)
+        return self.data[offset:end].decode("utf-8", "replace")
+
+    def section_data(self, name):
+        _, _, _, offset, size = self.sections[name]
+        return self.data[offset:offset + size]
+
+    def string_at_address(self, address):
+        for sh_type, flags, addr, offset, size in self.sections.values():
+            # Allocated PROGBITS sections hold the strings in flash
+            if sh_type == 1 and flags & 0x2 and addr <= address < addr + size:
+                return self.cstring_at(offset + address - addr)
+        return "<0x%08x>" % address
+
+
+def load_call_sites(elf):
+    if CALL_SITE_SECTION not in elf.sections:
+        raise ValueError("ELF has no %s section, was it built with logging enabled?" % CALL_SITE_SECTION)
+
+    data = elf.section_data(CALL_SITE_SECTION)
+    sites = []
+    for offset in range(0, len(data) - CALL_SITE_SIZE + 1, CALL_SITE_SIZE):
+        # The level is taken from each frame, it is what the target logged
+        file_ptr, func_ptr, fmt_ptr, line, _, _, _, _ = struct.unpack_from("<IIIHBBII", data, offset)
+        sites.append({
+            "file": elf.string_at_address(file_ptr),
+            "func": elf.string_at_address(func_ptr),
+            "format": elf.string_at_address(fmt_ptr),
+            "line": line,
+        })
+    return sites
+
+
+def format_message(fmt, words, arena):
+    """Formats the captured argument words the way the target's printf would."""
+    out = []
+    pos = 0
+    word = 0
+
+    def take(count):
+        nonlocal word
+        if word + count > len(words):
+            raise IndexError
+        value = 0
+        for i in range(count):
+            value |= words[word + i] << (32 * i)
+        word += count
+        return value
+
+    def signed(value, size):
+        bits = size * 8
+        return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+    for match in SPEC_RE.finditer(fmt):
+        out.append(fmt[pos:match.start()])
+        pos = match.end()
+        flags, width, precision, length, conv = match.groups()
+        length = length or ""
+
+        if conv == "%":
+            out.append("%")
+            continue
+        if conv == "n":
+            continue
+
+        try:
+            star_args = []
+            if width == "*":
+                star_args.append(signed(take(1), 4))
+            if precision == "*":
+                star_args.append(signed(take(1), 4))
+
+            spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+
+            if conv in "diouxX":
+                size = INT_SIZES[length]
+                bits = INT_BITS.get(length, size * 8)
+                value = take(size // 4) & ((1 << bits) - 1)
+                if conv in "di":
+                    value = signed(value, bits // 8)
+                conv = "d" if conv in "diu" else conv
+            elif conv == "c":
+                value = chr(take(1) & 0xFF)
+            elif conv in "fFeEgGaA":
+                (value,) = struct.unpack("<d", struct.pack("<Q", take(2)))
+                conv = {"a": "e", "A": "E"}.get(conv, conv)
+            elif conv == "p":
+                value = take(1)
+                spec = "0x%" + flags
+                conv = "x"
+            else:
+                offset = take(1)
+                end = arena.find(b"\0", offset)
+                value = arena[offset:end if end >= 0 else len(arena)].decode("utf-8", "replace")
+        except IndexError:
+            # Arguments past LOG_MAX_ARG_WORDS were not captured
+            return "".join(out)
+
+        out.append((spec + conv) % tuple(star_args + [value]))
+
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def format_report(words):
+    repeated, suppressed = words
+    if repeated and suppressed:
+        return "last message repeated %d times, %d more rate limited" % (repeated, suppressed)
+    if repeated:
+        return "last message repeated %d times" % repeated
+    return "%d messages rate limited" % suppressed
+
+
+def format_timestamp(cycles, clock_hz):
+    """Seconds with nanosecond digits, as printed by the text output."""
+    ns = cycles * 1000000000 // clock_hz
+    return "%d.%09d" % (ns // 1000000000, ns % 1000000000)
+
+
+class Incomplete(Exception):
+    """The buffer ends inside a frame, more bytes are needed."""
+
+
+class Invalid(Exception):
+    """The buffer does not start with a frame."""
+
+
+def read_varint(buf, pos):
+    value = 0
+    for i in range(VARINT_MAX):
+        if pos + i >= len(buf):
+            raise Incomplete
+        value |= (buf[pos + i] & 0x7F) << (7 * i)
+        if not buf[pos + i] & 0x80:
+            return value, pos + i + 1
+    raise Invalid
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def parse_frame(buf, site_count):
+    """Returns (flags, site ID, time, words, arena, frame length) of the frame at the start of buf."""
+    if len(buf) < 2:
+        raise Incomplete
+    flags = buf[1]
+    if buf[0] != FRAME_SYNC or flags & FRAME_RESERVED:
+        raise Invalid
+
+    site_id, pos = read_varint(buf, 2)
+    if site_id >= site_count:
+        raise Invalid
+    time, pos = read_varint(buf, pos)
+
+    nwords, pos = read_varint(buf, pos)
+    if nwords > FRAME_MAX_WORDS:
+        raise Invalid
+    words = []
+    for _ in range(nwords):
+        value, pos = read_varint(buf, pos)
+        words.append(unzigzag(value) & 0xFFFFFFFF)
+
+    arena_len, pos = read_varint(buf, pos)
+    if arena_len > FRAME_MAX_ARENA:
+        raise Invalid
+    if len(buf) < pos + arena_len:
+        raise Incomplete
+
+    return flags, site_id, time, words, buf[pos:pos + arena_len], pos + arena_len
+
+
+def decode_stream(stream, sites, out, clock_hz):
+    buf = b""
+    # Time of the previous frame, None until an absolute one arrives
+    last = None
+    while True:
+        # read1 returns whatever is available so live captures are not held back
+        chunk = stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+        if not chunk:
+            break
+        buf += chunk
+
+        while buf:
+            try:
+                flags, site_id, time, words, arena, frame_len = parse_frame(buf, len(sites))
+            except Incomplete:
+                break
+            except Invalid:
+                # Not a frame start, resynchronise on the next sync byte. The
+                # deltas of any frame lost on the way would be missing too.
+                start = buf.find(bytes([FRAME_SYNC]), 1)
+                buf = buf[start:] if start >= 0 else b""
+                last = None
+                continue
+            buf = buf[frame_len:]
+
+            if flags & FRAME_ABSOLUTE:
+                last = time
+            elif last is not None:
+                last += unzigzag(time)
+
+            site = sites[site_id]
+            if flags & FRAME_REPORT and len(words) == 2:
+                message = format_report(words)
+            else:
+                message = format_message(site["format"], words, arena)
+            timestamp = format_timestamp(last, clock_hz) if last is not None else "?"
+            level = LEVELS.get(flags & FRAME_LEVEL_MASK, "NONE")
+            out.write("[%s] [%s] %s:%d %s() - %s\n" % (timestamp, level,
+                                                        site["file"], site["line"], site["func"], message))
+            out.flush()
+
+
+def main(argv):
+    clock_hz = DEFAULT_CLOCK_HZ
+    if len(argv) > 2 and argv[1] == "--clock":
+        clock_hz = int(argv[2])
+        argv = argv[:1] + argv[3:]
+
+    if len(argv) not in (2, 3):
+        sys.stderr.write(__doc__)
+        return 2
+
+    sites = load_call_sites(Elf(argv[1]))
+
+    if len(argv) == 3:
+        with open(argv[2], "rb", buffering=0) as stream:
+            decode_stream(stream, sites, sys.stdout, clock_hz)
+    else:
+        decode_stream(sys.stdin.buffer, sites, sys.stdout, clock_hz)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""
+rttdump.py - Extracts the log output from a RAM dump of the RTT control block
+
+Finds the control block logTask writes with LOG_OUTPUT_RTT (see
+Core/Inc/logrtt.h) by its "SEGGER RTT" ID and writes the up-buffer
+contents to stdout. Useful post mortem, when no probe software was
+attached while the firmware ran. Binary frames (LOG_WIRE_BINARY) can be
+piped on into logdecode.py.
+
+Usage:
+    python3 Tools/rttdump.py [--all] BASE ram.bin
+    python3 Tools/rttdump.py 0x20000000 ram.bin | python3 Tools/logdecode.py firmware.elf
+
+    BASE   address the dump starts at, e.g. 0x20000000
+    --all  the whole ring, oldest byte first, instead of the unread bytes
+
+Take the dump with e.g. gdb "dump binary memory ram.bin 0x20000000 0x20050000"
+or OpenOCD "dump_image ram.bin 0x20000000 0x50000".
+
+Control block layout (little endian, 32-bit pointers):
+    id[16], max_up (i32), max_down (i32),
+    up-buffers:   name, buf, size, wr_off, rd_off, flags (u32 each)
+"""
+
+import struct
+import sys
+
+RTT_ID = b"SEGGER RTT\0"
+RTT_ID_SIZE = 16
+DESCRIPTOR_SIZE = 24
+
+
+def read_string(dump, base, address, limit=32):
+    offset = address - base
+    if not 0 <= offset < len(dump):
+        return "?"
+    end = dump.find(b"\0", offset, offset + limit)
+    return dump[offset:end if end >= 0 else offset + limit].decode("ascii", "replace")
+
+
+def extract(dump, base, everything):
+    """Yields (name, bytes) of every up-buffer of the first control block."""
+    cb = dump.find(RTT_ID)
+    while cb >= 0 and cb % 4:
+        cb = dump.find(RTT_ID, cb + 1)
+    if cb < 0:
+        raise ValueError("no RTT control block in the dump")
+
+    max_up, _max_down = struct.unpack_from("<ii", dump, cb + RTT_ID_SIZE)
+
+    for i in range(max_up):
+        name, buf, size, wr, rd, _flags = struct.unpack_from("<IIIIII", dump, cb + RTT_ID_SIZE + 8 + i * DESCRIPTOR_SIZE)
+        offset = buf - base
+
+        if size == 0 or wr >= size or rd >= size or not 0 <= offset <= len(dump) - size:
+            raise ValueError("up-buffer %d descriptor is not valid" % i)
+
+        ring = dump[offset:offset + size]
+        # Oldest byte right after the write offset, one byte always stays free
+        start = (wr + 1) % size if everything else rd
+        data = ring[start:wr] if start <= wr else ring[start:] + ring[:wr]
+
+        yield read_string(dump, base, name), data.lstrip(b"\0") if everything else data
+
+
+def main(argv):
+    everything = len(argv) > 1 and argv[1] == "--all"
+    if everything:
+        argv = argv[:1] + argv[2:]
+
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 2
+
+    with open(argv[2], "rb") as f:
+        dump = f.read()
+
+    for name, data in extract(dump, int(argv[1], 0), everything):
+        sys.stderr.write("%s: %d bytes\n" % (name, len(data)))
+        sys.stdout.buffer.write(data)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))